@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "index_common.hpp"
+#include "index_edge.hpp"
+#include "index_block.hpp"
+
+namespace ssindex {
+
+/// |BatchLocator| maps each key to the id of the batch holding its newest
+/// version. It's a stack of segments, each a set of retrieval blocks, one
+/// per partition (see |ChoosePartitionNum|, a segment has its own count),
+/// storing batch ids without false positive validation bits, so it costs
+/// a few bits per key (log2 of the number of batches, times the
+/// redundancy).
+///
+/// A segment is built from a snapshot of some batches, which are
+/// "covered". Later on:
+/// 1) Flushed batches are not covered, they form a tail that has to be
+/// probed before the locator. A new segment is built from the tail, and
+/// it replaces the newest segments that are not larger than what it's
+/// built from, by building from their batches as well: segments grow
+/// geometrically, so an entry is rebuilt a logarithmic number of times.
+/// 2) Compacted batches are remapped to the batch replacing them, which is
+/// covered only if all of its sources are.
+///
+/// Segments are searched from the newest. For a key of an older segment,
+/// or an absent one, a segment returns an arbitrary id, and the block of
+/// the batch is responsible for rejecting it.
+template<typename KeyType>
+class BatchLocator {
+public:
+    using Blocks = std::vector<IndexBlock<uint64_t>>;
+
+    explicit BatchLocator() = default;
+
+    /// Push a segment built from the batches |ids| holding |entry_num|
+    /// entries, in place of the |absorbed| newest segments. |covered| are
+    /// the batches covered along with the segment, as of the snapshot it's
+    /// built from: the compactions since then must be replayed.
+    void AddSegment(Blocks blocks, const std::vector<uint64_t> & ids, uint64_t entry_num, size_t absorbed,
+                    std::unordered_set<uint64_t> covered) {
+        segments_.resize(segments_.size() - std::min(absorbed, segments_.size()));
+        Segment segment{std::move(blocks), {}, entry_num};
+        for (auto id : ids) {
+            segment.owners_.emplace(id, id);
+        }
+        segments_.emplace_back(std::move(segment));
+        covered_ = std::move(covered);
+    }
+
+    auto GetSegmentNum() const -> size_t {
+        return segments_.size();
+    }
+
+    /// Number of entries the |segment|-th newest segment is built from
+    auto GetSegmentEntryNum(size_t segment) const -> uint64_t {
+        return getSegment(segment).entry_num_;
+    }
+
+    /// Add the ids of the batches located by the |segment|-th newest
+    /// segment to |ids|
+    void CollectSegmentBatches(size_t segment, std::unordered_set<uint64_t> * ids) const {
+        for (auto & owner : getSegment(segment).owners_) {
+            ids->insert(owner.second);
+        }
+    }
+
+    /// Id of the batch owning the newest version of the key among the
+    /// batches of the |segment|-th newest segment, or |KeyNotFound| if the
+    /// segment rejects the key, |hash| is the |IndexUtils::Hash| of the key
+    auto Locate(size_t segment, const char * kbuf, const size_t klen, uint64_t hash) const -> uint64_t {
+        auto & seg = getSegment(segment);
+        auto & block = seg.blocks_.at(hash % seg.blocks_.size());
+        IndexEdge<uint64_t> ie{kbuf, klen, 0, block.GetSeed()};
+        auto id = block.GetValue(ie);
+        /// an absent key may get an id the segment is not built from
+        auto iter = seg.owners_.find(id);
+        return iter == seg.owners_.end() ? IndexUtils<uint64_t>::KeyNotFound() : iter->second;
+    }
+
+    auto IsCovered(uint64_t id) const -> bool {
+        return covered_.count(id) != 0;
+    }
+
+    /// Batches |sources| are compacted into the batch |target|
+    void OnCompaction(const std::vector<uint64_t> & sources, uint64_t target) {
+        bool all_covered = true;
+        for (auto source : sources) {
+            all_covered = all_covered && IsCovered(source);
+            covered_.erase(source);
+        }
+        if (all_covered) {
+            covered_.insert(target);
+        }
+        /// owners point to live batches only, nothing to follow later
+        std::unordered_set<uint64_t> compacted(sources.begin(), sources.end());
+        for (auto & segment : segments_) {
+            for (auto & owner : segment.owners_) {
+                if (compacted.count(owner.second) != 0) {
+                    owner.second = target;
+                }
+            }
+        }
+    }
+
+    /// Number of bytes used by the locator
+    auto GetFootprint() const -> size_t {
+        size_t sum = 0;
+        for (auto & segment : segments_) {
+            for (auto & block : segment.blocks_) {
+                sum += block.GetFootprint();
+            }
+        }
+        return sum;
+    }
+
+private:
+    struct Segment {
+        /// Retrieval blocks of batch ids, one per partition
+        Blocks blocks_;
+
+        /// Batch id stored in the blocks -> id of the batch holding its
+        /// entries now, which differs once the batch is compacted
+        std::unordered_map<uint64_t, uint64_t> owners_;
+
+        uint64_t entry_num_ = 0;
+    };
+
+    auto getSegment(size_t segment) const -> const Segment & {
+        return segments_.at(segments_.size() - 1 - segment);
+    }
+
+    /// Oldest first
+    std::vector<Segment> segments_;
+
+    /// Ids of the batches whose keys are located
+    std::unordered_set<uint64_t> covered_;
+};
+
+}  // namespace ssindex
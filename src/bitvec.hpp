@@ -4,16 +4,35 @@
 #include <fstream>
 #include <iostream>
 #include <cassert>
+#include <bitset>
+#include <cstring>
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
 
 #include "index_common.hpp"
 
 namespace ssindex {
 
+/// Bit array of fixed-width fields.
+///
+/// Storage is padded by one word (see |Resize|), so besides the generic
+/// accessors, fields can be read and written branch-free:
+/// 1) |getBitsPacked| & |setBitsPacked| handle fields of at most
+/// |PackedMaxBits| bits with one unaligned 64-bit load (or store), a shift
+/// and a mask, as a field starting at any bit fits in the 8 bytes from
+/// its first byte.
+/// 2) |getBitsWide| handles fields of up to 64 bits with two loads.
+///
+/// The packed accessors assume a little-endian machine.
 template<typename ValueType>
 class BitVec {
 public:
     static constexpr size_t BitsNum = 64;
 
+    /// Widest field read by a single unaligned load
+    static constexpr size_t PackedMaxBits = BitsNum - 7;
+
     explicit BitVec() : data_(std::vector<uint64_t>{}) {}
 
     explicit BitVec(size_t size) {
@@ -25,11 +44,17 @@ public:
         return data_.empty();
     }
 
+    /// One more word is allocated, so that a field can always be read
+    /// together with its next word (e.g. by a gather)
     auto Resize(size_t new_size) {
-        data_.resize((new_size + BitsNum - 1) / BitsNum);
+        data_.resize((new_size + BitsNum - 1) / BitsNum + 1);
         fill(data_.begin(), data_.end(), 0);
     }
 
+    auto Data() const -> const uint64_t * {
+        return data_.data();
+    }
+
     auto BitsCount() const -> size_t {
         return data_.size() * BitsNum;
     }
@@ -118,17 +143,53 @@ public:
         return ret;
     }
 
+    /// |len| in [1, 64]
+    static auto lowBits(uint64_t bits, size_t len) -> uint64_t {
+#if defined(__BMI2__)
+        return _bzhi_u64(bits, static_cast<unsigned>(len));
+#else
+        return bits & (~0LLU >> (BitsNum - len));
+#endif
+    }
+
+    /// Read a field of at most |PackedMaxBits| bits
+    auto getBitsPacked(size_t pos, size_t len) const -> uint64_t {
+        uint64_t word = 0;
+        memcpy(&word, reinterpret_cast<const char *>(data_.data()) + pos / 8, sizeof(word));
+        return lowBits(word >> (pos % 8), len);
+    }
+
+    /// Write a field of at most |PackedMaxBits| bits
+    auto setBitsPacked(size_t pos, size_t len, uint64_t bits) {
+        auto * addr = reinterpret_cast<char *>(data_.data()) + pos / 8;
+        uint64_t word = 0;
+        memcpy(&word, addr, sizeof(word));
+        uint64_t shift = pos % 8;
+        uint64_t field_mask = lowBits(~0LLU, len) << shift;
+        word = (word & ~field_mask) | ((bits << shift) & field_mask);
+        memcpy(addr, &word, sizeof(word));
+    }
+
+    /// Read a field of up to 64 bits, the second word is shifted in two
+    /// steps, so that an aligned field takes nothing from it
+    auto getBitsWide(size_t pos, size_t len) const -> uint64_t {
+        uint64_t index = pos / BitsNum;
+        uint64_t offset = pos % BitsNum;
+        uint64_t bits = (data_[index] >> offset) | ((data_[index + 1] << 1) << (BitsNum - 1 - offset));
+        return lowBits(bits, len);
+    }
+
     auto write(std::ofstream & ofs) const {
         auto data_size = static_cast<uint64_t>(data_.size());
         ofs.write((const char *)(&data_size), sizeof(data_size));
-        ofs.write((const char *)(&data_[0]), sizeof(data_[0]) * data_size);
+        ofs.write((const char *)(data_.data()), sizeof(uint64_t) * data_size);
     }
 
     auto read(std::ifstream & ifs) {
         uint64_t data_size = 0;
         ifs.read((char *)(&data_size), sizeof(data_size));
         data_.resize(data_size);
-        ifs.read((char *)(&data_[0]), sizeof(data_[0]) * data_size);
+        ifs.read((char *)(data_.data()), sizeof(uint64_t) * data_size);
     }
 
     auto printInfo() {
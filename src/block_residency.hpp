@@ -0,0 +1,421 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "index_common.hpp"
+#include "index_block.hpp"
+
+namespace ssindex {
+
+/// A block of a batch, i.e. its partition
+struct BlockKey {
+    uint64_t batch_id_;
+    uint64_t partition_;
+
+    auto operator==(const BlockKey & other) const -> bool {
+        return batch_id_ == other.batch_id_ && partition_ == other.partition_;
+    }
+};
+
+struct BlockKeyHasher {
+    auto operator()(const BlockKey & key) const -> size_t {
+        return std::hash<uint64_t>{}(key.batch_id_ * 0x9e3779b97f4a7c15LLU ^ key.partition_);
+    }
+};
+
+struct BlockResidencyStats {
+    uint64_t resident_bytes_ = 0;
+    uint64_t faults_ = 0;
+    uint64_t evictions_ = 0;
+    /// Victims which failed to be written to their block files, and
+    /// stayed resident
+    uint64_t spill_failures_ = 0;
+};
+
+/// Access tracking & eviction policy of |BlockResidency|
+///
+/// |OnAccess| is called by the readers on every probe of a resident block,
+/// concurrently and without any lock, so it must be cheap and thread-safe.
+/// The other calls may run concurrently with it, but never with each other.
+class ResidencyPolicy {
+public:
+    virtual ~ResidencyPolicy() = default;
+
+    /// |key| becomes resident: built, or faulted back in
+    virtual void OnLoad(const BlockKey & key) = 0;
+
+    virtual void OnAccess(const BlockKey & key) = 0;
+
+    /// |key| is no more resident: evicted, or its batch is dropped
+    virtual void OnRemove(const BlockKey & key) = 0;
+
+    /// Resident block to evict next, false if there's none
+    virtual auto PickVictim(BlockKey * key) -> bool = 0;
+};
+
+/// CLOCK over the resident blocks, the default policy: an access sets the
+/// reference bit of a block, and the hand clears the bits until it meets a
+/// block not referenced since its last pass (see |ReadCache| as well).
+class ClockResidencyPolicy : public ResidencyPolicy {
+public:
+    void OnLoad(const BlockKey & key) override {
+        std::lock_guard<std::shared_mutex> w_latch{mutex_};
+        uint64_t pos;
+        if (!free_.empty()) {
+            pos = free_.back();
+            free_.pop_back();
+        } else {
+            pos = slots_.size();
+            slots_.emplace_back(std::make_unique<Slot>());
+        }
+        slots_[pos]->key_ = key;
+        slots_[pos]->used_ = true;
+        slots_[pos]->referenced_.store(false, std::memory_order_relaxed);
+        index_.insert_or_assign(key, pos);
+    }
+
+    void OnAccess(const BlockKey & key) override {
+        std::shared_lock<std::shared_mutex> r_latch{mutex_};
+        if (auto iter = index_.find(key); iter != index_.end()) {
+            slots_[iter->second]->referenced_.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    void OnRemove(const BlockKey & key) override {
+        std::lock_guard<std::shared_mutex> w_latch{mutex_};
+        if (auto iter = index_.find(key); iter != index_.end()) {
+            slots_[iter->second]->used_ = false;
+            free_.emplace_back(iter->second);
+            index_.erase(iter);
+        }
+    }
+
+    auto PickVictim(BlockKey * key) -> bool override {
+        std::lock_guard<std::shared_mutex> w_latch{mutex_};
+        if (index_.empty()) {
+            return false;
+        }
+        while (true) {
+            Slot & slot = *slots_[hand_];
+            hand_ = (hand_ + 1) % slots_.size();
+            if (slot.used_ && !slot.referenced_.exchange(false, std::memory_order_relaxed)) {
+                *key = slot.key_;
+                return true;
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        BlockKey key_{};
+        bool used_ = false;
+        std::atomic<bool> referenced_{false};
+    };
+
+    std::shared_mutex mutex_;
+
+    std::vector<std::unique_ptr<Slot>> slots_;
+
+    /// Unused slots
+    std::vector<uint64_t> free_;
+
+    /// Clock hand
+    uint64_t hand_ = 0;
+
+    std::unordered_map<BlockKey, uint64_t, BlockKeyHasher> index_;
+};
+
+/// Block Residency
+///
+/// |BlockResidency| keeps the bit arrays of the blocks within a memory
+/// budget. When the budget is exceeded, the blocks picked by the
+/// |ResidencyPolicy| are evicted in two steps: |PrepareEviction| writes the
+/// bit arrays of the victims to the block file of their batch the first
+/// time they're evicted (blocks are never modified), and |Evict| releases
+/// them. |Acquire| faults an evicted block back in before a probe. The rest
+/// of a block (seed, widths, dictionary, ...) is small and stays in memory.
+///
+/// The manager leans on the batch lock of the index:
+/// 1) |AddBatch|, |DropBatch| & |Evict| are called with the batches locked
+/// exclusively, so no reader is probing any block, and they do no I/O.
+/// 2) |Acquire| & |PrepareEviction| are called with the batches locked
+/// shared, the readers keep probing the victims being written, faults are
+/// serialized by the manager, and a reader only probes a block once it's
+/// resident.
+///
+/// Blocks of a batch must stay in place from |AddBatch| to |DropBatch|.
+template<typename ValueType>
+class BlockResidency {
+public:
+    using Blocks = std::vector<IndexBlock<ValueType>>;
+
+    /// The policy is CLOCK (see |ClockResidencyPolicy|) if it's not given
+    explicit BlockResidency(size_t memory_budget,
+                            std::string directory = default_working_directory,
+                            std::unique_ptr<ResidencyPolicy> policy = nullptr)
+        : memory_budget_(memory_budget),
+          directory_(std::move(directory)),
+          policy_(policy == nullptr ? std::make_unique<ClockResidencyPolicy>() : std::move(policy)),
+          resident_bytes_(0),
+          faults_(0),
+          evictions_(0),
+          spill_failures_(0) {}
+
+    ~BlockResidency() {
+        for (auto & batch : batches_) {
+            removeBlockFile(batch.second);
+        }
+    }
+
+    /// Track the blocks of a new batch, which are all resident
+    void AddBatch(uint64_t batch_id, Blocks & blocks) {
+        auto & batch = batches_[batch_id];
+        batch.block_num_ = blocks.size();
+        batch.states_ = std::make_unique<BlockState[]>(blocks.size());
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            auto & state = batch.states_[i];
+            state.block_ = &blocks[i];
+            state.bytes_ = blocks[i].GetBitsFootprint();
+            state.resident_.store(true, std::memory_order_relaxed);
+            /// empty blocks have nothing to evict
+            if (state.bytes_ != 0) {
+                resident_bytes_.fetch_add(state.bytes_, std::memory_order_relaxed);
+                policy_->OnLoad(BlockKey{batch_id, i});
+            }
+        }
+    }
+
+    /// Forget the blocks of a batch about to be dropped
+    void DropBatch(uint64_t batch_id) {
+        auto iter = batches_.find(batch_id);
+        if (iter == batches_.end()) {
+            return;
+        }
+        auto & batch = iter->second;
+        for (size_t i = 0; i < batch.block_num_; ++i) {
+            auto & state = batch.states_[i];
+            if (state.bytes_ != 0 && state.resident_.load(std::memory_order_relaxed)) {
+                resident_bytes_.fetch_sub(state.bytes_, std::memory_order_relaxed);
+                policy_->OnRemove(BlockKey{batch_id, i});
+            }
+        }
+        removeBlockFile(batch);
+        batches_.erase(iter);
+    }
+
+    /// Make the block |partition| of the batch resident before probing it
+    auto Acquire(uint64_t batch_id, uint64_t partition) -> Status {
+        auto iter = batches_.find(batch_id);
+        if (iter == batches_.end()) {
+            return Status::SUCCESS;
+        }
+        auto & batch = iter->second;
+        auto & state = batch.states_[partition];
+        if (state.bytes_ == 0) {
+            return Status::SUCCESS;
+        }
+        BlockKey key{batch_id, partition};
+        if (state.resident_.load(std::memory_order_acquire)) {
+            policy_->OnAccess(key);
+            return Status::SUCCESS;
+        }
+
+        std::lock_guard<std::mutex> fault_latch{fault_mutex_};
+        if (state.resident_.load(std::memory_order_acquire)) {
+            return Status::SUCCESS;
+        }
+        std::ifstream ifs(batch.file_name_, std::ios::binary);
+        ifs.seekg(static_cast<std::streamoff>(state.offset_));
+        state.block_->readBits(ifs);
+        if (!ifs) {
+            state.block_->releaseBits();
+            return Status::ERROR;
+        }
+        resident_bytes_.fetch_add(state.bytes_, std::memory_order_relaxed);
+        faults_.fetch_add(1, std::memory_order_relaxed);
+        policy_->OnLoad(key);
+        state.resident_.store(true, std::memory_order_release);
+        return Status::SUCCESS;
+    }
+
+    /// Whether the resident blocks exceed the budget
+    auto OverBudget() const -> bool {
+        return resident_bytes_.load(std::memory_order_relaxed) > memory_budget_;
+    }
+
+    /// Pick the victims to evict down to the budget and write those never
+    /// evicted before to their block files. It returns at once if another
+    /// thread is preparing an eviction.
+    auto PrepareEviction() -> Status {
+        std::unique_lock<std::mutex> evict_latch{evict_mutex_, std::try_to_lock};
+        if (!evict_latch.owns_lock()) {
+            return Status::SUCCESS;
+        }
+        {
+            /// policy calls are serialized with the faults
+            std::lock_guard<std::mutex> fault_latch{fault_mutex_};
+            BlockKey key{};
+            while (resident_bytes_.load(std::memory_order_relaxed) > memory_budget_ + victim_bytes_ &&
+                   policy_->PickVictim(&key)) {
+                /// the victims are not picked again, even if they're accessed
+                /// before |Evict|
+                policy_->OnRemove(key);
+                auto * state = findState(key);
+                if (state != nullptr && state->resident_.load(std::memory_order_relaxed)) {
+                    victims_.emplace_back(key);
+                    victim_bytes_ += state->bytes_;
+                }
+            }
+        }
+        for (auto & key : victims_) {
+            auto * state = findState(key);
+            if (state != nullptr && !state->spilled_) {
+                auto s = spill(batches_.at(key.batch_id_), *state);
+                if (s != Status::SUCCESS) {
+                    spill_failures_.fetch_add(1, std::memory_order_relaxed);
+                    return s;
+                }
+            }
+        }
+        return Status::SUCCESS;
+    }
+
+    /// Release the victims written by |PrepareEviction|, the ones that
+    /// failed to be written stay resident
+    void Evict() {
+        std::lock_guard<std::mutex> evict_latch{evict_mutex_};
+        for (auto & key : victims_) {
+            auto * state = findState(key);
+            if (state == nullptr || !state->resident_.load(std::memory_order_relaxed)) {
+                continue;
+            }
+            if (!state->spilled_) {
+                policy_->OnLoad(key);
+                continue;
+            }
+            state->block_->releaseBits();
+            state->resident_.store(false, std::memory_order_relaxed);
+            resident_bytes_.fetch_sub(state->bytes_, std::memory_order_relaxed);
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+        victims_.clear();
+        victim_bytes_ = 0;
+    }
+
+    /// Number of bytes of the resident bit arrays
+    auto GetResidentBytes() const -> uint64_t {
+        return resident_bytes_.load(std::memory_order_relaxed);
+    }
+
+    auto GetStats() const -> BlockResidencyStats {
+        return BlockResidencyStats{resident_bytes_.load(std::memory_order_relaxed),
+                                   faults_.load(std::memory_order_relaxed),
+                                   evictions_.load(std::memory_order_relaxed),
+                                   spill_failures_.load(std::memory_order_relaxed)};
+    }
+
+private:
+    struct BlockState {
+        IndexBlock<ValueType> * block_ = nullptr;
+
+        /// Bytes of the bit arrays
+        uint64_t bytes_ = 0;
+
+        /// Offset of the bit arrays in the block file, once spilled
+        uint64_t offset_ = 0;
+
+        bool spilled_ = false;
+
+        std::atomic<bool> resident_{true};
+    };
+
+    struct BatchState {
+        std::unique_ptr<BlockState[]> states_;
+
+        size_t block_num_ = 0;
+
+        /// Created by the first eviction of a block of the batch
+        std::string file_name_;
+
+        uint64_t file_size_ = 0;
+    };
+
+    /// State of a block still tracked, null if its batch is dropped
+    auto findState(const BlockKey & key) -> BlockState * {
+        auto iter = batches_.find(key.batch_id_);
+        if (iter == batches_.end() || key.partition_ >= iter->second.block_num_) {
+            return nullptr;
+        }
+        return &iter->second.states_[key.partition_];
+    }
+
+    auto spill(BatchState & batch, BlockState & state) -> Status {
+        if (batch.file_name_.empty()) {
+            batch.file_name_ = FetchNextBlockFileName(directory_);
+        }
+        std::ofstream ofs(batch.file_name_, std::ios::binary | std::ios::app);
+        state.block_->writeBits(ofs);
+        if (!ofs) {
+            /// evictions are retried by the reads, only the first of the
+            /// failures in a row is logged
+            if (!spill_failing_) {
+                std::cerr << "Cannot write block file | " << batch.file_name_ << std::endl;
+            }
+            spill_failing_ = true;
+            return Status::ERROR;
+        }
+        spill_failing_ = false;
+        state.offset_ = batch.file_size_;
+        batch.file_size_ = static_cast<uint64_t>(ofs.tellp());
+        state.spilled_ = true;
+        return Status::SUCCESS;
+    }
+
+    static void removeBlockFile(const BatchState & batch) {
+        if (!batch.file_name_.empty()) {
+            std::error_code ec{};
+            std::filesystem::remove(batch.file_name_, ec);
+        }
+    }
+
+    size_t memory_budget_;
+
+    std::string directory_;
+
+    std::unique_ptr<ResidencyPolicy> policy_;
+
+    /// Batch id -> states of its blocks
+    std::unordered_map<uint64_t, BatchState> batches_;
+
+    /// Serializes the faults
+    std::mutex fault_mutex_;
+
+    /// Serializes the evictions, and guards the victims & the block files
+    std::mutex evict_mutex_;
+
+    /// Picked by |PrepareEviction|, released by |Evict|
+    std::vector<BlockKey> victims_;
+
+    uint64_t victim_bytes_ = 0;
+
+    /// Whether the last victim written failed
+    bool spill_failing_ = false;
+
+    std::atomic<uint64_t> resident_bytes_;
+
+    std::atomic<uint64_t> faults_;
+
+    std::atomic<uint64_t> evictions_;
+
+    std::atomic<uint64_t> spill_failures_;
+};
+
+}  // namespace ssindex
@@ -0,0 +1,193 @@
+#pragma once
+
+#include "index_common.hpp"
+#include "index_archived_file.hpp"
+#include "index_block.hpp"
+#include "scheduler.hpp"
+#include "task_build_partition.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace ssindex {
+
+/// |BulkLoader| builds a whole batch from a flat key/value file, without
+/// going through memtables, per-memtable batches and compactions:
+///
+/// 1) The entries of the input are counted, and the batch picks its
+/// number of partitions from them (see |ChoosePartitionNum|), as a
+/// compacted batch of the same entries does.
+/// 2) The input is streamed into a staging |IndexArchivedFile|, each entry
+/// is routed to its partition, so the file acts as a set of per-partition
+/// spill files and only one page per partition stays in memory. The file
+/// has as many partitions as the batch, up to |max_staging_partition_num|.
+/// 3) The |IndexBlock|s within each partition of the staging file are
+/// built by their own task (see |BuildPartitionTask|), and the tasks run
+/// in parallel on a dedicated scheduler. The newest versions of each
+/// partition of the batch are then written to the file of the batch as a
+/// sorted run, like flushes and compactions do, and the staging file is
+/// removed.
+///
+/// The result is the same single batch as |SsIndex::Optimize| produces.
+/// With a non-zero |memory_budget|, partitions are sorted and built in
+/// external memory (see |ExternalEntryFile| & |ExternalEdgeFile|), each
+/// build task spills beyond that budget.
+///
+/// Each line of the input is "<key>\t<value>", and the last value of a
+/// duplicated key wins.
+template<typename KeyType, typename ValueType>
+class BulkLoader {
+public:
+    using FileHandlePtr = std::shared_ptr<IndexArchivedFile<KeyType, ValueType>>;
+    using Blocks = std::vector<IndexBlock<ValueType>>;
+
+    static constexpr char Delimiter = '\t';
+
+    /// Default most partitions of the staging file, i.e. pages held by the
+    /// staging
+    static constexpr uint64_t MaxStagingPartitionNum = 4096;
+
+    explicit BulkLoader(std::string directory,
+                        uint64_t seed,
+                        uint64_t fp_bits,
+                        size_t parallelism,
+                        size_t memory_budget = 0,
+                        uint64_t max_staging_partition_num = MaxStagingPartitionNum)
+        : directory_(std::move(directory)),
+          max_staging_partition_num_(std::max<uint64_t>(max_staging_partition_num, 1)),
+          block_num_(0),
+          seed_(seed),
+          fp_bits_(fp_bits),
+          parallelism_(parallelism == 0 ? 1 : parallelism),
+          memory_budget_(memory_budget),
+          entry_num_(0) {}
+
+    /// Load the input file and build the blocks of all the partitions
+    auto Load(const std::string & input_file) -> Status {
+        std::ifstream ifs(input_file);
+        if (!ifs.is_open()) {
+            std::cerr << "Cannot open bulk load input | " << input_file << std::endl;
+            return Status::ERROR;
+        }
+
+        uint64_t entry_num = 0;
+        for (std::string line{}; std::getline(ifs, line);) {
+            entry_num += line.empty() ? 0 : 1;
+        }
+        ifs.clear();
+        ifs.seekg(0);
+        block_num_ = ChoosePartitionNum(entry_num);
+
+        auto staging_name = FetchNextArchivedFileName(directory_);
+        auto staging = std::make_shared<IndexArchivedFile<KeyType, ValueType>>(
+                staging_name, std::min(block_num_, max_staging_partition_num_));
+        auto s = stage(ifs, *staging);
+        if (s != Status::SUCCESS) {
+            return discard(staging, staging_name, s);
+        }
+
+        auto output_name = FetchNextArchivedFileName(directory_);
+        file_handle_ = std::make_shared<IndexArchivedFile<KeyType, ValueType>>(output_name, block_num_);
+        s = Build(staging);
+        if (s == Status::SUCCESS) {
+            s = file_handle_->Freeze();
+        }
+        if (s != Status::SUCCESS) {
+            discard(file_handle_, output_name, s);
+        }
+        return discard(staging, staging_name, s);
+    }
+
+    /// Build the blocks of all the partitions from |input|, which are
+    /// rewritten to |file_handle_| as sorted runs
+    auto Build(const FileHandlePtr & input) -> Status {
+        blocks_ = Blocks(block_num_);
+        /// partitions of a file are not written concurrently
+        std::mutex output_latch{};
+        Scheduler scheduler{parallelism_};
+        TaskGroup build_tasks{};
+        for (uint64_t part = 0; part < input->GetPartitionNum(); ++part) {
+            auto task = std::make_unique<BuildPartitionTask<KeyType, ValueType>>(
+                    input, part, &blocks_, seed_, fp_bits_, memory_budget_, directory_);
+            task->SetOutput(file_handle_, &output_latch);
+            build_tasks.Add(scheduler.ScheduleTask(std::move(task)));
+        }
+        auto s = build_tasks.Wait();
+        scheduler.Stop();
+        return s;
+    }
+
+    auto GetEntryNum() const -> uint64_t {
+        return entry_num_;
+    }
+
+    /// outputs
+    FileHandlePtr file_handle_;
+    Blocks blocks_;
+
+private:
+    /// Route every entry of the input to its partition of |staging|
+    auto stage(std::ifstream & ifs, IndexArchivedFile<KeyType, ValueType> & staging) -> Status {
+        std::string line{};
+        uint64_t line_num = 0;
+        while (std::getline(ifs, line)) {
+            line_num++;
+            if (line.empty()) {
+                continue;
+            }
+            auto pos = line.rfind(Delimiter);
+            KeyType key{};
+            ValueType value{};
+            if (pos == std::string::npos
+                || IndexUtils<KeyType>::FromString(line.substr(0, pos), &key) != Status::SUCCESS
+                || IndexUtils<ValueType>::FromString(line.substr(pos + 1), &value) != Status::SUCCESS) {
+                std::cerr << "Malformed bulk load entry at line " << line_num << " | " << line << std::endl;
+                return Status::ERROR;
+            }
+            auto s = staging.WriteData(IndexUtils<KeyType>::Hash(key) % staging.GetPartitionNum(), key, value);
+            if (s != Status::SUCCESS) {
+                return s;
+            }
+            entry_num_++;
+        }
+        /// partitions are built from the pages only
+        return staging.Freeze();
+    }
+
+    /// Release |file| and remove it from the disk, returns |s|
+    static auto discard(FileHandlePtr & file, const std::string & file_name, Status s) -> Status {
+        file.reset();
+        std::error_code ec{};
+        std::filesystem::remove(file_name, ec);
+        return s;
+    }
+
+    /// Directory of the archived file and the spilled edges
+    std::string directory_;
+
+    /// A power of two, as the partition counts of the batches
+    uint64_t max_staging_partition_num_;
+
+    /// Number of partitions of the batch
+    uint64_t block_num_;
+
+    uint64_t seed_;
+
+    uint64_t fp_bits_;
+
+    size_t parallelism_;
+
+    /// Memory budget per build task, 0 for building in memory
+    size_t memory_budget_;
+
+    /// Number of lines loaded, including duplicated keys
+    uint64_t entry_num_;
+};
+
+}  // namespace ssindex
@@ -2,6 +2,8 @@
 
 #include <string>
 #include <iostream>
+#include <cstring>
+#include <type_traits>
 
 #include "index_common.hpp"
 
@@ -71,16 +73,56 @@ public:
     }
 };
 
-template<>
-class Codec<std::pair<std::string, uint64_t>> {
+/// A key/value entry of a fixed-width key, it's a fixed-size record of the
+/// key followed by the value, without any padding in between
+template<typename KeyType, typename ValueType>
+class Codec<std::pair<KeyType, ValueType>> {
+public:
+    static_assert(std::is_trivially_copyable_v<KeyType>, "fixed-width keys are trivially copyable");
+
+    static constexpr size_t RecordSize = sizeof(KeyType) + sizeof(ValueType);
+
+    static auto EncodeValue(
+            const std::pair<KeyType, ValueType> & entry,
+            char * dest,
+            size_t space,
+            size_t * used = nullptr) -> Status {
+        if (RecordSize > space) {
+            return Status::PAGE_FULL;
+        }
+        memcpy(dest, &entry.first, sizeof(KeyType));
+        memcpy(dest + sizeof(KeyType), &entry.second, sizeof(ValueType));
+        if (used != nullptr) {
+            *used = RecordSize;
+        }
+        return Status::SUCCESS;
+    }
+
+    static auto DecodeValue(
+            const char * src,
+            std::pair<KeyType, ValueType> * dest,
+            size_t * used = nullptr
+            ) {
+        memcpy(&dest->first, src, sizeof(KeyType));
+        memcpy(&dest->second, src + sizeof(KeyType), sizeof(ValueType));
+        if (used != nullptr) {
+            *used = RecordSize;
+        }
+    }
+};
+
+/// A key/value entry, the key is length-prefixed and the value takes
+/// |sizeof(ValueType)| bytes
+template<typename ValueType>
+class Codec<std::pair<std::string, ValueType>> {
 public:
     static auto EncodeValue(
-            const std::pair<std::string, uint64_t> & entry,
+            const std::pair<std::string, ValueType> & entry,
             char * dest,
             size_t space,
             size_t * used = nullptr) -> Status {
         auto & key = entry.first;
-        if (key.size() + 2 * sizeof(uint64_t) >= space) {
+        if (key.size() + sizeof(uint64_t) + sizeof(ValueType) >= space) {
             return Status::PAGE_FULL;
         }
         uint64_t length = key.size();
@@ -89,24 +131,24 @@ public:
         //strcpy(dest + sizeof(uint64_t), key.data());
         memcpy(dest + sizeof(uint64_t), key.data(), length);
 
-        Codec<uint64_t>::EncodeValue(entry.second, dest + sizeof(uint64_t) + length, sizeof(uint64_t));
+        Codec<ValueType>::EncodeValue(entry.second, dest + sizeof(uint64_t) + length, sizeof(ValueType));
 
         if (used != nullptr) {
-            *used = 2 * sizeof(uint64_t) + static_cast<size_t>(length);
+            *used = sizeof(uint64_t) + sizeof(ValueType) + static_cast<size_t>(length);
         }
         return Status::SUCCESS;
     }
 
     static auto DecodeValue(
             const char * src,
-            std::pair<std::string, uint64_t> * dest,
+            std::pair<std::string, ValueType> * dest,
             size_t * used = nullptr
             ) {
         std::string key{};
-        uint64_t value;
+        ValueType value;
         size_t used1 = 0, used2 = 0;
         Codec<std::string>::DecodeValue(src, &key, &used1);
-        Codec<uint64_t>::DecodeValue(src + used1, &value, &used2);
+        Codec<ValueType>::DecodeValue(src + used1, &value, &used2);
         *dest = std::make_pair(std::move(key), value);
         if (used != nullptr) {
             *used = used1 + used2;
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <filesystem>
+
+#include "index_common.hpp"
+#include "index_edge.hpp"
+
+namespace ssindex {
+
+/// |ExternalEdgeFile| spills the hashed edges of a partition to the disk,
+/// so that a block can be built with a bounded amount of memory:
+///
+/// 1) Appended edges are buffered until |memory_budget| is reached, then
+/// the chunk is sorted by hash and written as a sorted run.
+/// 2) |Finish| merges all the runs into one sorted edge file. Edges of the
+/// same key are adjacent after the merge, and only the last appended one
+/// is kept.
+///
+/// The merged file is then consumed sequentially by
+/// |IndexBlock::TryBuildExternal|.
+template<typename ValueType>
+class ExternalEdgeFile {
+public:
+    /// Bytes of an edge on the disk, see |IndexEdge::write|
+    static constexpr size_t RecordSize = sizeof(ValueType) + sizeof(uint64_t) * NumHashFunctions;
+
+    explicit ExternalEdgeFile(std::string file_prefix, size_t memory_budget)
+        : file_prefix_(std::move(file_prefix)),
+          chunk_capacity_(std::max<size_t>(memory_budget / (RecordSize + sizeof(uint64_t)), 1)),
+          entry_num_(0),
+          min_value_(static_cast<ValueType>(-1)),
+          max_value_(0),
+          sequence_(0) {}
+
+    ~ExternalEdgeFile() {
+        for (auto & run : runs_) {
+            std::filesystem::remove(run);
+        }
+        std::filesystem::remove(GetFileName());
+    }
+
+    void Append(const IndexEdge<ValueType> & edge) {
+        if (edge.value_ < min_value_) {
+            min_value_ = edge.value_;
+        }
+        if (edge.value_ > max_value_) {
+            max_value_ = edge.value_;
+        }
+        chunk_.emplace_back(edge, sequence_++);
+        if (chunk_.size() >= chunk_capacity_) {
+            spillChunk();
+        }
+    }
+
+    /// Merge all the sorted runs into the edge file
+    auto Finish() -> Status {
+        if (!chunk_.empty()) {
+            spillChunk();
+        }
+
+        struct Cursor {
+            IndexEdge<ValueType> edge_;
+            size_t run_;
+        };
+        /// smallest edge first, the newest run first among the same edges
+        auto greater = [](const Cursor & c1, const Cursor & c2) -> bool {
+            if (c1.edge_ < c2.edge_) return false;
+            if (c2.edge_ < c1.edge_) return true;
+            return c1.run_ < c2.run_;
+        };
+        std::priority_queue<Cursor, std::vector<Cursor>, decltype(greater)> heap{greater};
+
+        std::vector<std::ifstream> inputs{};
+        inputs.reserve(runs_.size());
+        for (size_t i = 0; i < runs_.size(); ++i) {
+            inputs.emplace_back(runs_[i], std::ios::binary);
+            if (!inputs.back().is_open()) {
+                return Status::ERROR;
+            }
+            Cursor cursor{IndexEdge<ValueType>{}, i};
+            if (readEdge(inputs.back(), cursor.edge_)) {
+                heap.push(cursor);
+            }
+        }
+
+        std::ofstream ofs(GetFileName(), std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            return Status::ERROR;
+        }
+        entry_num_ = 0;
+        bool has_last = false;
+        IndexEdge<ValueType> last{};
+        while (!heap.empty()) {
+            auto cursor = heap.top();
+            heap.pop();
+            if (!has_last || last < cursor.edge_) {
+                cursor.edge_.write(ofs);
+                last = cursor.edge_;
+                has_last = true;
+                entry_num_++;
+            }
+            if (readEdge(inputs[cursor.run_], cursor.edge_)) {
+                heap.push(cursor);
+            }
+        }
+        ofs.close();
+
+        for (auto & input : inputs) {
+            input.close();
+        }
+        for (auto & run : runs_) {
+            std::filesystem::remove(run);
+        }
+        runs_.clear();
+        return ofs.fail() ? Status::ERROR : Status::SUCCESS;
+    }
+
+    static auto readEdge(std::ifstream & ifs, IndexEdge<ValueType> & edge) -> bool {
+        edge.read(ifs);
+        return static_cast<bool>(ifs);
+    }
+
+    auto GetFileName() const -> std::string {
+        return file_prefix_ + ".edges";
+    }
+
+    auto GetFilePrefix() const -> const std::string & {
+        return file_prefix_;
+    }
+
+    /// Number of distinct edges, valid after |Finish|
+    auto GetEntryNum() const -> uint64_t {
+        return entry_num_;
+    }
+
+    auto GetMinValue() const -> ValueType {
+        return min_value_;
+    }
+
+    auto GetMaxValue() const -> ValueType {
+        return max_value_;
+    }
+
+private:
+    void spillChunk() {
+        /// the newest edge goes first among the same ones
+        std::sort(chunk_.begin(), chunk_.end(),
+                [](const std::pair<IndexEdge<ValueType>, uint64_t> & e1,
+                   const std::pair<IndexEdge<ValueType>, uint64_t> & e2) -> bool {
+            if (e1.first < e2.first) return true;
+            if (e2.first < e1.first) return false;
+            return e1.second > e2.second;
+        });
+
+        runs_.emplace_back(file_prefix_ + ".run" + std::to_string(runs_.size()));
+        std::ofstream ofs(runs_.back(), std::ios::binary | std::ios::trunc);
+        for (size_t i = 0; i < chunk_.size(); ++i) {
+            if (i > 0 && !(chunk_[i - 1].first < chunk_[i].first)) {
+                continue;
+            }
+            chunk_[i].first.write(ofs);
+        }
+        chunk_.clear();
+    }
+
+    std::string file_prefix_;
+
+    /// Number of edges buffered before spilling a sorted run
+    size_t chunk_capacity_;
+
+    std::vector<std::pair<IndexEdge<ValueType>, uint64_t>> chunk_;
+
+    std::vector<std::string> runs_;
+
+    uint64_t entry_num_;
+
+    ValueType min_value_;
+
+    ValueType max_value_;
+
+    /// Append order of the edges
+    uint64_t sequence_;
+};
+
+}  // namespace ssindex
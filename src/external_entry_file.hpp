@@ -0,0 +1,198 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <filesystem>
+
+#include "index_common.hpp"
+#include "encoding.hpp"
+
+namespace ssindex {
+
+/// |ExternalEntryFile| sorts the key/value entries of a partition by key
+/// with a bounded amount of memory, the way |ExternalEdgeFile| sorts the
+/// hashed edges:
+///
+/// 1) Appended entries are buffered until |memory_budget| is reached, then
+/// the chunk is sorted by key and written as a sorted run, with only the
+/// last appended version of each key.
+/// 2) |Scan| merges the runs and streams each key once, in increasing
+/// order, with its last appended value. The runs are kept until the file
+/// is destroyed, so it can be scanned again.
+template<typename KeyType, typename ValueType>
+class ExternalEntryFile {
+public:
+    using Entry = std::pair<KeyType, ValueType>;
+
+    explicit ExternalEntryFile(std::string file_prefix, size_t memory_budget)
+        : file_prefix_(std::move(file_prefix)),
+          memory_budget_(std::max<size_t>(memory_budget, 1)),
+          chunk_bytes_(0),
+          sequence_(0),
+          status_(Status::SUCCESS) {}
+
+    ~ExternalEntryFile() {
+        for (auto & run : runs_) {
+            std::error_code ec{};
+            std::filesystem::remove(run, ec);
+        }
+    }
+
+    /// A failed spill is reported by |Finish|
+    void Append(const Entry & entry) {
+        chunk_bytes_ += entryBytes(entry);
+        chunk_.emplace_back(entry, sequence_++);
+        if (chunk_bytes_ >= memory_budget_) {
+            spillChunk();
+        }
+    }
+
+    /// Spill the last chunk, no more entry is appended then
+    auto Finish() -> Status {
+        if (!chunk_.empty()) {
+            spillChunk();
+        }
+        return status_;
+    }
+
+    /// Merge the runs and stream the newest version of each key, in
+    /// increasing key order, to |consumer|
+    auto Scan(const std::function<void(const Entry &)> & consumer) const -> Status {
+        struct Cursor {
+            Entry entry_;
+            size_t run_;
+        };
+        /// smallest key first, the newest run first among the same keys
+        auto greater = [](const Cursor & c1, const Cursor & c2) -> bool {
+            if (c1.entry_.first < c2.entry_.first) return false;
+            if (c2.entry_.first < c1.entry_.first) return true;
+            return c1.run_ < c2.run_;
+        };
+        std::priority_queue<Cursor, std::vector<Cursor>, decltype(greater)> heap{greater};
+
+        std::vector<char> scratch{};
+        std::vector<std::ifstream> inputs{};
+        inputs.reserve(runs_.size());
+        for (size_t i = 0; i < runs_.size(); ++i) {
+            inputs.emplace_back(runs_[i], std::ios::binary);
+            if (!inputs.back().is_open()) {
+                return Status::ERROR;
+            }
+            Cursor cursor{Entry{}, i};
+            if (readEntry(inputs.back(), scratch, cursor.entry_)) {
+                heap.push(std::move(cursor));
+            }
+        }
+
+        bool has_last = false;
+        KeyType last{};
+        while (!heap.empty()) {
+            auto cursor = heap.top();
+            heap.pop();
+            if (!has_last || last < cursor.entry_.first) {
+                consumer(cursor.entry_);
+                last = cursor.entry_.first;
+                has_last = true;
+            }
+            if (readEntry(inputs[cursor.run_], scratch, cursor.entry_)) {
+                heap.push(std::move(cursor));
+            }
+        }
+        for (auto & input : inputs) {
+            if (input.bad()) {
+                return Status::ERROR;
+            }
+        }
+        return Status::SUCCESS;
+    }
+
+    auto GetRunNum() const -> size_t {
+        return runs_.size();
+    }
+
+private:
+    /// Memory held by a buffered entry
+    static auto entryBytes(const Entry & entry) -> size_t {
+        if constexpr (std::is_same_v<KeyType, std::string>) {
+            return sizeof(std::pair<Entry, uint64_t>) + entry.first.capacity();
+        } else {
+            return sizeof(std::pair<Entry, uint64_t>);
+        }
+    }
+
+    /// A record is the length of the encoded entry followed by the entry
+    static auto writeEntry(std::ofstream & ofs, std::vector<char> & scratch, const Entry & entry) {
+        size_t span = 0;
+        if (scratch.empty()) {
+            scratch.resize(64);
+        }
+        while (Codec<Entry>::EncodeValue(entry, scratch.data(), scratch.size(), &span) == Status::PAGE_FULL) {
+            scratch.resize(scratch.size() * 2);
+        }
+        uint64_t length = span;
+        ofs.write(reinterpret_cast<const char *>(&length), sizeof(uint64_t));
+        ofs.write(scratch.data(), static_cast<std::streamsize>(span));
+    }
+
+    static auto readEntry(std::ifstream & ifs, std::vector<char> & scratch, Entry & entry) -> bool {
+        uint64_t length = 0;
+        if (!ifs.read(reinterpret_cast<char *>(&length), sizeof(uint64_t))) {
+            return false;
+        }
+        scratch.resize(std::max<size_t>(scratch.size(), length));
+        if (!ifs.read(scratch.data(), static_cast<std::streamsize>(length))) {
+            return false;
+        }
+        Codec<Entry>::DecodeValue(scratch.data(), &entry);
+        return true;
+    }
+
+    void spillChunk() {
+        /// the newest version goes first among the same keys
+        std::sort(chunk_.begin(), chunk_.end(),
+                [](const std::pair<Entry, uint64_t> & e1, const std::pair<Entry, uint64_t> & e2) -> bool {
+            if (e1.first.first < e2.first.first) return true;
+            if (e2.first.first < e1.first.first) return false;
+            return e1.second > e2.second;
+        });
+
+        runs_.emplace_back(file_prefix_ + ".entries" + std::to_string(runs_.size()));
+        std::ofstream ofs(runs_.back(), std::ios::binary | std::ios::trunc);
+        std::vector<char> scratch{};
+        for (size_t i = 0; i < chunk_.size(); ++i) {
+            if (i > 0 && !(chunk_[i - 1].first.first < chunk_[i].first.first)) {
+                continue;
+            }
+            writeEntry(ofs, scratch, chunk_[i].first);
+        }
+        ofs.close();
+        if (ofs.fail()) {
+            status_ = Status::ERROR;
+        }
+        std::vector<std::pair<Entry, uint64_t>>{}.swap(chunk_);
+        chunk_bytes_ = 0;
+    }
+
+    std::string file_prefix_;
+
+    /// Bytes of entries buffered before spilling a sorted run
+    size_t memory_budget_;
+
+    std::vector<std::pair<Entry, uint64_t>> chunk_;
+
+    size_t chunk_bytes_;
+
+    std::vector<std::string> runs_;
+
+    /// Append order of the entries
+    uint64_t sequence_;
+
+    /// First failure of the spills
+    Status status_;
+};
+
+}  // namespace ssindex
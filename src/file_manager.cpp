@@ -5,6 +5,11 @@
 namespace ssindex {
 
 auto FileManager::WritePage(uint64_t * page_id, WriteBuffer data) -> Status {
+    std::lock_guard<std::mutex> latch{io_mutex_};
+    /// the file cannot be created, e.g. its directory is gone
+    if (!data_file_.is_open()) {
+        return Status::ERROR;
+    }
     *page_id = next_id_++;
     size_t offset = GetOffset(*page_id);
     data_file_.seekp(offset);
@@ -18,6 +23,7 @@ auto FileManager::WritePage(uint64_t * page_id, WriteBuffer data) -> Status {
 }
 
 auto FileManager::ReadPage(uint64_t page_id, ReadBuffer result) -> Status {
+    std::lock_guard<std::mutex> latch{io_mutex_};
     size_t offset = GetOffset(page_id);
     if (offset > GetFileSize(file_name_)) {
         return Status::ERROR;
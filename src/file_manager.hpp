@@ -2,8 +2,10 @@
 
 #include <string>
 #include <sys/stat.h>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include "index_common.hpp"
 
 namespace ssindex {
@@ -57,6 +59,10 @@ private:
     /// File handle
     std::fstream data_file_;
 
+    /// Serializes seek & read/write on |data_file_|, so that pages can be
+    /// read by multiple threads
+    std::mutex io_mutex_;
+
     /// Page id allocator
     uint64_t next_id_;
 };
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <utility>
+#include <cassert>
+
+#include "bitvec.hpp"
+#include "index_edge.hpp"
+
+namespace ssindex {
+
+/// Peel the hyper graph of |index_edges|, where the i-th vertex of an edge
+/// is |get(i, num_v)|. On success, |peeled| holds the edges in peeling
+/// order, each of them with the hash index of the vertex it was the only
+/// edge of when it got removed.
+///
+/// Edges assigned in the reversed peeling order find their other vertices
+/// either final or never assigned, which both |IndexBlock| and |MphBlock|
+/// rely on.
+template<typename ValueType>
+auto PeelHypergraph(const std::vector<IndexEdge<ValueType>> & index_edges,
+                    uint64_t num_v,
+                    std::vector<std::pair<uint64_t, uint8_t>> & peeled) -> Status {
+    const uint64_t entry_num = index_edges.size();
+    std::vector<uint8_t> degs(num_v * NumHashFunctions);
+    std::vector<uint64_t> offsets(num_v * NumHashFunctions + 1);
+
+    for (size_t i = 0; i < index_edges.size(); ++i) {
+        const IndexEdge<ValueType> & ie = index_edges[i];
+        for (uint64_t j = 0; j < NumHashFunctions; ++j) {
+            uint64_t t = ie.get(j, num_v);
+            if (degs[t] == 0xFF) {
+                return Status::ERROR;
+            }
+            ++degs[t];
+        }
+    }
+
+    /// set offsets
+    uint64_t sum = 0;
+    for (size_t i = 0; i < degs.size(); ++i) {
+        offsets[i] = sum;
+        sum += degs[i];
+        degs[i] = 0;
+    }
+    offsets.back() = sum;
+
+    /// set edges
+    std::vector<uint64_t> edges(entry_num * NumHashFunctions);
+    for (size_t i = 0; i < index_edges.size(); ++i) {
+        const IndexEdge<ValueType> & ie = index_edges[i];
+        for (uint64_t j = 0; j < NumHashFunctions; ++j) {
+            uint64_t t = ie.get(j, num_v);
+            edges[offsets[t] + degs[t]++] = i;
+        }
+    }
+
+    /// init queue
+    std::queue<uint64_t> q{};
+    for (size_t i = 0; i < degs.size(); ++i) {
+        if (degs[i] == 1) {
+            q.push(edges[offsets[i]]);
+        }
+    }
+
+    peeled.clear();
+    peeled.reserve(entry_num);
+    BitVec<uint64_t> visited_edges(entry_num);
+    uint64_t deleted_num = 0;
+    while (!q.empty()) {
+        uint64_t v = q.front();
+        q.pop();
+
+        if (visited_edges.getBit(v)) continue;
+        visited_edges.setBit(v);
+        ++deleted_num;
+
+        const IndexEdge<ValueType> & ie(index_edges[v]);
+        int choosed = -1;
+        for (uint64_t i = 0; i < NumHashFunctions; ++i) {
+            const uint64_t t = ie.get(i, num_v);
+            --degs[t];
+
+            if (degs[t] == 0) {
+                choosed = i;
+                continue;
+            } else if (degs[t] >= 2) {
+                continue;
+            }
+            // degs[t] == 1
+            const uint64_t end = offsets[t + 1];
+            for (uint64_t j = offsets[t]; j < end; ++j) {
+                if (!visited_edges.getBit(edges[j])) {
+                    q.push(edges[j]);
+                    break;
+                }
+            }
+        }
+        assert(choosed != -1);
+        peeled.emplace_back(std::make_pair(v, choosed));
+    }
+
+    if (deleted_num != entry_num) {
+        return Status::ERROR;
+    }
+    return Status::SUCCESS;
+}
+
+}  // namespace ssindex
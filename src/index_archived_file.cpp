@@ -1,4 +1,5 @@
 #include <cassert>
+#include <algorithm>
 #include "index_archived_file.hpp"
 #include "encoding.hpp"
 
@@ -6,10 +7,18 @@ namespace ssindex {
 
 template<typename KeyType, typename ValueType>
 auto IndexArchivedFile<KeyType, ValueType>::WriteData(size_t partition_id, KeyType key, ValueType value) -> Status {
+    if (frozen_) {
+        return Status::ERROR;
+    }
+    if (buffers_[partition_id] == nullptr) {
+        buffers_[partition_id] = new char[FileManager::PageSize]();
+    }
     size_t offset = buffer_usages_[partition_id];
     size_t left_space = pageSize() - offset;
     if (left_space <= 0 || left_space > pageSize() - UsedSizeWidth) {
-        flushBuffer(partition_id);
+        if (auto s = flushBuffer(partition_id); s != Status::SUCCESS) {
+            return s;
+        }
         offset = buffer_usages_[partition_id];
         left_space = pageSize() - offset;
     }
@@ -22,23 +31,128 @@ auto IndexArchivedFile<KeyType, ValueType>::WriteData(size_t partition_id, KeyTy
         if (status != Status::PAGE_FULL) {
             return status;
         }
-        flushBuffer(partition_id);
+        if (auto s = flushBuffer(partition_id); s != Status::SUCCESS) {
+            return s;
+        }
         offset = buffer_usages_[partition_id];
         left_space = pageSize() - offset;
         status = Codec<std::pair<KeyType, ValueType>>::EncodeValue(entry, buffer + offset, left_space, &span);
         assert(status == Status::SUCCESS);
     }
+    if (offset == UsedSizeWidth) {
+        fence_keys_[partition_id].emplace_back(entry.first);
+    }
+    if (buffer_usages_[partition_id] != UsedSizeWidth || !page_ids_[partition_id].empty()) {
+        sorted_[partition_id] = sorted_[partition_id] && last_keys_[partition_id] < entry.first;
+    }
     buffer_usages_[partition_id] += span;
+    entry_num_++;
+    last_keys_[partition_id] = std::move(entry.first);
     return Status::SUCCESS;
 }
 
+template<typename KeyType, typename ValueType>
+auto IndexArchivedFile<KeyType, ValueType>::Freeze() -> Status {
+    if (frozen_) {
+        return Status::SUCCESS;
+    }
+    for (size_t i = 0; i < partition_num_; ++i) {
+        if (buffers_[i] == nullptr) {
+            continue;
+        }
+        /// the last page of the partition, its fence key is already kept
+        if (buffer_usages_[i] != UsedSizeWidth) {
+            auto s = flushBuffer(i);
+            if (s != Status::SUCCESS) {
+                return s;
+            }
+        }
+        delete [] buffers_[i];
+        buffers_[i] = nullptr;
+    }
+    file_manager_->Sync();
+    frozen_ = true;
+    return Status::SUCCESS;
+}
+
+template<typename KeyType, typename ValueType>
+auto IndexArchivedFile<KeyType, ValueType>::Lookup(size_t partition_id, const KeyType & key, ValueType * value) const -> Status {
+    if (!sorted_[partition_id]) {
+        /// the last version written wins, as in the blocks built from the
+        /// partition (see |BuildPartitionTask|)
+        bool found = false;
+        auto s = ScanData(partition_id, [&](const std::pair<KeyType, ValueType> & entry) {
+            if (entry.first == key) {
+                *value = entry.second;
+                found = true;
+            }
+        });
+        if (s != Status::SUCCESS) {
+            return s;
+        }
+        return found ? Status::SUCCESS : Status::NOT_FOUND;
+    }
+
+    /// the last page starting at or before |key|
+    auto & fences = fence_keys_[partition_id];
+    auto page = static_cast<size_t>(std::upper_bound(fences.begin(), fences.end(), key) - fences.begin());
+    if (page == 0) {
+        return Status::NOT_FOUND;
+    }
+    page--;
+
+    auto & pids = page_ids_[partition_id];
+    const char * target_page = buffers_[partition_id];
+    size_t end = buffer_usages_[partition_id];
+    std::unique_ptr<char[]> page_buffer{};
+    if (page < pids.size()) {
+        page_buffer = std::make_unique<char[]>(pageSize());
+        auto s = file_manager_->ReadPage(pids[page], page_buffer.get());
+        if (s != Status::SUCCESS) {
+            return s;
+        }
+        uint64_t used;
+        Codec<uint64_t>::DecodeValue(page_buffer.get(), &used);
+        end = static_cast<size_t>(used);
+        target_page = page_buffer.get();
+    }
+
+    for (size_t curr_pos = UsedSizeWidth; curr_pos < end;) {
+        auto entry = std::pair<KeyType, ValueType>{};
+        size_t span = 0;
+        Codec<std::pair<KeyType, ValueType>>::DecodeValue(target_page + curr_pos, &entry, &span);
+        curr_pos += span;
+        if (entry.first == key) {
+            *value = entry.second;
+            return Status::SUCCESS;
+        }
+        if (key < entry.first) {
+            break;
+        }
+    }
+    return Status::NOT_FOUND;
+}
+
 template<typename KeyType, typename ValueType>
 auto IndexArchivedFile<KeyType, ValueType>::ReadData(
         size_t partition_id,
         std::vector<std::pair<KeyType, ValueType>> & result,
         std::function<void(const std::pair<KeyType, ValueType> &)> predicate
                 ) const -> Status {
-    auto pageIterator = [predicate](char * target_page, size_t start_pos, size_t end_pos, std::vector<std::pair<KeyType, ValueType>> & res) {
+    return ScanData(partition_id, [&result, &predicate](const std::pair<KeyType, ValueType> & entry) {
+        if (predicate) {
+            predicate(entry);
+        }
+        result.emplace_back(entry);
+    });
+}
+
+template<typename KeyType, typename ValueType>
+auto IndexArchivedFile<KeyType, ValueType>::ScanData(
+        size_t partition_id,
+        const std::function<void(const std::pair<KeyType, ValueType> &)> & consumer
+                ) const -> Status {
+    auto pageIterator = [&consumer](char * target_page, size_t start_pos, size_t end_pos) {
         //std::cout << "Iterating Page " << start_pos << ", " << end_pos << std::endl;
         size_t curr_pos = start_pos;
         while (curr_pos < end_pos) {
@@ -46,27 +160,31 @@ auto IndexArchivedFile<KeyType, ValueType>::ReadData(
             size_t span = 0;
             Codec<std::pair<KeyType, ValueType>>::DecodeValue(target_page + curr_pos, &entry, &span);
             curr_pos += span;
-            if (predicate) {
-                predicate(entry);
-            }
-            res.emplace_back(entry);
+            consumer(entry);
         }
     };
 
-    char * buffer = buffers_[partition_id];
-    size_t end = buffer_usages_[partition_id];
+    /// spilled pages first, then the buffer, so entries come in write order
+    size_t end = 0;
     size_t curr_pos = UsedSizeWidth;
-
-    pageIterator(buffer, curr_pos, end, result);
-
     auto page_buffer = std::make_unique<char[]>(pageSize());
     for (uint64_t page_id : page_ids_[partition_id]) {
-        file_manager_->ReadPage(page_id, page_buffer.get());
+        auto s = file_manager_->ReadPage(page_id, page_buffer.get());
+        if (s != Status::SUCCESS) {
+            return s;
+        }
         uint64_t used;
         Codec<uint64_t>::DecodeValue(page_buffer.get(), &used);
         end = static_cast<size_t>(used);
         curr_pos = UsedSizeWidth;
-        pageIterator(page_buffer.get(), curr_pos, end, result);
+        pageIterator(page_buffer.get(), curr_pos, end);
+    }
+
+    char * buffer = buffers_[partition_id];
+    if (buffer != nullptr) {
+        end = buffer_usages_[partition_id];
+        curr_pos = UsedSizeWidth;
+        pageIterator(buffer, curr_pos, end);
     }
     return Status::SUCCESS;
 }
@@ -76,6 +194,9 @@ template class IndexArchivedFile<std::string, uint32_t>;
 template class IndexArchivedFile<std::string, uint16_t>;
 template class IndexArchivedFile<std::string, uint8_t>;
 
-// template class IndexArchivedFile<uint64_t, uint64_t>;
+template class IndexArchivedFile<uint64_t, uint64_t>;
+template class IndexArchivedFile<uint64_t, uint32_t>;
+template class IndexArchivedFile<Key128, uint64_t>;
+template class IndexArchivedFile<Key128, uint32_t>;
 
 }  // namespace ssindex
@@ -7,6 +7,8 @@
 #include <iostream>
 #include <functional>
 #include <vector>
+#include <algorithm>
+#include <type_traits>
 
 namespace ssindex {
 
@@ -24,6 +26,15 @@ namespace ssindex {
 /// persisted to the disk, so at this point, |IndexArchivedFile| becomes
 /// a real "file". Since we don't store any metadata within the file,
 /// additional metadata saving process is needed for the crash safety.
+/// |Freeze| switches to this mode once a file is fully written: the
+/// buffers are spilled and released, and reads only go through pages.
+///
+/// A partition written in strictly increasing key order is a sorted run,
+/// and the first key of each of its pages is kept as a fence key, so that
+/// |Lookup| reads the single page that could hold a key.
+///
+/// The buffer of a partition is only allocated by its first write, as a
+/// file of a large batch has many partitions, written one after another.
 template<typename KeyType, typename ValueType>
 class IndexArchivedFile {
 public:
@@ -32,12 +43,13 @@ public:
     explicit IndexArchivedFile(std::string file_name, size_t partition_num)
       : partition_num_(partition_num),
         buffer_usages_(std::vector<size_t>(partition_num, UsedSizeWidth)),
-        page_ids_(std::vector<std::vector<uint64_t>>(partition_num, std::vector<uint64_t>{})) {
-        /// initialize buffers for each partition
-        for (auto i = 0; i < partition_num_; ++i) {
-            buffers_.emplace_back(new char[FileManager::PageSize]);
-        }
-
+        page_ids_(std::vector<std::vector<uint64_t>>(partition_num, std::vector<uint64_t>{})),
+        buffers_(partition_num, nullptr),
+        entry_num_(0),
+        fence_keys_(partition_num),
+        last_keys_(partition_num),
+        sorted_(partition_num, true),
+        frozen_(false) {
         /// initialize the FileManager
         file_manager_ = std::make_unique<FileManager>(std::move(file_name));
     }
@@ -48,15 +60,82 @@ public:
         }
     }
 
-    /// Write the given key/value to the certain partition
+    /// Write the given key/value to the certain partition, it fails once
+    /// the file is frozen
     auto WriteData(size_t partition_id, KeyType key, ValueType value) -> Status;
 
-    /// Read all the data of the certain partition
+    /// Switch to the frozen mode, see above
+    auto Freeze() -> Status;
+
+    auto IsFrozen() const -> bool {
+        return frozen_;
+    }
+
+    /// Read all the data of the certain partition, in the order they were written
     auto ReadData(size_t partition_id,
                   std::vector<std::pair<KeyType, ValueType>> & result,
                   std::function<void(const std::pair<KeyType, ValueType> &)> predicate = nullptr
                           ) const -> Status;
 
+    /// Stream all the data of the certain partition to |consumer|, in the
+    /// order they were written, without materializing them
+    auto ScanData(size_t partition_id,
+                  const std::function<void(const std::pair<KeyType, ValueType> &)> & consumer) const -> Status;
+
+    /// Find |key| in the certain partition, with a single page read if the
+    /// partition is a sorted run, or a scan otherwise. A sorted run holds
+    /// a single version of a key, and the scan returns the last version
+    /// written, like the blocks built from the partition do.
+    auto Lookup(size_t partition_id, const KeyType & key, ValueType * value) const -> Status;
+
+    /// Whether the certain partition is a sorted run
+    auto IsSorted(size_t partition_id) const -> bool {
+        return sorted_[partition_id];
+    }
+
+    auto GetPartitionNum() const -> size_t {
+        return partition_num_;
+    }
+
+    /// Number of entries written, all the versions included
+    auto GetEntryNum() const -> uint64_t {
+        return entry_num_;
+    }
+
+    /// Number of bytes held in memory by the fence keys and the last keys
+    /// of the partitions, their containers included
+    auto GetFenceUsage() const -> uint64_t {
+        uint64_t size = fence_keys_.capacity() * sizeof(std::vector<KeyType>) + last_keys_.capacity() * sizeof(KeyType);
+        for (auto & fences : fence_keys_) {
+            size += fences.capacity() * sizeof(KeyType);
+            for (auto & fence : fences) {
+                size += keyHeapUsage(fence);
+            }
+        }
+        for (auto & key : last_keys_) {
+            size += keyHeapUsage(key);
+        }
+        return size;
+    }
+
+    /// Number of bytes of the write buffers, none once frozen
+    auto GetBufferUsage() const -> uint64_t {
+        uint64_t size = 0;
+        for (auto * buffer : buffers_) {
+            size += buffer == nullptr ? 0 : pageSize();
+        }
+        return size;
+    }
+
+    /// Number of bytes held by the file, both on the disk and in the buffers
+    auto GetDataSize() const -> uint64_t {
+        uint64_t size = 0;
+        for (size_t i = 0; i < partition_num_; ++i) {
+            size += page_ids_[i].size() * pageSize() + buffer_usages_[i] - UsedSizeWidth;
+        }
+        return size;
+    }
+
     /// Sync all data on the disk
     auto SyncData() {
         file_manager_->Sync();
@@ -77,27 +156,34 @@ private:
         buffer_usages_[partition_id] = UsedSizeWidth;
     }
 
-    auto flushBuffer(size_t partition_id) {
+    auto flushBuffer(size_t partition_id) -> Status {
         char * buf = buffers_[partition_id];
         /// record used size
         Codec<uint64_t>::EncodeValue(buffer_usages_[partition_id], buf, UsedSizeWidth);
         uint64_t pid;
-        file_manager_->WritePage(&pid, buf);
-        resetBuffer(partition_id);
-        auto & pids = page_ids_[partition_id];
-        pids.emplace_back(pid);
-    }
-
-    auto flushAllBuffers() {
-        for (size_t i = 0; i < partition_num_; ++i) {
-            flushBuffer(i);
+        auto s = file_manager_->WritePage(&pid, buf);
+        /// the buffer is kept as is if the page is not written
+        if (s != Status::SUCCESS) {
+            return s;
         }
+        resetBuffer(partition_id);
+        page_ids_[partition_id].emplace_back(pid);
+        return Status::SUCCESS;
     }
 
     static auto pageSize() -> size_t {
         return FileManager::PageSize;
     }
 
+    /// Bytes a key holds out of its object, short strings hold none
+    static auto keyHeapUsage(const KeyType & key) -> uint64_t {
+        if constexpr (std::is_same_v<KeyType, std::string>) {
+            return key.capacity() > std::string{}.capacity() ? key.capacity() + 1 : 0;
+        } else {
+            return 0;
+        }
+    }
+
     /// File manager of the underlying archived file
     std::unique_ptr<FileManager> file_manager_;
 
@@ -107,11 +193,117 @@ private:
     /// The id of pages (written to the disk) of each partitions
     std::vector<std::vector<uint64_t>> page_ids_;
 
-    /// Memory buffer for each partition
+    /// Memory buffer for each partition, null until the first write
     std::vector<char *> buffers_;
 
+    /// Number of entries of all the partitions
+    uint64_t entry_num_;
+
     /// Usage of each buffer
     std::vector<size_t> buffer_usages_;
+
+    /// First key of each page of each partition, the buffer included
+    std::vector<std::vector<KeyType>> fence_keys_;
+
+    /// Last key written to each partition
+    std::vector<KeyType> last_keys_;
+
+    /// Whether the keys of each partition are strictly increasing
+    std::vector<bool> sorted_;
+
+    /// Whether the file is in the frozen mode
+    bool frozen_;
+};
+
+/// |RepartitionedReader| reads archived files of any numbers of partitions
+/// as partitions out of |target_num| (see |ChoosePartitionNum|), reading
+/// every partition of every file once, as merges and splits do.
+///
+/// Partitions are read by groups (see |ForEachGroupPartition|), out of the
+/// least of |target_num| and the most partitions of a file, and a group is
+/// split into its target partitions by the caller. A partition of a file
+/// with fewer partitions than groups spans several groups: it's read with
+/// the first of them, and its entries of the others are kept until these
+/// are read.
+template<typename KeyType, typename ValueType>
+class RepartitionedReader {
+public:
+    using FileHandlePtr = std::shared_ptr<IndexArchivedFile<KeyType, ValueType>>;
+    using Entry = std::pair<KeyType, ValueType>;
+
+    /// |files| are read in the given order
+    explicit RepartitionedReader(std::vector<FileHandlePtr> files, uint64_t target_num)
+        : files_(std::move(files)),
+          group_num_(1),
+          pending_(files_.size()),
+          scanned_(files_.size()) {
+        for (auto & file : files_) {
+            group_num_ = std::max<uint64_t>(group_num_, file->GetPartitionNum());
+        }
+        group_num_ = std::min(group_num_, std::max<uint64_t>(target_num, 1));
+        for (size_t i = 0; i < files_.size(); ++i) {
+            if (files_[i]->GetPartitionNum() < group_num_) {
+                pending_[i].resize(group_num_);
+                scanned_[i].resize(files_[i]->GetPartitionNum(), false);
+            }
+        }
+    }
+
+    auto GetGroupNum() const -> uint64_t {
+        return group_num_;
+    }
+
+    /// Stream the entries of group |group| to |consumer|, along the index of
+    /// their file, file by file and in write order within a file. Each
+    /// group is read once.
+    auto ScanGroup(uint64_t group, const std::function<void(size_t, const Entry &)> & consumer) -> Status {
+        for (size_t i = 0; i < files_.size(); ++i) {
+            auto & file = files_[i];
+            uint64_t partition_num = file->GetPartitionNum();
+            if (partition_num >= group_num_) {
+                auto s = Status::SUCCESS;
+                ForEachGroupPartition(partition_num, group_num_, group, [&](uint64_t part) {
+                    if (s == Status::SUCCESS) {
+                        s = file->ScanData(part, [&consumer, i](const Entry & entry) {
+                            consumer(i, entry);
+                        });
+                    }
+                });
+                if (s != Status::SUCCESS) {
+                    return s;
+                }
+                continue;
+            }
+            /// the partition spans several groups, keep the entries of each
+            uint64_t part = group % partition_num;
+            auto & pending = pending_[i];
+            if (!scanned_[i][part]) {
+                auto s = file->ScanData(part, [&](const Entry & entry) {
+                    pending[IndexUtils<KeyType>::Hash(entry.first) % group_num_].emplace_back(entry);
+                });
+                if (s != Status::SUCCESS) {
+                    return s;
+                }
+                scanned_[i][part] = true;
+            }
+            for (auto & entry : pending[group]) {
+                consumer(i, entry);
+            }
+            std::vector<Entry>{}.swap(pending[group]);
+        }
+        return Status::SUCCESS;
+    }
+
+private:
+    std::vector<FileHandlePtr> files_;
+
+    uint64_t group_num_;
+
+    /// Entries of the files with fewer partitions than groups, by group
+    std::vector<std::vector<std::vector<Entry>>> pending_;
+
+    /// Partitions of these files already read
+    std::vector<std::vector<bool>> scanned_;
 };
 
 /// TODO: implement this when in-memory logic is done
@@ -1,7 +1,7 @@
 #include "index_block.hpp"
+#include "hypergraph.hpp"
 
-#include <queue>
-#include <cassert>
+#include <algorithm>
 
 namespace ssindex {
 
@@ -10,42 +10,338 @@ auto IndexBlock<ValueType>::GetValue(const IndexEdge<ValueType> & ie) const -> V
     if (data_.Empty()) {
         return IndexUtils<ValueType>::KeyNotFound();
     }
+    auto result = decode_(*this, ie);
+    if (exceptions_ != nullptr && result == exception_sentinel_) {
+        return exceptions_->GetValue(ie);
+    }
+    if (dictionary_ != nullptr && result != IndexUtils<ValueType>::KeyNotFound()) {
+        return (*dictionary_)[result];
+    }
+    return result;
+}
 
-    uint64_t block_size = bits_occupied_by_value_ + bits_occupied_by_fp_;
-    if (bits_occupied_by_fp_ != 0) {
-        uint64_t fp_check = 0;
-        for (uint64_t i = 0; i < NumHashFunctions; ++i) {
-            fp_check ^= data_.getBits(ie.get(i, num_v_) * block_size, bits_occupied_by_fp_);
-            //std::cout << fp_check << " ";
+template<typename ValueType>
+template<size_t Arity>
+auto IndexBlock<ValueType>::decodeInterleaved(const IndexBlock & block, const IndexEdge<ValueType> & ie) -> ValueType {
+    uint64_t vertices[Arity];
+    for (size_t i = 0; i < Arity; ++i) {
+        vertices[i] = ie.get(i, block.num_v_);
+    }
+    const uint64_t fp_bits = block.bits_occupied_by_fp_;
+    const uint64_t block_size = block.bits_occupied_by_value_ + fp_bits;
+    if (fp_bits != 0) {
+        uint64_t fp_check = xorFields<Arity>(block.data_, vertices, block_size, 0, fp_bits);
+        if (fp_check != IndexUtils<uint64_t>::mask(ie.v_[0] ^ ie.v_[1], fp_bits)) {
+            return IndexUtils<ValueType>::KeyNotFound();
         }
-        if (fp_check != IndexUtils<uint64_t>::mask(ie.v_[0] ^ ie.v_[1], bits_occupied_by_fp_)) {
-            //std::cout << IndexUtils<uint64_t>::maskCheckLen(ie.v_[0] ^ ie.v_[1], bits_occupied_by_fp_) << std::endl;
+    }
+    uint64_t result = xorFields<Arity>(block.data_, vertices, block_size, fp_bits, block.bits_occupied_by_value_);
+    if (result > block.max_value_) {
+        return IndexUtils<ValueType>::KeyNotFound();
+    }
+    return static_cast<ValueType>(result + block.min_value_);
+}
+
+template<typename ValueType>
+template<size_t Arity>
+auto IndexBlock<ValueType>::decodeSplit(const IndexBlock & block, const IndexEdge<ValueType> & ie) -> ValueType {
+    uint64_t vertices[Arity];
+    for (size_t i = 0; i < Arity; ++i) {
+        vertices[i] = ie.get(i, block.num_v_);
+    }
+    const uint64_t fp_bits = block.bits_occupied_by_fp_;
+    if (fp_bits != 0) {
+        uint64_t fp_check = xorFields<Arity>(block.fp_data_, vertices, fp_bits, 0, fp_bits);
+        if (fp_check != IndexUtils<uint64_t>::mask(ie.v_[0] ^ ie.v_[1], fp_bits)) {
             return IndexUtils<ValueType>::KeyNotFound();
         }
     }
+    const uint64_t value_bits = block.bits_occupied_by_value_;
+    uint64_t result = xorFields<Arity>(block.data_, vertices, value_bits, 0, value_bits);
+    if (result > block.max_value_) {
+        return IndexUtils<ValueType>::KeyNotFound();
+    }
+    return static_cast<ValueType>(result + block.min_value_);
+}
 
-    ValueType result{};
-    for (uint64_t i = 0; i < NumHashFunctions; ++i) {
-        result ^= data_.getBits(ie.get(i, num_v_) * block_size + bits_occupied_by_fp_, bits_occupied_by_value_);
+template<typename ValueType>
+template<size_t Arity>
+auto IndexBlock<ValueType>::decodeFingerprint(const IndexBlock & block, const IndexEdge<ValueType> & ie) -> ValueType {
+    uint64_t vertices[Arity];
+    for (size_t i = 0; i < Arity; ++i) {
+        vertices[i] = ie.get(i, block.num_v_);
+    }
+    const uint64_t fp_bits = block.bits_occupied_by_fp_;
+    uint64_t fp_check = block.layout_ == BlockLayout::INTERLEAVED
+                        ? xorFields<Arity>(block.data_, vertices, fp_bits, 0, fp_bits)
+                        : xorFields<Arity>(block.fp_data_, vertices, fp_bits, 0, fp_bits);
+    if (fp_check != IndexUtils<uint64_t>::mask(ie.v_[0] ^ ie.v_[1], fp_bits)) {
+        return IndexUtils<ValueType>::KeyNotFound();
     }
+    return block.min_value_;
+}
 
-    if (result > max_value_) {
+template<typename ValueType>
+template<size_t Arity, typename FpWord, typename ValueWord>
+auto IndexBlock<ValueType>::decodeAligned(const IndexBlock & block, const IndexEdge<ValueType> & ie) -> ValueType {
+    uint64_t vertices[Arity];
+    for (size_t i = 0; i < Arity; ++i) {
+        vertices[i] = ie.get(i, block.num_v_);
+    }
+    if constexpr (!std::is_void_v<FpWord>) {
+        FpWord fp_check = 0;
+        for (size_t i = 0; i < Arity; ++i) {
+            fp_check ^= loadWord<FpWord>(block.fp_data_.Data(), vertices[i]);
+        }
+        if (fp_check != static_cast<FpWord>(ie.v_[0] ^ ie.v_[1])) {
+            return IndexUtils<ValueType>::KeyNotFound();
+        }
+    }
+    ValueWord result = 0;
+    for (size_t i = 0; i < Arity; ++i) {
+        result ^= loadWord<ValueWord>(block.data_.Data(), vertices[i]);
+    }
+    if (result > block.max_value_) {
         return IndexUtils<ValueType>::KeyNotFound();
     }
+    return static_cast<ValueType>(result + block.min_value_);
+}
+
+template<typename ValueType>
+void IndexBlock<ValueType>::selectDecoder() {
+    constexpr size_t Arity = NumHashFunctions;
+    /// [fingerprint word][value word], fingerprints of 0/8/16 bits and
+    /// values of 8/16/32/64 bits
+    static constexpr DecodeFn aligned_kernels[3][4] = {
+        {decodeAligned<Arity, void, uint8_t>, decodeAligned<Arity, void, uint16_t>,
+         decodeAligned<Arity, void, uint32_t>, decodeAligned<Arity, void, uint64_t>},
+        {decodeAligned<Arity, uint8_t, uint8_t>, decodeAligned<Arity, uint8_t, uint16_t>,
+         decodeAligned<Arity, uint8_t, uint32_t>, decodeAligned<Arity, uint8_t, uint64_t>},
+        {decodeAligned<Arity, uint16_t, uint8_t>, decodeAligned<Arity, uint16_t, uint16_t>,
+         decodeAligned<Arity, uint16_t, uint32_t>, decodeAligned<Arity, uint16_t, uint64_t>},
+    };
+    auto word_index = [](uint64_t bits) -> int {
+        switch (bits) {
+            case 8: return 0;
+            case 16: return 1;
+            case 32: return 2;
+            case 64: return 3;
+            default: return -1;
+        }
+    };
+
+    if (bits_occupied_by_value_ == 0) {
+        decode_ = decodeFingerprint<Arity>;
+        return;
+    }
+    if (layout_ == BlockLayout::INTERLEAVED) {
+        decode_ = decodeInterleaved<Arity>;
+        return;
+    }
+    /// split slots of whole bytes decode with plain loads, whether they
+    /// are aligned on purpose or by chance
+    /// a fingerprint of any other width must keep being checked, by the
+    /// generic kernel
+    int fp_index = bits_occupied_by_fp_ == 0 ? 0 : word_index(bits_occupied_by_fp_);
+    if (bits_occupied_by_fp_ != 0 && fp_index != -1) {
+        fp_index++;
+    }
+    int value_index = word_index(bits_occupied_by_value_);
+    if (fp_index != -1 && fp_index < 3 && value_index != -1) {
+        decode_ = aligned_kernels[fp_index][value_index];
+        return;
+    }
+    decode_ = decodeSplit<Arity>;
+}
+
+template<typename ValueType>
+auto IndexBlock<ValueType>::choosePatchedWidth(const std::vector<IndexEdge<ValueType>> & index_edges, double * cost) const -> uint64_t {
+    constexpr uint64_t max_bits = 64;
+    /// values of each bit length, and those having all their bits set
+    /// (i.e. colliding with the sentinel of that width)
+    uint64_t counts[max_bits + 1]{};
+    uint64_t all_ones[max_bits + 1]{};
+    for (auto & ie : index_edges) {
+        auto value = static_cast<uint64_t>(ie.value_);
+        uint64_t bits = value == 0 ? 0 : max_bits - __builtin_clzll(value);
+        counts[bits]++;
+        if (bits == max_bits ? value == ~0LLU : value == (1LLU << bits) - 1) {
+            all_ones[bits]++;
+        }
+    }
+
+    /// slot bits, and the bits of the nested block for the exceptions
+    const uint64_t range_bits = bits_occupied_by_value_;
+    const double slots = static_cast<double>(index_edges.size()) * kScale;
+    const double exception_overhead = double(intercept * NumHashFunctions * range_bits) + sizeof(IndexBlock) * 8;
+    uint64_t best_width = range_bits;
+    double best_cost = slots * double(range_bits);
+    uint64_t wider = 0;
+    for (uint64_t width = range_bits - 1; width >= 1; --width) {
+        wider += counts[width + 1];
+        uint64_t exception_num = wider + all_ones[width];
+        double cost = slots * double(width) + double(exception_num) * kScale * double(range_bits) + exception_overhead;
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_width = width;
+        }
+    }
+    if (cost != nullptr) {
+        *cost = best_cost;
+    }
+    return best_width;
+}
+
+template<typename ValueType>
+auto IndexBlock<ValueType>::buildDictionary(std::vector<IndexEdge<ValueType>> & index_edges) -> bool {
+    std::vector<ValueType> distinct{};
+    distinct.reserve(index_edges.size());
+    for (auto & ie : index_edges) {
+        distinct.emplace_back(ie.value_);
+    }
+    std::sort(distinct.begin(), distinct.end());
+    distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+    /// the codes must stay below |KeyNotFound|, which is returned for the
+    /// keys rejected by the fingerprints, e.g. 255 of uint8 values
+    if (distinct.size() > MaxDictionarySize ||
+        distinct.size() > static_cast<uint64_t>(IndexUtils<ValueType>::KeyNotFound())) {
+        return false;
+    }
+
+    /// codes & the dictionary against the patched (or range) encoding
+    uint64_t code_bits = distinct.size() <= 1 ? 1 : 64 - __builtin_clzll(distinct.size() - 1);
+    double patched_cost = 0;
+    choosePatchedWidth(index_edges, &patched_cost);
+    double dictionary_cost = static_cast<double>(index_edges.size()) * kScale * double(code_bits) +
+                             double(distinct.size() * sizeof(ValueType) * 8);
+    if (dictionary_cost >= patched_cost) {
+        return false;
+    }
+
+    for (auto & ie : index_edges) {
+        ie.value_ = static_cast<ValueType>(std::lower_bound(distinct.begin(), distinct.end(), ie.value_) - distinct.begin());
+    }
+    for (auto & value : distinct) {
+        value += min_value_;
+    }
+    min_value_ = 0;
+    max_value_ = static_cast<ValueType>(distinct.size() - 1);
+    bits_occupied_by_value_ = code_bits;
+    dictionary_ = std::make_shared<const std::vector<ValueType>>(std::move(distinct));
+    encoding_ = ValueEncoding::DICTIONARY;
+    return true;
+}
+
+template<typename ValueType>
+auto IndexBlock<ValueType>::buildExceptions(std::vector<IndexEdge<ValueType>> & index_edges) -> Status {
+    const auto sentinel = static_cast<ValueType>((1LLU << bits_occupied_by_value_) - 1);
+    std::vector<IndexEdge<ValueType>> exception_edges{};
+    for (auto & ie : index_edges) {
+        if (ie.value_ >= sentinel) {
+            exception_edges.emplace_back(ie);
+            exception_edges.back().value_ = ie.value_ + min_value_;
+            ie.value_ = sentinel;
+        }
+    }
+    if (exception_edges.empty()) {
+        return Status::SUCCESS;
+    }
+
+    /// the nested block shares the seed, so that its edges are the same
+    auto exceptions = std::make_shared<IndexBlock>();
+    auto s = exceptions->TryBuild(exception_edges, seed_, 0, BlockLayout::SPLIT, ValueEncoding::RANGE);
+    if (s != Status::SUCCESS) {
+        return s;
+    }
+    exceptions_ = std::move(exceptions);
+    exception_sentinel_ = static_cast<ValueType>(sentinel + min_value_);
+    encoding_ = ValueEncoding::PATCHED;
+    return Status::SUCCESS;
+}
+
+template<typename ValueType>
+void IndexBlock<ValueType>::alignFieldWidths() {
+    if (layout_ != BlockLayout::ALIGNED) {
+        return;
+    }
+    auto round_up = [](uint64_t bits) -> uint64_t {
+        for (uint64_t width : {8, 16, 32}) {
+            if (bits <= width) {
+                return width;
+            }
+        }
+        return 64;
+    };
+    if (bits_occupied_by_value_ != 0) {
+        bits_occupied_by_value_ = round_up(bits_occupied_by_value_);
+    }
+    if (bits_occupied_by_fp_ != 0 && bits_occupied_by_fp_ <= 16) {
+        bits_occupied_by_fp_ = round_up(bits_occupied_by_fp_);
+    }
+}
+
+template<typename ValueType>
+void IndexBlock<ValueType>::GetValues(const IndexEdge<ValueType> * edges, size_t num, ValueType * values) const {
+    if (data_.Empty()) {
+        std::fill(values, values + num, IndexUtils<ValueType>::KeyNotFound());
+        return;
+    }
 
-    return result + min_value_;
+    DecodeParams params{};
+    if (layout_ != BlockLayout::INTERLEAVED) {
+        params.fp_ = SlotField{fp_data_.Data(), bits_occupied_by_fp_, 0, bits_occupied_by_fp_};
+        params.value_ = SlotField{data_.Data(), bits_occupied_by_value_, 0, bits_occupied_by_value_};
+    } else {
+        uint64_t block_size = bits_occupied_by_value_ + bits_occupied_by_fp_;
+        params.fp_ = SlotField{data_.Data(), block_size, 0, bits_occupied_by_fp_};
+        params.value_ = SlotField{data_.Data(), block_size, bits_occupied_by_fp_, bits_occupied_by_value_};
+    }
+    params.min_value_ = min_value_;
+    params.max_value_ = max_value_;
+    params.not_found_ = IndexUtils<ValueType>::KeyNotFound();
+    auto kernel = GetDecodeSlotsKernel();
+
+    uint64_t vertices[NumHashFunctions * DecodeBatchSize];
+    uint64_t signatures[DecodeBatchSize];
+    uint64_t results[DecodeBatchSize];
+    size_t i = 0;
+    for (; i + DecodeBatchSize <= num; i += DecodeBatchSize) {
+        for (size_t k = 0; k < DecodeBatchSize; ++k) {
+            const IndexEdge<ValueType> & ie = edges[i + k];
+            for (uint64_t j = 0; j < NumHashFunctions; ++j) {
+                vertices[j * DecodeBatchSize + k] = ie.get(j, num_v_);
+            }
+            signatures[k] = IndexUtils<uint64_t>::mask(ie.v_[0] ^ ie.v_[1], bits_occupied_by_fp_);
+        }
+        kernel(params, vertices, signatures, results);
+        for (size_t k = 0; k < DecodeBatchSize; ++k) {
+            values[i + k] = static_cast<ValueType>(results[k]);
+            if (exceptions_ != nullptr && values[i + k] == exception_sentinel_) {
+                values[i + k] = exceptions_->GetValue(edges[i + k]);
+            }
+            if (dictionary_ != nullptr && values[i + k] != IndexUtils<ValueType>::KeyNotFound()) {
+                values[i + k] = (*dictionary_)[values[i + k]];
+            }
+        }
+    }
+    for (; i < num; ++i) {
+        values[i] = GetValue(edges[i]);
+    }
 }
 
 template<typename ValueType>
 auto IndexBlock<ValueType>::TryBuild(std::vector<IndexEdge<ValueType>> & index_edges,
               uint64_t seed,
-              uint64_t fp_bits) -> Status {
+              uint64_t fp_bits,
+              BlockLayout layout,
+              ValueEncoding encoding) -> Status {
     entry_num_ = static_cast<uint64_t>(index_edges.size());
     if (entry_num_ == 0) {
         return Status::SUCCESS;
     }
     seed_ = seed;
     bits_occupied_by_fp_ = fp_bits;
+    layout_ = layout;
 
     min_value_ = static_cast<ValueType>(-1);
     max_value_ = 0;
@@ -65,168 +361,224 @@ auto IndexBlock<ValueType>::TryBuild(std::vector<IndexEdge<ValueType>> & index_e
         index_edges[i].value_ -= min_value_;
     }
 
-    /// average bit usage per value (after normalization)
-    bits_occupied_by_value_ = IndexUtils<ValueType>::log2(max_value_ - min_value_);
-    if (bits_occupied_by_value_ == 0) bits_occupied_by_value_ = 1;
+    /// average bit usage per value (after normalization), a block of a
+    /// single value with fingerprints is a filter, its slots only hold
+    /// the fingerprints
+    bits_occupied_by_value_ = max_value_ == min_value_ ? 0 : IndexUtils<ValueType>::log2(max_value_ - min_value_);
+    if (bits_occupied_by_value_ == 0 && fp_bits == 0) bits_occupied_by_value_ = 1;
+    encoding_ = ValueEncoding::RANGE;
+    exceptions_.reset();
+    dictionary_.reset();
+    uint64_t range_bits = bits_occupied_by_value_;
+    const bool has_values = range_bits != 0;
+    if (has_values && encoding == ValueEncoding::DICTIONARY && buildDictionary(index_edges)) {
+        range_bits = bits_occupied_by_value_;
+    } else if (has_values && encoding != ValueEncoding::RANGE) {
+        bits_occupied_by_value_ = choosePatchedWidth(index_edges);
+    }
+    alignFieldWidths();
+    if (bits_occupied_by_value_ < range_bits) {
+        auto s = buildExceptions(index_edges);
+        if (s != Status::SUCCESS) {
+            return s;
+        }
+    }
 //    std::cout << max_value_ << " " << min_value_ << std::endl;
 //    std::cout << "Value Bits: " << bits_occupied_by_value_ << std::endl;
     /// number of vertices
     num_v_ = static_cast<uint64_t>(entry_num_ * kScale / double(NumHashFunctions) + intercept);
 
-    uint64_t bits_per_value_with_fp = bits_occupied_by_value_ + bits_occupied_by_fp_;
-    uint64_t points_per_entry = 1;
-
-    /// set index_edges
-    uint64_t space = 0;
-    std::vector<uint8_t> degs(num_v_ * NumHashFunctions + space);
-    std::vector<uint64_t> offsets(num_v_ * NumHashFunctions + space + 1);
-
-    for (size_t i = 0; i < index_edges.size(); ++i) {
-        const IndexEdge<ValueType> & ie = index_edges[i];
-        uint64_t len = 1;
-        for (uint64_t j = 0; j < NumHashFunctions; ++j) {
-            uint64_t t = ie.get(j, num_v_);
-            for (uint64_t k = 0; k < len; ++k) {
-                if (degs[t + k] == 0xFF) {
-                    return Status::ERROR;
-                }
-                ++degs[t + k];
-            }
-        }
+    /// vertices are assigned in the reversed peeling order, the other
+    /// vertices of an edge are either final or still zero at that point
+    std::vector<std::pair<uint64_t, uint8_t>> extracted_edges{};
+    auto peel_status = PeelHypergraph(index_edges, num_v_, extracted_edges);
+    if (peel_status != Status::SUCCESS) {
+        return peel_status;
     }
+    resizeSlots();
 
-    /// set offsets
-    uint64_t sum = 0;
-    for (size_t i = 0; i < degs.size(); ++i) {
-        offsets[i] = sum;
-        sum += degs[i];
-        degs[i] = 0;
+    std::reverse(extracted_edges.begin(),  extracted_edges.end());
+    for (auto & extracted_edge : extracted_edges) {
+        const IndexEdge<ValueType> & ie = index_edges[extracted_edge.first];
+        assignEdge(ie, ie.value_, extracted_edge.second);
     }
-    offsets.back() = sum;
 
-    /// set edges
-    uint64_t total_edge_num = entry_num_ * NumHashFunctions;
-    std::vector<uint64_t> edges(total_edge_num);
-    for (size_t i = 0; i < index_edges.size(); ++i) {
-        const IndexEdge<ValueType> & ie = index_edges[i];
-        uint64_t len = 1;
-        for (uint64_t j = 0; j < NumHashFunctions; ++j) {
-            uint64_t t = ie.get(j, num_v_);
-            for (uint64_t k = 0; k < len; ++k) {
-                edges[offsets[t + k] + degs[t + k]++] = i * points_per_entry + k;
-            }
-        }
+    selectDecoder();
+    return Status::SUCCESS;
+}
+
+template<typename ValueType>
+auto IndexBlock<ValueType>::TryBuildExternal(const ExternalEdgeFile<ValueType> & edge_file,
+              uint64_t seed,
+              uint64_t fp_bits,
+              BlockLayout layout) -> Status {
+    using Reader = ExternalEdgeFile<ValueType>;
+    entry_num_ = edge_file.GetEntryNum();
+    if (entry_num_ == 0) {
+        return Status::SUCCESS;
     }
+    seed_ = seed;
+    bits_occupied_by_fp_ = fp_bits;
+    layout_ = layout;
+    min_value_ = edge_file.GetMinValue();
+    max_value_ = edge_file.GetMaxValue();
 
-    /// init queue
-    std::queue<uint64_t> q{};
-    for (size_t i = 0; i < degs.size(); ++i) {
-        if (degs[i] == 1) {
-            q.push(edges[offsets[i]]);
+    bits_occupied_by_value_ = max_value_ == min_value_ ? 0 : IndexUtils<ValueType>::log2(max_value_ - min_value_);
+    if (bits_occupied_by_value_ == 0) bits_occupied_by_value_ = 1;
+    /// values are not patched nor coded in external memory
+    encoding_ = ValueEncoding::RANGE;
+    exceptions_.reset();
+    dictionary_.reset();
+    alignFieldWidths();
+    num_v_ = static_cast<uint64_t>(entry_num_ * kScale / double(NumHashFunctions) + intercept);
+
+    /// count degrees
+    std::vector<uint8_t> degs(num_v_ * NumHashFunctions);
+    {
+        std::ifstream ifs(edge_file.GetFileName(), std::ios::binary);
+        IndexEdge<ValueType> ie{};
+        while (Reader::readEdge(ifs, ie)) {
+            for (uint64_t j = 0; j < NumHashFunctions; ++j) {
+                uint64_t t = ie.get(j, num_v_);
+                if (degs[t] == 0xFF) {
+                    return Status::ERROR;
+                }
+                ++degs[t];
+            }
         }
     }
 
-    std::vector<std::pair<uint64_t, uint8_t>> extracted_edges{};
-    uint64_t assign_num = entry_num_ * points_per_entry;
-
-    BitVec<uint64_t> visited_edges(assign_num);
-    uint64_t deleted_num = 0;
-    while (!q.empty()) {
-        uint64_t v = q.front();
-        q.pop();
-
-        if (visited_edges.getBit(v)) continue;
-        visited_edges.setBit(v);
-        ++deleted_num;
-
-        uint64_t keyID  = v / points_per_entry;
-        uint64_t offset = v % points_per_entry;
-
-        const IndexEdge<ValueType>& ie(index_edges[keyID]);
-        int choosed = -1;
-        for (uint64_t i = 0; i < NumHashFunctions; ++i)
-        {
-            const uint64_t t = ie.get(i, num_v_);
-            --degs[t + offset];
-
-            if (degs[t + offset] == 0)
-            {
-                choosed = i;
-                continue;
+    /// peel in rounds, each round scans the remaining edges once, peels the
+    /// ones having a vertex of degree 1 and keeps the others for the next
+    /// round. Peeled edges are logged together with the chosen vertex.
+    const std::string & prefix = edge_file.GetFilePrefix();
+    const std::string peel_log = prefix + ".peel";
+    const std::string rounds[2] = {prefix + ".round0", prefix + ".round1"};
+    auto cleanup = [&]() {
+        std::filesystem::remove(peel_log);
+        std::filesystem::remove(rounds[0]);
+        std::filesystem::remove(rounds[1]);
+    };
+
+    std::ofstream log(peel_log, std::ios::binary | std::ios::trunc);
+    std::string current = edge_file.GetFileName();
+    uint64_t remaining = entry_num_;
+    for (size_t round = 0; remaining > 0; ++round) {
+        std::ifstream ifs(current, std::ios::binary);
+        std::ofstream next(rounds[round % 2], std::ios::binary | std::ios::trunc);
+        uint64_t peeled = 0;
+        IndexEdge<ValueType> ie{};
+        while (Reader::readEdge(ifs, ie)) {
+            int chosen = -1;
+            for (uint64_t j = 0; j < NumHashFunctions; ++j) {
+                if (degs[ie.get(j, num_v_)] == 1) {
+                    chosen = static_cast<int>(j);
+                    break;
+                }
             }
-            else if (degs[t + offset] >= 2)
-            {
+            if (chosen == -1) {
+                ie.write(next);
                 continue;
             }
-            // degs[t] == 1
-            const uint64_t end = offsets[t + offset + 1];
-            for (uint64_t j = offsets[t + offset]; j < end; ++j)
-            {
-                if (!visited_edges.getBit(edges[j]))
-                {
-                    q.push(edges[j]);
-                    break;
-                }
+            for (uint64_t j = 0; j < NumHashFunctions; ++j) {
+                --degs[ie.get(j, num_v_)];
             }
+            ie.write(log);
+            auto c = static_cast<uint8_t>(chosen);
+            log.write((const char *)(&c), sizeof(c));
+            ++peeled;
         }
-        assert(choosed != -1);
-        extracted_edges.emplace_back(std::make_pair(v, choosed));
+        if (peeled == 0) {
+            /// the remaining edges form a 2-core
+            log.close();
+            ifs.close();
+            next.close();
+            cleanup();
+            return Status::ERROR;
+        }
+        remaining -= peeled;
+        current = rounds[round % 2];
     }
-
-    if (deleted_num != entry_num_) {
-        return Status::ERROR;
+    log.close();
+    std::vector<uint8_t>{}.swap(degs);
+
+    /// assign the values in the reversed peeling order, the chosen vertex
+    /// is still zero at that point, so all the vertices can be xor-ed
+    resizeSlots();
+    constexpr size_t log_record_size = Reader::RecordSize + sizeof(uint8_t);
+    constexpr size_t records_per_read = 4096;
+    std::vector<char> buffer(log_record_size * records_per_read);
+    std::ifstream ifs(peel_log, std::ios::binary);
+    uint64_t records_left = entry_num_;
+    while (records_left > 0) {
+        uint64_t n = std::min<uint64_t>(records_left, records_per_read);
+        records_left -= n;
+        ifs.seekg(static_cast<std::streamoff>(records_left * log_record_size));
+        ifs.read(buffer.data(), static_cast<std::streamsize>(n * log_record_size));
+        if (!ifs) {
+            cleanup();
+            return Status::ERROR;
+        }
+        for (uint64_t r = n; r-- > 0;) {
+            const char * record = buffer.data() + r * log_record_size;
+            IndexEdge<ValueType> ie{};
+            memcpy(&ie.value_, record, sizeof(ie.value_));
+            memcpy(&ie.v_[0], record + sizeof(ie.value_), sizeof(ie.v_[0]) * NumHashFunctions);
+            uint8_t chosen = *reinterpret_cast<const uint8_t *>(record + Reader::RecordSize);
+            assignEdge(ie, ie.value_ - min_value_, chosen);
+        }
     }
+    ifs.close();
+    cleanup();
 
-    assert(q.empty());
-    data_.Resize(num_v_ * bits_per_value_with_fp * NumHashFunctions);
-    //std::cout << num_v_ << " " << bits_per_value_with_fp << " " << NumHashFunctions << std::endl;
-
-    uint64_t block_size = bits_per_value_with_fp;
-    BitVec<uint64_t> visited_vertices(assign_num * NumHashFunctions);
-    std::reverse(extracted_edges.begin(),  extracted_edges.end());
-    //std::cout << ".........." << std::endl;
-    for (auto & extracted_edge : extracted_edges) {
-        const uint64_t v = extracted_edge.first;
-        uint64_t key_index = v / points_per_entry;
-        uint64_t offset = v % points_per_entry;
-        const IndexEdge<ValueType> & ie = index_edges[key_index];
+    selectDecoder();
+    return Status::SUCCESS;
+}
 
-        uint64_t signature = IndexUtils<uint64_t>::mask(ie.v_[0] ^ ie.v_[1], bits_occupied_by_fp_);
-        uint64_t bits_write_value = bits_per_value_with_fp;
-        uint64_t bits = (ie.value_ << bits_occupied_by_fp_) + signature;
+template<typename ValueType>
+void IndexBlock<ValueType>::resizeSlots() {
+    if (layout_ != BlockLayout::INTERLEAVED) {
+        data_.Resize(num_v_ * bits_occupied_by_value_ * NumHashFunctions);
+        fp_data_.Resize(num_v_ * bits_occupied_by_fp_ * NumHashFunctions);
+        return;
+    }
+    data_.Resize(num_v_ * (bits_occupied_by_value_ + bits_occupied_by_fp_) * NumHashFunctions);
+    fp_data_ = BitVec<uint64_t>{};
+}
 
-        for (uint64_t i = 0; i < NumHashFunctions; ++i) {
-            const uint64_t t = ie.get(i, num_v_);
-            if (!(visited_vertices.getBit(t + offset))) {
-                continue;
+template<typename ValueType>
+void IndexBlock<ValueType>::assignEdge(const IndexEdge<ValueType> & ie, ValueType normalized_value, uint64_t chosen) {
+    uint64_t signature = IndexUtils<uint64_t>::mask(ie.v_[0] ^ ie.v_[1], bits_occupied_by_fp_);
+    const uint64_t set_pos = ie.get(chosen, num_v_);
+
+    if (layout_ != BlockLayout::INTERLEAVED) {
+        if (bits_occupied_by_fp_ != 0) {
+            for (uint64_t i = 0; i < NumHashFunctions; ++i) {
+                signature ^= fp_data_.getBitsU64(ie.get(i, num_v_) * bits_occupied_by_fp_, bits_occupied_by_fp_);
             }
-            //signature ^= data_.getBitsU64(t * block_size + offset, bits_occupied_by_fp_);
-            bits ^= data_.getBits(t * block_size + offset, bits_write_value);
-        }
-
-        const uint64_t set_pos = ie.get(extracted_edge.second, num_v_);
-        data_.setBits(set_pos * block_size + offset, bits_write_value, bits);
-        visited_vertices.setBit(set_pos + offset);
-
-//        uint64_t signature = IndexUtils<uint64_t>::maskCheckLen(ie.v_[0] ^ ie.v_[1], bits_occupied_by_fp_);
-//
-//        ValueType bits = ie.value_;
-//        for (uint64_t i = 0; i < 3; ++i) {
-//            const uint64_t t = ie.get(i, num_v_);
-//            if (!(visited_vertices.getBit(t + offset))) {
-//                continue;
-//            }
-//            signature ^= data_.getBitsU64(t * block_size + offset, bits_occupied_by_fp_);
-//            bits ^= data_.getBits(t * block_size + offset + bits_occupied_by_fp_, bits_per_value_with_fp);
-//        }
-//
-//        const uint64_t set_pos = ie.get(extracted_edge.second, num_v_);
-//        data_.setBitsU64(set_pos * block_size + offset, bits_occupied_by_fp_, signature);
-//        data_.setBits(set_pos * block_size + offset + bits_occupied_by_fp_, bits_per_value_with_fp, bits);
-//        visited_vertices.setBit(set_pos + offset);
+            fp_data_.setBitsU64(set_pos * bits_occupied_by_fp_, bits_occupied_by_fp_, signature);
+        }
+        ValueType bits = normalized_value;
+        for (uint64_t i = 0; i < NumHashFunctions; ++i) {
+            bits ^= data_.getBits(ie.get(i, num_v_) * bits_occupied_by_value_, bits_occupied_by_value_);
+        }
+        data_.setBits(set_pos * bits_occupied_by_value_, bits_occupied_by_value_, bits);
+        return;
     }
 
-    return Status::SUCCESS;
+    uint64_t block_size = bits_occupied_by_value_ + bits_occupied_by_fp_;
+    uint64_t bits = (uint64_t(normalized_value) << bits_occupied_by_fp_) + signature;
+    if (block_size <= 64) {
+        for (uint64_t i = 0; i < NumHashFunctions; ++i) {
+            bits ^= data_.getBitsWide(ie.get(i, num_v_) * block_size, block_size);
+        }
+        data_.setBitsU64(set_pos * block_size, block_size, bits);
+        return;
+    }
+    for (uint64_t i = 0; i < NumHashFunctions; ++i) {
+        bits ^= data_.getBits(ie.get(i, num_v_) * block_size, block_size);
+    }
+    data_.setBits(set_pos * block_size, block_size, bits);
 }
 
 template class IndexBlock<uint64_t>;
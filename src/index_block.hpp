@@ -1,7 +1,13 @@
 #pragma once
 
+#include <cstring>
+#include <type_traits>
+#include <memory>
+
 #include "bitvec.hpp"
 #include "index_edge.hpp"
+#include "external_edge_file.hpp"
+#include "simd_kernels.hpp"
 
 namespace ssindex {
 
@@ -22,20 +28,97 @@ public:
         , bits_occupied_by_fp_(default_fp_bits)
         , seed_(0x12345678)
         , level_(0)
-        , num_v_(0) {}
+        , num_v_(0)
+        , layout_(DefaultBlockLayout)
+        , encoding_(ValueEncoding::RANGE)
+        , exception_sentinel_(0)
+        , decode_(nullptr) {}
 
     auto GetValue(const IndexEdge<ValueType> & edge) const -> ValueType;
 
+    /// Batched |GetValue|, keys are decoded |DecodeBatchSize| at a time by
+    /// the SIMD kernel selected for the running CPU
+    void GetValues(const IndexEdge<ValueType> * edges, size_t num, ValueType * values) const;
+
+    /// With |BlockLayout::SPLIT|, fingerprints and values are stored in two
+    /// bit arrays, so a probe rejected by the fingerprint never touches the
+    /// value array, at the cost of more cache misses for the accepted ones.
+    /// |BlockLayout::ALIGNED| rounds the fields of the split layout up to
+    /// 8/16/32/64 bits, trading space for plain loads.
+    ///
+    /// With |ValueEncoding::PATCHED|, the slot width is chosen to cover
+    /// most of the values rather than the whole range. The slot of an
+    /// outlier holds a sentinel, and the outliers are stored in a nested
+    /// block, which is only probed when the sentinel is decoded.
+    ///
+    /// With |ValueEncoding::DICTIONARY|, slots hold the codes of the
+    /// distinct values (log2 of their number bits), translated through a
+    /// small sorted dictionary. Min & max values are then the code range.
+    ///
+    /// A block of a single value built with fingerprints stores no value
+    /// bits at all, i.e. it's an approximate membership filter.
     auto TryBuild(std::vector<IndexEdge<ValueType>> & edges,
                   uint64_t seed,
-                  uint64_t fp_bits) -> Status;
+                  uint64_t fp_bits,
+                  BlockLayout layout = DefaultBlockLayout,
+                  ValueEncoding encoding = DefaultValueEncoding) -> Status;
+
+    /// External-memory version of |TryBuild|. Edges are peeled in rounds of
+    /// sequential scans over the spilled edge file, and only the vertex
+    /// degrees (one byte per vertex) and the block itself are kept in memory.
+    auto TryBuildExternal(const ExternalEdgeFile<ValueType> & edges,
+                          uint64_t seed,
+                          uint64_t fp_bits,
+                          BlockLayout layout = DefaultBlockLayout) -> Status;
+
+    /// Seed the block is built with, it may differ from the requested one
+    /// if the first attempts of |TryBuild| failed
+    auto GetSeed() const -> uint64_t {
+        return seed_;
+    }
+
+    auto GetLayout() const -> BlockLayout {
+        return layout_;
+    }
+
+    auto GetEncoding() const -> ValueEncoding {
+        return encoding_;
+    }
+
+    /// Number of values stored as exceptions
+    auto GetExceptionNum() const -> uint64_t {
+        return exceptions_ == nullptr ? 0 : exceptions_->entry_num_;
+    }
+
+    /// Number of distinct values of a dictionary-coded block
+    auto GetDictionarySize() const -> uint64_t {
+        return dictionary_ == nullptr ? 0 : dictionary_->size();
+    }
 
     /// Number of bytes used by the block
     auto GetFootprint() const -> size_t {
-        return data_.BitsCount() / 8 + sizeof(uint64_t) * 5 + sizeof(ValueType) * 2;
+        return GetBitsFootprint() + GetMetaFootprint();
+    }
+
+    /// Number of bytes of the bit arrays, i.e. those released by
+    /// |releaseBits|
+    auto GetBitsFootprint() const -> size_t {
+        return (data_.BitsCount() + fp_data_.BitsCount()) / 8;
     }
 
-    auto write(std::ofstream & ofs) const {
+    /// Number of bytes used by the block besides the bit arrays
+    auto GetMetaFootprint() const -> size_t {
+        size_t sum = sizeof(uint64_t) * 5 + sizeof(ValueType) * 3;
+        if (exceptions_ != nullptr) {
+            sum += exceptions_->GetFootprint();
+        }
+        if (dictionary_ != nullptr) {
+            sum += dictionary_->size() * sizeof(ValueType);
+        }
+        return sum;
+    }
+
+    auto write(std::ofstream & ofs) const -> void {
         ofs.write((const char *)(&entry_num_), sizeof(entry_num_));
         ofs.write((const char *)(&min_value_), sizeof(min_value_));
         ofs.write((const char *)(&max_value_), sizeof(max_value_));
@@ -43,11 +126,25 @@ public:
         ofs.write((const char *)(&bits_occupied_by_fp_), sizeof(bits_occupied_by_fp_));
         ofs.write((const char *)(&seed_), sizeof(seed_));
         ofs.write((const char *)(&num_v_), sizeof(num_v_));
+        ofs.write((const char *)(&layout_), sizeof(layout_));
+        ofs.write((const char *)(&encoding_), sizeof(encoding_));
+        ofs.write((const char *)(&exception_sentinel_), sizeof(exception_sentinel_));
 
         data_.write(ofs);
+        fp_data_.write(ofs);
+        bool has_exceptions = exceptions_ != nullptr;
+        ofs.write((const char *)(&has_exceptions), sizeof(has_exceptions));
+        if (has_exceptions) {
+            exceptions_->write(ofs);
+        }
+        uint64_t dictionary_size = GetDictionarySize();
+        ofs.write((const char *)(&dictionary_size), sizeof(dictionary_size));
+        if (dictionary_size != 0) {
+            ofs.write((const char *)(dictionary_->data()), sizeof(ValueType) * dictionary_size);
+        }
     }
 
-    auto read(std::ifstream & ifs) {
+    auto read(std::ifstream & ifs) -> void {
         ifs.read((char *)(&entry_num_), sizeof(entry_num_));
         ifs.read((char *)(&min_value_), sizeof(min_value_));
         ifs.read((char *)(&max_value_), sizeof(max_value_));
@@ -55,24 +152,140 @@ public:
         ifs.read((char *)(&bits_occupied_by_fp_), sizeof(bits_occupied_by_fp_));
         ifs.read((char *)(&seed_), sizeof(seed_));
         ifs.read((char *)(&num_v_), sizeof(num_v_));
+        ifs.read((char *)(&layout_), sizeof(layout_));
+        ifs.read((char *)(&encoding_), sizeof(encoding_));
+        ifs.read((char *)(&exception_sentinel_), sizeof(exception_sentinel_));
+
+        data_.read(ifs);
+        fp_data_.read(ifs);
+        bool has_exceptions = false;
+        ifs.read((char *)(&has_exceptions), sizeof(has_exceptions));
+        exceptions_.reset();
+        if (has_exceptions) {
+            auto exceptions = std::make_shared<IndexBlock>();
+            exceptions->read(ifs);
+            exceptions_ = std::move(exceptions);
+        }
+        uint64_t dictionary_size = 0;
+        ifs.read((char *)(&dictionary_size), sizeof(dictionary_size));
+        dictionary_.reset();
+        if (dictionary_size != 0) {
+            auto dictionary = std::make_shared<std::vector<ValueType>>(dictionary_size);
+            ifs.read((char *)(dictionary->data()), sizeof(ValueType) * dictionary_size);
+            dictionary_ = std::move(dictionary);
+        }
+        selectDecoder();
+    }
+
+    /// Write the bit arrays only, see |BlockResidency|
+    auto writeBits(std::ofstream & ofs) const -> void {
+        data_.write(ofs);
+        fp_data_.write(ofs);
+    }
 
+    /// Read back the bit arrays written by |writeBits|
+    auto readBits(std::ifstream & ifs) -> void {
         data_.read(ifs);
+        fp_data_.read(ifs);
+    }
+
+    /// Release the bit arrays, the block must not be probed until they're
+    /// read back
+    auto releaseBits() -> void {
+        data_ = BitVec<ValueType>{};
+        fp_data_ = BitVec<uint64_t>{};
     }
 
     /// The level of this block
     int level_;
 
 private:
-    /// Succinct representation of the internal data
+    /// Decoding kernel of a block, see |selectDecoder|
+    using DecodeFn = auto (*)(const IndexBlock & block, const IndexEdge<ValueType> & ie) -> ValueType;
+
+    /// Xor of the fields of |vertices|, fields are read branch-free, see
+    /// |BitVec::getBitsPacked|
+    template<size_t Arity, typename Bits>
+    static auto xorFields(const Bits & bits, const uint64_t * vertices,
+                          uint64_t stride, uint64_t base, uint64_t len) -> uint64_t {
+        uint64_t result = 0;
+        if (len <= Bits::PackedMaxBits) {
+            for (size_t i = 0; i < Arity; ++i) {
+                result ^= bits.getBitsPacked(vertices[i] * stride + base, len);
+            }
+            return result;
+        }
+        for (size_t i = 0; i < Arity; ++i) {
+            result ^= bits.getBitsWide(vertices[i] * stride + base, len);
+        }
+        return result;
+    }
+
+    /// Field of a byte-aligned slot, read with a plain load
+    template<typename Word>
+    static auto loadWord(const uint64_t * words, uint64_t vertex) -> Word {
+        Word word{};
+        memcpy(&word, reinterpret_cast<const char *>(words) + vertex * sizeof(Word), sizeof(Word));
+        return word;
+    }
+
+    template<size_t Arity>
+    static auto decodeInterleaved(const IndexBlock & block, const IndexEdge<ValueType> & ie) -> ValueType;
+
+    /// Slots without values, i.e. a block of a single value
+    template<size_t Arity>
+    static auto decodeFingerprint(const IndexBlock & block, const IndexEdge<ValueType> & ie) -> ValueType;
+
+    /// Split layout of any field width
+    template<size_t Arity>
+    static auto decodeSplit(const IndexBlock & block, const IndexEdge<ValueType> & ie) -> ValueType;
+
+    /// Split layout of byte-aligned fields, |FpWord| is void without
+    /// fingerprints
+    template<size_t Arity, typename FpWord, typename ValueWord>
+    static auto decodeAligned(const IndexBlock & block, const IndexEdge<ValueType> & ie) -> ValueType;
+
+    /// Pick the kernel matching the layout, the field widths and the hash
+    /// count, it's called once the block is built or loaded
+    void selectDecoder();
+
+    /// Round the field widths up to whole words in the aligned layout
+    void alignFieldWidths();
+
+    /// Slot width minimizing the space of the slots and the exceptions,
+    /// |index_edges| hold the normalized values, and |cost| is set to the
+    /// bits of the patched encoding if it's given
+    auto choosePatchedWidth(const std::vector<IndexEdge<ValueType>> & index_edges, double * cost = nullptr) const -> uint64_t;
+
+    /// Replace the normalized values of |index_edges| by their codes if the
+    /// dictionary encoding is the smallest one, returns whether it is
+    auto buildDictionary(std::vector<IndexEdge<ValueType>> & index_edges) -> bool;
+
+    /// Move the values not fitting in the slots to |exceptions_|
+    auto buildExceptions(std::vector<IndexEdge<ValueType>> & index_edges) -> Status;
+
+    /// Allocate the slots of all the vertices
+    void resizeSlots();
+
+    /// Set the slot |chosen| of an edge, so that the slots of the edge xor
+    /// to its value & fingerprint. The other slots of the edge must be final.
+    void assignEdge(const IndexEdge<ValueType> & ie, ValueType normalized_value, uint64_t chosen);
+
+    /// Succinct representation of the internal data, it holds the
+    /// fingerprints as well in the interleaved layout
     BitVec<ValueType> data_;
 
+    /// Fingerprints in the split layout
+    BitVec<uint64_t> fp_data_;
+
     /// Minimum value in the block
     ValueType min_value_;
 
     /// Maximum value in the block
     ValueType max_value_;
 
-    /// Number of bits used per value for storing the data
+    /// Number of bits used per value for storing the data, 0 when all the
+    /// values are the same and only fingerprints are stored
     uint64_t bits_occupied_by_value_;
 
     /// Number of bits used per value for false positive validation
@@ -86,6 +299,21 @@ private:
 
     /// Number of key/value pairs in this block
     uint64_t entry_num_;
+
+    BlockLayout layout_;
+
+    ValueEncoding encoding_;
+
+    /// Outliers of the patched encoding, shared by the copies of the block
+    std::shared_ptr<const IndexBlock> exceptions_;
+
+    /// Decoded value of the slots of outliers
+    ValueType exception_sentinel_;
+
+    /// Distinct values of the dictionary encoding, indexed by their codes
+    std::shared_ptr<const std::vector<ValueType>> dictionary_;
+
+    DecodeFn decode_;
 };
 
 }  // namespace ssindex
@@ -1,8 +1,16 @@
 #pragma once
 
 #include <string>
+#include <algorithm>
 #include <cassert>
 #include <atomic>
+#include <memory>
+#include <cstring>
+#include <filesystem>
+#include <compare>
+#include <charconv>
+#include <limits>
+#include <unordered_map>
 
 namespace ssindex {
 
@@ -12,8 +20,18 @@ static auto GetFullPath(const std::string & file_name) -> std::string {
 }
 
 static std::atomic_uint64_t file_sequence_number = 0;
-static auto FetchNextArchivedFileName() -> std::string {
-    return GetFullPath(std::to_string(file_sequence_number.fetch_add(1)) + ".arc");
+static auto FetchNextArchivedFileName(const std::string & directory = default_working_directory) -> std::string {
+    return (std::filesystem::path(directory) / (std::to_string(file_sequence_number.fetch_add(1)) + ".arc")).string();
+}
+
+static std::atomic_uint64_t block_file_sequence_number = 0;
+static auto FetchNextBlockFileName(const std::string & directory = default_working_directory) -> std::string {
+    return (std::filesystem::path(directory) / (std::to_string(block_file_sequence_number.fetch_add(1)) + ".blk")).string();
+}
+
+static std::atomic_uint64_t spill_sequence_number = 0;
+static auto FetchNextSpillFilePrefix(const std::string & directory = default_working_directory) -> std::string {
+    return (std::filesystem::path(directory) / (std::to_string(spill_sequence_number.fetch_add(1)) + ".spill")).string();
 }
 
 static std::atomic_uint64_t memtable_sequence_number = 0;
@@ -24,6 +42,28 @@ static auto FetchMemtableId() -> uint64_t {
 using WriteBuffer = const char *;
 using ReadBuffer = char *;
 
+/// Layout of the slots of an |IndexBlock|
+enum class BlockLayout : uint8_t {
+    /// Fingerprint and value bits of a slot are adjacent
+    INTERLEAVED = 0,
+    /// Fingerprints and values are kept in two separate bit arrays
+    SPLIT = 1,
+    /// Split layout with fields rounded up to whole bytes or words
+    ALIGNED = 2
+};
+
+/// Encoding of the values of an |IndexBlock|
+enum class ValueEncoding : uint8_t {
+    /// Values are stored as offsets to the minimum value
+    RANGE = 0,
+    /// Offsets are stored in a narrow width, and the outliers are stored
+    /// aside as exceptions
+    PATCHED = 1,
+    /// Codes of the distinct values are stored, and translated through a
+    /// dictionary
+    DICTIONARY = 2
+};
+
 /// Number of Hash in IndexBlock
 static constexpr size_t NumHashFunctions = 3;
 /// Threshold of flushing memtable to the disk
@@ -34,11 +74,70 @@ static constexpr size_t CompactionThreshold = 99999;
 static constexpr uint64_t DefaultPartitionNum = 32;
 /// Default false positive validation bits
 static constexpr uint64_t DefaultFpBits = 8;
+/// Default number of immutable memtables to slow down & stop writes
+static constexpr uint64_t DefaultSlowdownImmutableNum = 4;
+static constexpr uint64_t DefaultStopImmutableNum = 8;
+/// Number of times a failed flush is retried before leaving it to the next
+/// memtable rotation
+static constexpr size_t FlushRetryNum = 3;
+/// Default bytes of pending compaction input to slow down & stop writes
+static constexpr uint64_t DefaultSlowdownPendingCompactionBytes = 64LLU << 20;
+static constexpr uint64_t DefaultStopPendingCompactionBytes = 256LLU << 20;
+/// Default layout of index blocks, most probes of a batch are rejected by
+/// the fingerprints, which are denser in the split layout
+static constexpr BlockLayout DefaultBlockLayout = BlockLayout::SPLIT;
+/// Default value encoding of index blocks, an encoding falls back to the
+/// simpler ones (i.e. dictionary -> patched -> range) when it doesn't save
+/// any space
+static constexpr ValueEncoding DefaultValueEncoding = ValueEncoding::DICTIONARY;
+/// Maximum number of distinct values of a dictionary-coded block
+static constexpr uint64_t MaxDictionarySize = 1 << 16;
+/// Default number of batches not covered by the batch locator to rebuild it
+static constexpr size_t DefaultLocatorRebuildThreshold = 4;
+/// Default fingerprint bits of a filter-only index, i.e. a false positive
+/// rate of about 1/4096 per batch
+static constexpr uint64_t DefaultFilterFpBits = 12;
+/// Default size of a value log segment
+static constexpr size_t DefaultValueLogSegmentSize = 64LLU << 20;
+/// Default garbage ratio of a sealed value log segment to collect it
+static constexpr double DefaultValueLogGcRatio = 0.5;
+/// Target number of entries of a partition of a batch
+static constexpr uint64_t DefaultPartitionSize = 4096;
+/// Maximum number of partitions of a batch
+static constexpr uint64_t MaxPartitionNum = 1LLU << 16;
+
+/// Number of partitions of a batch of |entry_num| entries, i.e. the least
+/// power of two keeping partitions within |DefaultPartitionSize| entries.
+///
+/// Partition counts are always powers of two, so that partitions of
+/// different counts nest: a key of hash |h| is in partition |h % n| out of
+/// |n|, and for |m <= n|, partition |p| out of |n| is within partition
+/// |p % m| out of |m|. Batches of any counts can thus be merged and split.
+inline auto ChoosePartitionNum(uint64_t entry_num) -> uint64_t {
+    uint64_t num = 1;
+    while (num < MaxPartitionNum && num * DefaultPartitionSize < entry_num) {
+        num <<= 1;
+    }
+    return num;
+}
+
+/// Partitions out of |n| and out of |m| nest into |min(n, m)| groups (see
+/// above): partition |p| out of either count is in group |p % min(n, m)|.
+/// Call |f| with each partition out of |num| in group |group| out of
+/// |group_num|, a divisor of |num|.
+template<typename F>
+inline void ForEachGroupPartition(uint64_t num, uint64_t group_num, uint64_t group, F && f) {
+    for (uint64_t part = group; part < num; part += group_num) {
+        f(part);
+    }
+}
 
 enum Status : int {
     ERROR = -1,
     SUCCESS = 0,
-    PAGE_FULL = 1
+    PAGE_FULL = 1,
+    CANCELLED = 2,
+    NOT_FOUND = 3
 };
 
 #define BOB_MIX(a, b, c) \
@@ -55,8 +154,56 @@ enum Status : int {
     b -= c; b -= a; b ^= (a<<18); \
     c -= a; c -= b; c ^= (b>>22);
 
+/// Fixed-length kernels of the |HASH|es below, for 8 and 16-byte keys (e.g.
+/// integers and UUIDs). They give the same results as the generic ones,
+/// which dispatch to them, without the loops and the tail switches.
+template<size_t Len>
+static auto HashFixed(const char * str, uint64_t seed, uint64_t & a, uint64_t & b, uint64_t & c) {
+    static_assert(Len == 8 || Len == 16, "fixed-length keys are 8 or 16 bytes");
+    uint64_t words[2] = {0, 0};
+    memcpy(words, str, Len);
+    a = 0x9e3779b97f4a7c13LLU + words[0];
+    b = seed + words[1];
+    c = seed + Len;
+    BOB_MIX(a, b, c)
+}
+
+template<size_t Len>
+static auto HashFixed(const char * buf) -> uint64_t {
+    static_assert(Len == 8 || Len == 16, "fixed-length keys are 8 or 16 bytes");
+    const uint64_t m = 0xc6a4a7935bd1e995;
+    const int r = 47;
+
+    uint64_t h = Len * m;
+    for (size_t i = 0; i < Len / 8; ++i) {
+        uint64_t k = 0;
+        memcpy(&k, buf + i * 8, sizeof(k));
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
 static auto HASH(const char * str, size_t len, uint64_t seed, uint64_t & a, uint64_t & b, uint64_t & c) {
     assert(str != nullptr);
+    if (len == 8) {
+        HashFixed<8>(str, seed, a, b, c);
+        return;
+    }
+    if (len == 16) {
+        HashFixed<16>(str, seed, a, b, c);
+        return;
+    }
     //std::cout << str << " " << len << std::endl;
     const auto * data = reinterpret_cast<const uint64_t *>(str);
     const uint64_t * end = data + len / 24;
@@ -110,6 +257,12 @@ static auto HASH(const char * str, size_t len, uint64_t seed, uint64_t & a, uint
 }
 
 static auto HASH(const char * buf, size_t len) -> uint64_t {
+    if (len == 8) {
+        return HashFixed<8>(buf);
+    }
+    if (len == 16) {
+        return HashFixed<16>(buf);
+    }
     const auto * data = reinterpret_cast<const uint8_t *>(buf);
     const uint64_t m = 0xc6a4a7935bd1e995;
     const int r = 47;
@@ -152,6 +305,45 @@ static auto HASH(const char * buf, size_t len) -> uint64_t {
     return h;
 }
 
+/// 16-byte fixed-width key, e.g. a UUID
+struct Key128 {
+    uint64_t hi_ = 0;
+    uint64_t lo_ = 0;
+
+    auto operator<=>(const Key128 & other) const = default;
+};
+
+/// Hash of fixed-width keys through the fixed-length kernels
+template<size_t Len>
+struct FixedKeyHasher {
+    template<typename KeyType>
+    auto operator()(const KeyType & key) const -> size_t {
+        static_assert(sizeof(KeyType) == Len, "key of a different width");
+        return HashFixed<Len>(reinterpret_cast<const char *>(&key));
+    }
+};
+
+/// Hash of the in-memory key tables, fixed-width keys go through the
+/// fixed-length kernels rather than |std::hash| (the identity for integers)
+template<typename KeyType>
+struct KeyHasher {
+    using type = std::hash<KeyType>;
+};
+
+template<>
+struct KeyHasher<uint64_t> {
+    using type = FixedKeyHasher<8>;
+};
+
+template<>
+struct KeyHasher<Key128> {
+    using type = FixedKeyHasher<16>;
+};
+
+/// Memtable of an index, see |KeyHasher|
+template<typename KeyType, typename ValueType>
+using MemtableMap = std::unordered_map<KeyType, ValueType, typename KeyHasher<KeyType>::type>;
+
 template<typename ValueType>
 struct IndexUtils {
     static auto log2(const ValueType & x) -> uint64_t;
@@ -163,7 +355,17 @@ struct IndexUtils {
     /// |key_not_found| will be returned as the result if key not found
     static auto KeyNotFound() -> ValueType;
 
-    static auto RawBuffer(const ValueType & value, size_t * length) -> std::unique_ptr<char>;
+    static auto RawBuffer(const ValueType & value, size_t * length) -> std::unique_ptr<char[]>;
+
+    /// Parse a key (or a value) from its text form, ERROR if |text| isn't
+    /// a valid one as a whole (|value| is left unchanged in that case)
+    static auto FromString(const std::string & text, ValueType * value) -> Status;
+
+    /// Inverse of |RawBuffer|
+    static auto FromRawBuffer(const char * buf, size_t length) -> ValueType;
+
+    /// |HASH| of the |RawBuffer| of a key, without building the buffer
+    static auto Hash(const ValueType & value) -> uint64_t;
 };
 
 template<typename ValueType>
@@ -178,21 +380,85 @@ inline auto IndexUtils<std::string>::KeyNotFound() -> std::string {
 
 
 template<typename ValueType>
-auto IndexUtils<ValueType>::RawBuffer(const ValueType & value, size_t * length) -> std::unique_ptr<char> {
-    auto ret = std::make_unique<char>(sizeof(ValueType));
+auto IndexUtils<ValueType>::RawBuffer(const ValueType & value, size_t * length) -> std::unique_ptr<char[]> {
+    auto ret = std::make_unique<char[]>(sizeof(ValueType));
     *length = sizeof(ValueType);
-    memcpy(ret.get(), &value, length);
+    memcpy(ret.get(), &value, sizeof(ValueType));
     return ret;
 }
 
 template<>
-inline auto IndexUtils<std::string>::RawBuffer(const std::string & value, size_t * length) -> std::unique_ptr<char> {
+inline auto IndexUtils<std::string>::RawBuffer(const std::string & value, size_t * length) -> std::unique_ptr<char[]> {
     *length = value.size();
-    auto ret = std::make_unique<char>(value.size());
+    auto ret = std::make_unique<char[]>(value.size());
     memcpy(ret.get(), value.data(), value.size());
     return ret;
 }
 
+template<typename ValueType>
+auto IndexUtils<ValueType>::FromRawBuffer(const char * buf, size_t length) -> ValueType {
+    assert(length == sizeof(ValueType));
+    ValueType value{};
+    memcpy(&value, buf, sizeof(ValueType));
+    return value;
+}
+
+template<>
+inline auto IndexUtils<std::string>::FromRawBuffer(const char * buf, size_t length) -> std::string {
+    return std::string{buf, length};
+}
+
+template<typename ValueType>
+auto IndexUtils<ValueType>::Hash(const ValueType & value) -> uint64_t {
+    return HASH(reinterpret_cast<const char *>(&value), sizeof(ValueType));
+}
+
+template<>
+inline auto IndexUtils<std::string>::Hash(const std::string & value) -> uint64_t {
+    return HASH(value.data(), value.size());
+}
+
+template<typename ValueType>
+auto IndexUtils<ValueType>::FromString(const std::string & text, ValueType * value) -> Status {
+    uint64_t parsed = 0;
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), parsed);
+    if (ec != std::errc{} || end != text.data() + text.size() || parsed > std::numeric_limits<ValueType>::max()) {
+        return Status::ERROR;
+    }
+    *value = static_cast<ValueType>(parsed);
+    return Status::SUCCESS;
+}
+
+template<>
+inline auto IndexUtils<std::string>::FromString(const std::string & text, std::string * value) -> Status {
+    *value = text;
+    return Status::SUCCESS;
+}
+
+/// 32 hex digits, dashes (as in a UUID) are skipped
+template<>
+inline auto IndexUtils<Key128>::FromString(const std::string & text, Key128 * value) -> Status {
+    std::string digits{};
+    for (char ch : text) {
+        if (ch != '-') {
+            digits.push_back(ch);
+        }
+    }
+    if (digits.size() != 32) {
+        return Status::ERROR;
+    }
+    uint64_t words[2] = {0, 0};
+    for (size_t i = 0; i < 2; ++i) {
+        const char * begin = digits.data() + i * 16;
+        auto [end, ec] = std::from_chars(begin, begin + 16, words[i], 16);
+        if (ec != std::errc{} || end != begin + 16) {
+            return Status::ERROR;
+        }
+    }
+    *value = Key128{words[0], words[1]};
+    return Status::SUCCESS;
+}
+
 template<typename ValueType>
 auto IndexUtils<ValueType>::log2(const ValueType & x) -> uint64_t {
     return 64 - __builtin_clzll(x);
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <filesystem>
+
+#include "ssindex.hpp"
+#include "value_log.hpp"
+
+namespace ssindex {
+
+/// Key-Value Store
+///
+/// |KvStore| stores byte-string values of any length: a record is appended
+/// to a |ValueLog| and its |ValueRef| is set in an |SsIndex|, which acts as
+/// the key directory. The index keeps no keys, so a probe may return the
+/// reference of another key (a false positive, or an arbitrary value of a
+/// block without fingerprints); the log keeps the key next to the value,
+/// and |Get| rejects a record of another key and goes on with the older
+/// batches (see |SsIndex::GetIf|).
+///
+/// The index reports the references overwritten in the memtable or dropped
+/// by compactions as garbage of the log, and once a segment gets sealed,
+/// the segments with at least |gc_ratio| garbage are collected.
+template<typename KeyType>
+class KvStore {
+public:
+    explicit KvStore(const std::string & directory,
+                     double gc_ratio = DefaultValueLogGcRatio,
+                     size_t segment_size = DefaultValueLogSegmentSize,
+                     WriteControllerOptions write_options = WriteControllerOptions{},
+                     Scheduler * scheduler = nullptr)
+        : gc_ratio_(gc_ratio),
+          log_((std::filesystem::path(directory) / "vlog").string(), segment_size),
+          index_((std::filesystem::path(directory) / "index").string(), write_options, scheduler) {
+        index_.SetDropListener([this](const std::pair<KeyType, ValueRef> & entry) {
+            log_.MarkDead(entry.second);
+        });
+    }
+
+    auto Put(const KeyType & key, std::string_view value) -> Status {
+        size_t len = 0;
+        auto buf = IndexUtils<KeyType>::RawBuffer(key, &len);
+        std::lock_guard<std::mutex> w_latch{write_mutex_};
+        ValueRef ref = 0;
+        bool sealed = false;
+        auto s = log_.Append(buf.get(), len, value.data(), value.size(), &ref, &sealed);
+        if (s != Status::SUCCESS) {
+            return s;
+        }
+        index_.Set(key, ref);
+        if (sealed) {
+            collectGarbage();
+        }
+        return Status::SUCCESS;
+    }
+
+    /// |view| points into the log, no copy of the value is made
+    auto Get(const KeyType & key, ValueView * view) -> Status {
+        while (true) {
+            /// the garbage collection may drop the segment of the reference
+            /// found, once it has set the moved one in the index, and a
+            /// lookup started after that finds the moved one
+            auto epoch = gc_epoch_.load(std::memory_order_acquire);
+            auto s = get(key, view);
+            if (s == Status::SUCCESS || gc_epoch_.load(std::memory_order_acquire) == epoch) {
+                return s;
+            }
+        }
+    }
+
+    /// Collect the segments with enough garbage, return the number of them
+    auto CollectGarbage() -> size_t {
+        std::lock_guard<std::mutex> w_latch{write_mutex_};
+        return collectGarbage();
+    }
+
+    /// Number of entries of the memtable to trigger a flush
+    void SetMemtableFlushThreshold(size_t threshold) {
+        index_.SetMemtableFlushThreshold(threshold);
+    }
+
+    void Optimize() {
+        index_.Optimize();
+    }
+
+    void WaitTaskComplete() {
+        index_.WaitTaskComplete();
+    }
+
+    /// Number of bytes used by the key directory
+    auto GetUsage() -> uint64_t {
+        return index_.GetUsage();
+    }
+
+    /// Number of bytes of the records in the log
+    auto GetLogUsage() const -> uint64_t {
+        return log_.GetDiskUsage();
+    }
+
+    auto GetSegmentNum() const -> size_t {
+        return log_.GetSegmentNum();
+    }
+
+private:
+    auto get(const KeyType & key, ValueView * view) -> Status {
+        size_t len = 0;
+        auto buf = IndexUtils<KeyType>::RawBuffer(key, &len);
+        std::string_view key_bytes{buf.get(), len};
+        Status s = Status::SUCCESS;
+        auto ref = index_.GetIf(key, [&](const ValueRef & candidate) -> bool {
+            return log_.Read(candidate, view) == Status::SUCCESS && view->key_ == key_bytes;
+        }, &s);
+        if (s != Status::SUCCESS) {
+            *view = ValueView{};
+            return s;
+        }
+        if (ref == index_.key_not_found) {
+            *view = ValueView{};
+            return Status::NOT_FOUND;
+        }
+        /// a memtable hit is not checked by |accept|
+        return log_.Read(ref, view);
+    }
+
+    /// Move the live records of the candidate segments to the active one,
+    /// the caller must hold |write_mutex_|
+    auto collectGarbage() -> size_t {
+        auto candidates = log_.CollectCandidates(gc_ratio_);
+        size_t collected = 0;
+        for (auto segment_id : candidates) {
+            std::vector<std::pair<KeyType, ValueRef>> live{};
+            auto s = log_.ScanSegment(segment_id, [&](ValueRef ref, const ValueView & view) {
+                auto key = IndexUtils<KeyType>::FromRawBuffer(view.key_.data(), view.key_.size());
+                ValueView current{};
+                if (Get(key, &current) == Status::SUCCESS && current.key_.data() == view.key_.data()) {
+                    live.emplace_back(std::move(key), ref);
+                }
+            });
+            if (s != Status::SUCCESS) {
+                continue;
+            }
+            bool moved = true;
+            for (auto & [key, ref] : live) {
+                ValueView view{};
+                ValueRef new_ref = 0;
+                if (log_.Read(ref, &view) != Status::SUCCESS
+                    || log_.Append(view.key_.data(), view.key_.size(), view.value_.data(), view.value_.size(), &new_ref) != Status::SUCCESS) {
+                    moved = false;
+                    break;
+                }
+                index_.Set(key, new_ref);
+            }
+            if (moved) {
+                /// bumped before the drop, so that a reader that may have
+                /// found a reference into the segment sees it changed
+                gc_epoch_.fetch_add(1, std::memory_order_acq_rel);
+                log_.DropSegment(segment_id);
+                ++collected;
+            }
+        }
+        return collected;
+    }
+
+    double gc_ratio_;
+
+    /// Serializes the writers, so that a record being moved by the garbage
+    /// collection can't be overwritten meanwhile
+    std::mutex write_mutex_;
+
+    /// Number of the segments dropped by the garbage collection
+    std::atomic<uint64_t> gc_epoch_{0};
+
+    ValueLog log_;
+
+    SsIndex<KeyType, ValueRef> index_;
+};
+
+}  // namespace ssindex
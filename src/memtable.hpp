@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+
+#include "index_common.hpp"
+
+namespace ssindex {
+
+/// Memtable of an index, organized as one table per partition.
+///
+/// The partition of a key is that of the blocks (see
+/// |IndexUtils::Hash|), computed once by the caller of |Insert| and
+/// |Find|, so a flush hands each table right to the builder of its
+/// partition, and a probe only searches the table of the key.
+template<typename KeyType, typename ValueType>
+class PartitionedMemtable {
+public:
+    using Table = MemtableMap<KeyType, ValueType>;
+
+    explicit PartitionedMemtable(uint64_t partition_num)
+        : tables_(partition_num == 0 ? 1 : partition_num),
+          size_(0) {}
+
+    /// Same as |std::unordered_map::try_emplace| on the table of |partition|
+    auto Insert(uint64_t partition, const KeyType & key, const ValueType & value) -> std::pair<typename Table::iterator, bool> {
+        auto ret = tables_[partition].try_emplace(key, value);
+        if (ret.second) {
+            size_++;
+        }
+        return ret;
+    }
+
+    auto Find(uint64_t partition, const KeyType & key, ValueType * value) const -> bool {
+        auto & table = tables_[partition];
+        if (auto iter = table.find(key); iter != table.end()) {
+            *value = iter->second;
+            return true;
+        }
+        return false;
+    }
+
+    auto Partition(uint64_t partition) const -> const Table & {
+        return tables_[partition];
+    }
+
+    auto PartitionNum() const -> uint64_t {
+        return tables_.size();
+    }
+
+    /// Number of entries of all the partitions
+    auto Size() const -> size_t {
+        return size_;
+    }
+
+    auto Empty() const -> bool {
+        return size_ == 0;
+    }
+
+private:
+    std::vector<Table> tables_;
+
+    size_t size_;
+};
+
+}  // namespace ssindex
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "index_common.hpp"
+
+namespace ssindex {
+
+/// Filter of a memtable
+///
+/// A blocked Bloom filter: a key sets |ProbeNum| bits within a single
+/// 64-byte block, so that |MayContain| touches one cache line. Keys are
+/// added by |Set| while the memtable is active, so the filter is complete
+/// as soon as the memtable is rotated, and |Get| skips the immutable
+/// memtables not holding a key without any lookup in their tables.
+///
+/// Bits are only ever set, and atomically, so readers of a rotated
+/// memtable need no lock on the filter.
+class MemtableFilter {
+public:
+    static constexpr uint64_t BitsPerKey = 10;
+    static constexpr uint64_t ProbeNum = 6;
+    static constexpr uint64_t WordsPerBlock = 8;
+
+    /// |expected_num| keys at a false positive rate of about 1%, more keys
+    /// are still fine but less filtered
+    explicit MemtableFilter(size_t expected_num)
+        : block_num_((expected_num * BitsPerKey + WordsPerBlock * 64 - 1) / (WordsPerBlock * 64) + 1),
+          words_(std::make_unique<std::atomic<uint64_t>[]>(block_num_ * WordsPerBlock)) {}
+
+    void Add(size_t hash) {
+        auto * block = words_.get() + blockOf(hash) * WordsPerBlock;
+        uint64_t h = mix(hash);
+        for (uint64_t i = 0; i < ProbeNum; ++i, h >>= 9) {
+            block[(h >> 6) & (WordsPerBlock - 1)].fetch_or(1LLU << (h & 63), std::memory_order_relaxed);
+        }
+    }
+
+    auto MayContain(size_t hash) const -> bool {
+        const auto * block = words_.get() + blockOf(hash) * WordsPerBlock;
+        uint64_t h = mix(hash);
+        for (uint64_t i = 0; i < ProbeNum; ++i, h >>= 9) {
+            if ((block[(h >> 6) & (WordsPerBlock - 1)].load(std::memory_order_relaxed) & (1LLU << (h & 63))) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Number of bytes used by the filter
+    auto GetFootprint() const -> size_t {
+        return block_num_ * WordsPerBlock * sizeof(uint64_t);
+    }
+
+private:
+    auto blockOf(size_t hash) const -> uint64_t {
+        return static_cast<uint64_t>(hash) % block_num_;
+    }
+
+    /// Bits within the block must not correlate with the block chosen,
+    /// each probe takes 9 bits of the mixed hash
+    static auto mix(size_t hash) -> uint64_t {
+        uint64_t h = static_cast<uint64_t>(hash) * 0x9e3779b97f4a7c15LLU;
+        return h ^ (h >> 29);
+    }
+
+    uint64_t block_num_;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> words_;
+};
+
+}  // namespace ssindex
@@ -0,0 +1,120 @@
+#include "mph_block.hpp"
+#include "hypergraph.hpp"
+
+#include <algorithm>
+
+namespace ssindex {
+
+namespace {
+
+/// Bit 2k is set iff the k-th 2-bit value of |word| is unused
+inline auto unusedMask(uint64_t word) -> uint64_t {
+    return word & (word >> 1) & 0x5555555555555555LLU;
+}
+
+}  // namespace
+
+auto MphBlock::TryBuild(const std::vector<MphEdge> & edges, uint64_t seed) -> Status {
+    if (edges.size() > MaxEntryNum) {
+        return Status::ERROR;
+    }
+    entry_num_ = static_cast<uint64_t>(edges.size());
+    seed_ = seed;
+    data_ = BitVec<uint64_t>{};
+    samples_.clear();
+    if (entry_num_ == 0) {
+        num_v_ = 0;
+        return Status::SUCCESS;
+    }
+    num_v_ = static_cast<uint64_t>(entry_num_ * kScale / double(NumHashFunctions) + intercept);
+
+    std::vector<std::pair<uint64_t, uint8_t>> peeled{};
+    auto s = PeelHypergraph(edges, num_v_, peeled);
+    if (s != Status::SUCCESS) {
+        return s;
+    }
+
+    const uint64_t vertex_num = num_v_ * NumHashFunctions;
+    data_.Resize(vertex_num * 2);
+    for (uint64_t t = 0; t < vertex_num; ++t) {
+        data_.setBitsPacked(t * 2, 2, UnusedVertex);
+    }
+
+    /// an unused vertex counts as 0, as it's 3 (mod 3)
+    std::reverse(peeled.begin(), peeled.end());
+    for (auto & [edge, chosen] : peeled) {
+        const MphEdge & ie = edges[edge];
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < NumHashFunctions; ++i) {
+            if (i != chosen) {
+                sum += getVertex(ie.get(i, num_v_));
+            }
+        }
+        data_.setBitsPacked(ie.get(chosen, num_v_) * 2, 2, (chosen + 6 - sum % 3) % 3);
+    }
+
+    samples_.resize(vertex_num / RankSampleVertices + 1);
+    uint64_t count = 0;
+    for (uint64_t t = 0; t < vertex_num; ++t) {
+        if (t % RankSampleVertices == 0) {
+            samples_[t / RankSampleVertices] = static_cast<uint32_t>(count);
+        }
+        if (getVertex(t) != UnusedVertex) {
+            ++count;
+        }
+    }
+    assert(count == entry_num_);
+    return Status::SUCCESS;
+}
+
+auto MphBlock::rank(uint64_t t) const -> uint64_t {
+    constexpr uint64_t vertices_per_word = BitVec<uint64_t>::BitsNum / 2;
+    const uint64_t * words = data_.Data();
+    uint64_t result = samples_[t / RankSampleVertices];
+    uint64_t last = t / vertices_per_word;
+    for (uint64_t w = t / RankSampleVertices * (RankSampleVertices / vertices_per_word); w < last; ++w) {
+        result += vertices_per_word - __builtin_popcountll(unusedMask(words[w]));
+    }
+    uint64_t rem = t % vertices_per_word;
+    if (rem != 0) {
+        result += rem - __builtin_popcountll(unusedMask(words[last]) & ((1LLU << (rem * 2)) - 1));
+    }
+    return result;
+}
+
+auto MphBlock::GetRank(const MphEdge & edge) const -> uint64_t {
+    if (entry_num_ == 0) {
+        return 0;
+    }
+    uint64_t vertices[NumHashFunctions];
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < NumHashFunctions; ++i) {
+        vertices[i] = edge.get(i, num_v_);
+        sum += getVertex(vertices[i]);
+    }
+    /// only a key outside the set may land on an unused vertex at the end
+    return std::min(rank(vertices[sum % 3]), entry_num_ - 1);
+}
+
+auto MphBlock::write(std::ofstream & ofs) const -> void {
+    ofs.write((const char *)(&entry_num_), sizeof(entry_num_));
+    ofs.write((const char *)(&num_v_), sizeof(num_v_));
+    ofs.write((const char *)(&seed_), sizeof(seed_));
+    data_.write(ofs);
+    auto sample_num = static_cast<uint64_t>(samples_.size());
+    ofs.write((const char *)(&sample_num), sizeof(sample_num));
+    ofs.write((const char *)(samples_.data()), sizeof(uint32_t) * sample_num);
+}
+
+auto MphBlock::read(std::ifstream & ifs) -> void {
+    ifs.read((char *)(&entry_num_), sizeof(entry_num_));
+    ifs.read((char *)(&num_v_), sizeof(num_v_));
+    ifs.read((char *)(&seed_), sizeof(seed_));
+    data_.read(ifs);
+    uint64_t sample_num = 0;
+    ifs.read((char *)(&sample_num), sizeof(sample_num));
+    samples_.resize(sample_num);
+    ifs.read((char *)(samples_.data()), sizeof(uint32_t) * sample_num);
+}
+
+}  // namespace ssindex
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include <fstream>
+#include <limits>
+
+#include "bitvec.hpp"
+#include "index_edge.hpp"
+
+namespace ssindex {
+
+/// Edge of a key in |MphBlock|, only the hashes of the key are used
+using MphEdge = IndexEdge<uint8_t>;
+
+/// Minimal perfect hash of a fixed key set.
+///
+/// Keys are the edges of the same hyper graph as |IndexBlock|, but a vertex
+/// holds a 2-bit value only: the vertex an edge is peeled at gets the value
+/// making the values of the edge sum up to its hash index (mod 3), and the
+/// vertices never chosen hold 3. A key is mapped to the number of chosen
+/// vertices before its own one, which is a dense rank in [0, n). Counts are
+/// sampled every |RankSampleVertices| vertices, so a key costs about
+/// 2 * |kScale| bits plus the samples, whatever the number of keys.
+///
+/// The rank of a key outside the set is arbitrary (but still in [0, n)).
+class MphBlock {
+public:
+    /// Redundancy for the vertices, right above the peeling threshold
+    static constexpr double kScale = 1.25;
+    static constexpr uint64_t intercept = 10;
+    /// Vertices between two rank samples, i.e. 8 words of 2-bit values
+    static constexpr uint64_t RankSampleVertices = 256;
+    /// Rank samples are 32-bit
+    static constexpr uint64_t MaxEntryNum = std::numeric_limits<uint32_t>::max();
+
+    explicit MphBlock()
+        : entry_num_(0)
+        , num_v_(0)
+        , seed_(0x12345678) {}
+
+    /// |edges| must be hashed with |seed| and distinct, and at most
+    /// |MaxEntryNum| of them
+    auto TryBuild(const std::vector<MphEdge> & edges, uint64_t seed) -> Status;
+
+    auto GetRank(const MphEdge & edge) const -> uint64_t;
+
+    /// Number of keys, i.e. the range of the ranks
+    auto Size() const -> uint64_t {
+        return entry_num_;
+    }
+
+    auto GetSeed() const -> uint64_t {
+        return seed_;
+    }
+
+    /// Number of bytes used by the block
+    auto GetFootprint() const -> size_t {
+        return data_.BitsCount() / 8 + samples_.size() * sizeof(uint32_t) + sizeof(uint64_t) * 3;
+    }
+
+    auto write(std::ofstream & ofs) const -> void;
+
+    auto read(std::ifstream & ifs) -> void;
+
+private:
+    static constexpr uint64_t UnusedVertex = 3;
+
+    auto getVertex(uint64_t t) const -> uint64_t {
+        return data_.getBitsPacked(t * 2, 2);
+    }
+
+    /// Number of chosen vertices before the vertex |t|
+    auto rank(uint64_t t) const -> uint64_t;
+
+    /// 2-bit values of all the vertices
+    BitVec<uint64_t> data_;
+
+    /// Number of chosen vertices before every |RankSampleVertices| vertices
+    std::vector<uint32_t> samples_;
+
+    /// Number of keys in this block
+    uint64_t entry_num_;
+
+    /// Number of vertices of each block in the hyper graph
+    uint64_t num_v_;
+
+    /// Seed for randomization
+    uint64_t seed_;
+};
+
+}  // namespace ssindex
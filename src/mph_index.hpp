@@ -0,0 +1,168 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <algorithm>
+
+#include "mph_block.hpp"
+
+namespace ssindex {
+
+/// Minimal Perfect Hash Index
+///
+/// |MphIndex| maps a fixed set of n keys to dense ranks in [0, n), which
+/// is what an |SsIndex| storing the ids as values would do, at a fraction
+/// of the space: the ranks are not stored but derived from an |MphBlock|
+/// per partition, costing about 2.7 bits per key however large n is.
+///
+/// Keys are partitioned the same way as |SsIndex| does, and the rank of a
+/// key is the number of keys of the previous partitions plus its rank
+/// within the partition. A key outside the set gets an arbitrary rank.
+template<typename KeyType>
+class MphIndex {
+public:
+    explicit MphIndex(uint64_t partition_num = DefaultPartitionNum, uint64_t seed = 0x12345678)
+        : partition_num_(partition_num == 0 ? 1 : partition_num),
+          seed_(seed),
+          blocks_(partition_num_),
+          offsets_(partition_num_ + 1, 0) {}
+
+    /// Build the ranks of |keys|, with |parallelism| partitions built at
+    /// the same time. Duplicated keys are ranked once.
+    auto Build(const std::vector<KeyType> & keys,
+               size_t parallelism = std::thread::hardware_concurrency()) -> Status {
+        std::vector<std::vector<KeyType>> part_keys(partition_num_);
+        for (auto & key : keys) {
+            size_t len = 0;
+            auto buf = IndexUtils<KeyType>::RawBuffer(key, &len);
+            part_keys[GetBlockPartition(buf.get(), len)].emplace_back(key);
+        }
+
+        std::atomic<uint64_t> next_part{0};
+        std::atomic<bool> failed{false};
+        auto worker = [&]() {
+            for (uint64_t part = next_part++; part < partition_num_ && !failed; part = next_part++) {
+                if (buildSinglePartition(part_keys[part], blocks_[part]) != Status::SUCCESS) {
+                    failed = true;
+                }
+            }
+        };
+        std::vector<std::thread> threads{};
+        for (size_t i = 1; i < std::max<size_t>(parallelism, 1); ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto & thread : threads) {
+            thread.join();
+        }
+        if (failed) {
+            return Status::ERROR;
+        }
+
+        for (uint64_t part = 0; part < partition_num_; ++part) {
+            offsets_[part + 1] = offsets_[part] + blocks_[part].Size();
+        }
+        return Status::SUCCESS;
+    }
+
+    auto Get(const KeyType & key) const -> uint64_t {
+        size_t len = 0;
+        auto buf = IndexUtils<KeyType>::RawBuffer(key, &len);
+        auto part = GetBlockPartition(buf.get(), len);
+        const MphBlock & block = blocks_[part];
+        if (block.Size() == 0) {
+            return 0;
+        }
+        MphEdge ie(buf.get(), len, 0, block.GetSeed());
+        return offsets_[part] + block.GetRank(ie);
+    }
+
+    /// Number of keys, i.e. the range of the ranks
+    auto Size() const -> uint64_t {
+        return offsets_.back();
+    }
+
+    auto GetBlockPartition(const char * kbuf, const size_t klen) const -> uint64_t {
+        return HASH(kbuf, klen) % partition_num_;
+    }
+
+    /// Number of bytes used by the index
+    auto GetUsage() const -> uint64_t {
+        uint64_t sum = offsets_.size() * sizeof(uint64_t);
+        for (auto & block : blocks_) {
+            sum += block.GetFootprint();
+        }
+        return sum;
+    }
+
+    auto Save(const std::string & file_name) const -> Status {
+        std::ofstream ofs(file_name, std::ios::binary);
+        if (!ofs) {
+            return Status::ERROR;
+        }
+        ofs.write((const char *)(&partition_num_), sizeof(partition_num_));
+        for (auto & block : blocks_) {
+            block.write(ofs);
+        }
+        return ofs ? Status::SUCCESS : Status::ERROR;
+    }
+
+    auto Load(const std::string & file_name) -> Status {
+        std::ifstream ifs(file_name, std::ios::binary);
+        if (!ifs) {
+            return Status::ERROR;
+        }
+        ifs.read((char *)(&partition_num_), sizeof(partition_num_));
+        if (!ifs || partition_num_ == 0) {
+            return Status::ERROR;
+        }
+        blocks_.assign(partition_num_, MphBlock{});
+        offsets_.assign(partition_num_ + 1, 0);
+        for (uint64_t part = 0; part < partition_num_; ++part) {
+            blocks_[part].read(ifs);
+            offsets_[part + 1] = offsets_[part] + blocks_[part].Size();
+        }
+        return ifs ? Status::SUCCESS : Status::ERROR;
+    }
+
+private:
+    auto buildSinglePartition(std::vector<KeyType> & keys, MphBlock & block) -> Status {
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        /// no seed makes it fit
+        if (keys.size() > MphBlock::MaxEntryNum) {
+            return Status::ERROR;
+        }
+
+        uint64_t seed = seed_;
+        const size_t round = 20;
+        for (size_t i = 0; i < round; ++i) {
+            std::vector<MphEdge> edges{};
+            edges.reserve(keys.size());
+            for (auto & key : keys) {
+                size_t length = 0;
+                auto buf = IndexUtils<KeyType>::RawBuffer(key, &length);
+                edges.emplace_back(buf.get(), length, 0, seed);
+            }
+            if (block.TryBuild(edges, seed) == Status::SUCCESS) {
+                return Status::SUCCESS;
+            }
+            seed += 114514;
+        }
+        return Status::ERROR;
+    }
+
+    uint64_t partition_num_;
+
+    uint64_t seed_;
+
+    std::vector<MphBlock> blocks_;
+
+    /// Number of keys of the partitions before each partition
+    std::vector<uint64_t> offsets_;
+};
+
+}  // namespace ssindex
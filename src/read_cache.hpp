@@ -0,0 +1,188 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "index_common.hpp"
+
+namespace ssindex {
+
+struct ReadCacheStats {
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+/// Read Cache
+///
+/// |ReadCache| keeps the answers of |SsIndex::Get| for the hot keys, so
+/// that a popular key skips the memtable, immutable & batch walk. Keys are
+/// sharded by hash, each shard owns a fixed number of slots and evicts
+/// them in CLOCK order: a hit sets the reference bit of a slot, and the
+/// hand clears the bits until it meets a slot not referenced since its
+/// last pass.
+///
+/// The index invalidates the cache in two ways:
+/// 1) |Erase| a key on |Set|. A reader that looked the key up in the index
+/// before the |Set| and inserts its answer after it must not win, so an
+/// answer is only inserted if the shard saw no write since the reader
+/// started (see |GetTicket|).
+/// 2) |Invalidate| all the keys when the batches change (a batch publish
+/// or a compaction commit), which bumps an epoch in O(1): an entry of an
+/// older epoch is a miss.
+template<typename KeyType, typename ValueType>
+class ReadCache {
+public:
+    /// Estimated bytes of an entry: the slot, and the node & bucket of the
+    /// slot index
+    static constexpr size_t EntryFootprint = sizeof(KeyType) * 2 + sizeof(ValueType) + sizeof(uint64_t) * 2 + sizeof(void *) * 4;
+
+    static constexpr size_t ShardNum = 16;
+
+    /// Snapshot of a shard taken before a lookup in the index
+    struct Ticket {
+        uint64_t epoch_;
+        uint64_t version_;
+    };
+
+    /// |memory_budget| bytes are split evenly among the shards
+    explicit ReadCache(size_t memory_budget)
+        : epoch_(0),
+          shards_(ShardNum) {
+        size_t capacity = memory_budget / EntryFootprint / ShardNum;
+        capacity = capacity == 0 ? 1 : capacity;
+        for (auto & shard : shards_) {
+            shard.slots_ = std::make_unique<Slot[]>(capacity);
+            shard.capacity_ = capacity;
+            shard.index_.reserve(capacity);
+        }
+    }
+
+    auto Lookup(const KeyType & key, ValueType * value) -> bool {
+        auto & shard = getShard(key);
+        std::shared_lock<std::shared_mutex> r_latch{shard.mutex_};
+        auto iter = shard.index_.find(key);
+        if (iter != shard.index_.end()) {
+            Slot & slot = shard.slots_[iter->second];
+            if (slot.epoch_ == epoch_.load(std::memory_order_acquire)) {
+                slot.referenced_.store(true, std::memory_order_relaxed);
+                *value = slot.value_;
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    auto GetTicket(const KeyType & key) -> Ticket {
+        auto & shard = getShard(key);
+        std::shared_lock<std::shared_mutex> r_latch{shard.mutex_};
+        return Ticket{epoch_.load(std::memory_order_acquire), shard.version_};
+    }
+
+    /// Insert the answer looked up after |ticket| was taken, unless it may
+    /// be stale
+    void Insert(const KeyType & key, const ValueType & value, const Ticket & ticket) {
+        auto & shard = getShard(key);
+        std::lock_guard<std::shared_mutex> w_latch{shard.mutex_};
+        if (shard.version_ != ticket.version_ || epoch_.load(std::memory_order_acquire) != ticket.epoch_) {
+            return;
+        }
+        uint64_t pos;
+        if (auto iter = shard.index_.find(key); iter != shard.index_.end()) {
+            pos = iter->second;
+        } else {
+            pos = shard.evict();
+            shard.slots_[pos].key_ = key;
+            shard.index_.emplace(key, pos);
+        }
+        Slot & slot = shard.slots_[pos];
+        slot.value_ = value;
+        slot.epoch_ = ticket.epoch_;
+        slot.referenced_.store(false, std::memory_order_relaxed);
+    }
+
+    void Erase(const KeyType & key) {
+        auto & shard = getShard(key);
+        std::lock_guard<std::shared_mutex> w_latch{shard.mutex_};
+        shard.version_++;
+        if (auto iter = shard.index_.find(key); iter != shard.index_.end()) {
+            shard.slots_[iter->second].used_ = false;
+            shard.index_.erase(iter);
+        }
+    }
+
+    /// Invalidate all the entries
+    void Invalidate() {
+        epoch_.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    auto GetStats() const -> ReadCacheStats {
+        return ReadCacheStats{hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed)};
+    }
+
+    /// Number of bytes of all the slots, i.e. about the memory budget
+    auto GetFootprint() const -> uint64_t {
+        return shards_.size() * shards_.front().capacity_ * EntryFootprint;
+    }
+
+private:
+    struct Slot {
+        KeyType key_{};
+        ValueType value_{};
+        uint64_t epoch_ = 0;
+        bool used_ = false;
+        std::atomic<bool> referenced_{false};
+    };
+
+    struct Shard {
+        /// Pick the slot of a new entry, the caller must hold |mutex_|
+        auto evict() -> uint64_t {
+            while (true) {
+                Slot & slot = slots_[hand_];
+                uint64_t pos = hand_;
+                hand_ = (hand_ + 1) % capacity_;
+                if (!slot.used_) {
+                    slot.used_ = true;
+                    return pos;
+                }
+                if (!slot.referenced_.exchange(false, std::memory_order_relaxed)) {
+                    index_.erase(slot.key_);
+                    return pos;
+                }
+            }
+        }
+
+        std::shared_mutex mutex_;
+
+        std::unique_ptr<Slot[]> slots_;
+
+        uint64_t capacity_ = 0;
+
+        /// Clock hand
+        uint64_t hand_ = 0;
+
+        /// Number of writes to the keys of the shard
+        uint64_t version_ = 0;
+
+        std::unordered_map<KeyType, uint64_t, typename KeyHasher<KeyType>::type> index_;
+    };
+
+    auto getShard(const KeyType & key) -> Shard & {
+        return shards_[typename KeyHasher<KeyType>::type{}(key) % ShardNum];
+    }
+
+    std::atomic<uint64_t> epoch_;
+
+    std::vector<Shard> shards_;
+
+    std::atomic<uint64_t> hits_{0};
+
+    std::atomic<uint64_t> misses_{0};
+};
+
+}  // namespace ssindex
@@ -8,14 +8,113 @@
 #include <thread>
 #include <atomic>
 #include <utility>
+#include <future>
+#include <chrono>
+#include <vector>
+#include <algorithm>
 #include <unistd.h>
 
 #include "index_common.hpp"
 
 namespace ssindex {
 
+enum class TaskState : int {
+    PENDING = 0,
+    RUNNING = 1,
+    FINISHED = 2,
+    CANCELLED = 3
+};
+
+/// State shared by a scheduled |Task| and every |TaskHandle| of it. The
+/// promise is fulfilled exactly once, either by the worker after the task
+/// has been executed, or by whoever cancels the task before it starts.
+struct TaskContext {
+    explicit TaskContext()
+        : state_(TaskState::PENDING),
+          future_(promise_.get_future().share()) {}
+
+    auto TryStart() -> bool {
+        auto expected = TaskState::PENDING;
+        return state_.compare_exchange_strong(expected, TaskState::RUNNING);
+    }
+
+    auto TryCancel() -> bool {
+        auto expected = TaskState::PENDING;
+        if (!state_.compare_exchange_strong(expected, TaskState::CANCELLED)) {
+            return false;
+        }
+        notifyFinish(Status::CANCELLED);
+        promise_.set_value(Status::CANCELLED);
+        return true;
+    }
+
+    void Finish(Status s) {
+        state_.store(s == Status::CANCELLED ? TaskState::CANCELLED : TaskState::FINISHED);
+        notifyFinish(s);
+        promise_.set_value(s);
+    }
+
+    void notifyFinish(Status s) {
+        if (on_finish_) {
+            on_finish_(s);
+            on_finish_ = nullptr;
+        }
+    }
+
+    /// Called once the task is done, whether it succeeded, failed or was
+    /// cancelled, before its waiters are woken up
+    std::function<void(Status)> on_finish_;
+
+    std::atomic<TaskState> state_;
+    std::promise<Status> promise_;
+    std::shared_future<Status> future_;
+};
+
+/// |TaskHandle| is the future side of a scheduled task. It's cheap to copy,
+/// and it stays valid after the task itself has been destroyed.
+class TaskHandle {
+public:
+    explicit TaskHandle() = default;
+
+    explicit TaskHandle(std::shared_ptr<TaskContext> context) : context_(std::move(context)) {}
+
+    auto Valid() const -> bool {
+        return context_ != nullptr;
+    }
+
+    /// Block until the task is finished or cancelled
+    auto Wait() const -> Status {
+        if (!Valid()) {
+            return Status::SUCCESS;
+        }
+        return context_->future_.get();
+    }
+
+    auto Done() const -> bool {
+        if (!Valid()) {
+            return true;
+        }
+        return context_->future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    /// Cancel the task if it hasn't been started yet, returns whether
+    /// the cancellation took effect
+    auto Cancel() const -> bool {
+        if (!Valid()) {
+            return false;
+        }
+        return context_->TryCancel();
+    }
+
+private:
+    std::shared_ptr<TaskContext> context_;
+};
+
 struct Task {
-    explicit Task() : pre_exec_([]{}), post_exec_([]{}) {}
+    explicit Task()
+        : pre_exec_([]{}),
+          post_exec_([]{}),
+          context_(std::make_shared<TaskContext>()) {}
 
     virtual ~Task() = default;
 
@@ -24,6 +123,14 @@ struct Task {
     std::function<void()> pre_exec_;
     std::function<void()> post_exec_;
 
+    /// Tasks that must be finished before this one starts
+    std::vector<TaskHandle> dependencies_;
+
+    /// Tasks that must be done, in any state, before this one starts
+    std::vector<TaskHandle> predecessors_;
+
+    std::shared_ptr<TaskContext> context_;
+
     void SetPreExecute(std::function<void()> && pre_exec) {
         pre_exec_ = std::move(pre_exec);
     }
@@ -32,6 +139,32 @@ struct Task {
         post_exec_ = std::move(post_exec);
     }
 
+    /// Unlike the post execution, it's called on every way out of the
+    /// task, with its final status
+    void SetOnFinish(std::function<void(Status)> && on_finish) {
+        context_->on_finish_ = std::move(on_finish);
+    }
+
+    /// The dependency must have been scheduled before this task, so that
+    /// a worker never waits on a task queued behind itself.
+    void DependsOn(const TaskHandle & dependency) {
+        if (dependency.Valid()) {
+            dependencies_.emplace_back(dependency);
+        }
+    }
+
+    /// Like |DependsOn|, but only the order matters: the task still runs
+    /// if |predecessor| has failed or has been cancelled
+    void RunsAfter(const TaskHandle & predecessor) {
+        if (predecessor.Valid()) {
+            predecessors_.emplace_back(predecessor);
+        }
+    }
+
+    auto GetHandle() const -> TaskHandle {
+        return TaskHandle{context_};
+    }
+
     void PreExecute() const {
         pre_exec_();
     }
@@ -39,6 +172,104 @@ struct Task {
     void PostExecute() const {
         post_exec_();
     }
+
+    /// Wait for all the dependencies, returns the status of the first
+    /// one which didn't succeed (the task doesn't run in that case)
+    auto WaitDependencies() const -> Status {
+        for (auto & predecessor : predecessors_) {
+            predecessor.Wait();
+        }
+        for (auto & dependency : dependencies_) {
+            if (auto s = dependency.Wait(); s != Status::SUCCESS) {
+                return s;
+            }
+        }
+        return Status::SUCCESS;
+    }
+};
+
+/// |TaskGroup| collects the handles of related tasks, so that callers can
+/// wait on (or cancel) exactly that work instead of draining the scheduler.
+class TaskGroup {
+public:
+    explicit TaskGroup() = default;
+
+    void Add(const TaskHandle & handle) {
+        std::lock_guard<std::mutex> latch{mutex_};
+        /// drop the handles which are already done, keeping their failure
+        for (auto & h : handles_) {
+            if (h.Done()) {
+                recordStatus(h.Wait());
+            }
+        }
+        handles_.erase(std::remove_if(handles_.begin(), handles_.end(),
+                [](const TaskHandle & h) { return h.Done(); }), handles_.end());
+        handles_.emplace_back(handle);
+    }
+
+    /// Wait for all the tasks in the group, including the ones added
+    /// while waiting. Returns the first non-successful status, if any.
+    ///
+    /// The handles stay in the group while they're waited on, so that a
+    /// concurrent |Cancel| still reaches the tasks not started yet.
+    auto Wait() -> Status {
+        while (true) {
+            std::vector<TaskHandle> handles{};
+            {
+                std::lock_guard<std::mutex> latch{mutex_};
+                handles = handles_;
+            }
+            bool all_done = true;
+            for (auto & handle : handles) {
+                if (!handle.Done()) {
+                    all_done = false;
+                    handle.Wait();
+                }
+            }
+            if (all_done) {
+                break;
+            }
+        }
+
+        std::lock_guard<std::mutex> latch{mutex_};
+        for (auto & handle : handles_) {
+            if (handle.Done()) {
+                recordStatus(handle.Wait());
+            }
+        }
+        handles_.erase(std::remove_if(handles_.begin(), handles_.end(),
+                [](const TaskHandle & h) { return h.Done(); }), handles_.end());
+        auto ret = status_;
+        status_ = Status::SUCCESS;
+        return ret;
+    }
+
+    /// Cancel all the tasks that haven't been started yet, returns the
+    /// number of cancelled tasks
+    auto Cancel() -> size_t {
+        std::lock_guard<std::mutex> latch{mutex_};
+        size_t cancelled = 0;
+        for (auto & handle : handles_) {
+            if (handle.Cancel()) {
+                cancelled++;
+            }
+        }
+        return cancelled;
+    }
+
+private:
+    /// Keep the first failure, called with the mutex held
+    void recordStatus(Status s) {
+        if (s != Status::SUCCESS && status_ == Status::SUCCESS) {
+            status_ = s;
+        }
+    }
+
+    std::vector<TaskHandle> handles_;
+    std::mutex mutex_;
+
+    /// First failure of the handles dropped since the last |Wait|
+    Status status_ = Status::SUCCESS;
 };
 
 class Worker {
@@ -46,8 +277,10 @@ public:
     explicit Worker()
         : task_queue_(std::queue<std::unique_ptr<Task>>{}),
           closed_(false),
-          pending_task_(0),
-          thread_(new std::thread([](Worker * w) { w->Run(); }, this)) {}
+          pending_task_(0) {
+        /// start the thread after all the members are initialized
+        thread_ = new std::thread([](Worker * w) { w->Run(); }, this);
+    }
 
     ~Worker() {
         delete thread_;
@@ -72,17 +305,7 @@ public:
             task_queue_.pop();
             latch.unlock();
 
-            std::cout << "PreExecuting a Task" << std::endl;
-            task->PreExecute();
-            std::cout << "Running a Task" << std::endl;
-            auto s = task->Execute();
-            if (s != Status::SUCCESS) {
-                std::cerr << "Task failed" << std::endl;
-                assert(false);
-            }
-            std::cout << "PostExecuting a Task" << std::endl;
-            task->PostExecute();
-            std::cout << "Finished a Task" << std::endl;
+            runTask(task.get());
 
             std::lock_guard<std::mutex> platch{ pending_mutex_ };
             pending_task_--;
@@ -90,6 +313,13 @@ public:
                 task_finished_cv_.notify_all();
             }
         }
+
+        /// resolve the handles of the tasks that will never run
+        std::lock_guard<std::mutex> latch{ task_queue_mutex_ };
+        while (!task_queue_.empty()) {
+            task_queue_.front()->context_->TryCancel();
+            task_queue_.pop();
+        }
     }
 
     void Stop() {
@@ -113,12 +343,36 @@ public:
 
     void PushTask(std::unique_ptr<Task> && task) {
         std::lock_guard<std::mutex> latch{task_queue_mutex_};
+        if (closed_.load()) {
+            task->context_->TryCancel();
+            return;
+        }
         std::lock_guard<std::mutex> platch{pending_mutex_};
         task_queue_.push(std::move(task));
         pending_task_++;
         task_queue_cv_.notify_one();
     }
 private:
+    static void runTask(Task * task) {
+        /// cancelled while waiting in the queue
+        if (!task->context_->TryStart()) {
+            return;
+        }
+        /// a cancelled dependency cancels the task, a failed one fails it,
+        /// as its outputs are missing either way
+        if (auto s = task->WaitDependencies(); s != Status::SUCCESS) {
+            task->context_->Finish(s == Status::CANCELLED ? Status::CANCELLED : Status::ERROR);
+            return;
+        }
+
+        task->PreExecute();
+        auto s = task->Execute();
+        if (s == Status::SUCCESS) {
+            task->PostExecute();
+        }
+        task->context_->Finish(s);
+    }
+
     //std::queue<std::function<void()>> task_queue_;
     std::queue<std::unique_ptr<Task>> task_queue_;
     std::mutex task_queue_mutex_;
@@ -142,8 +396,10 @@ public:
         current_idx_ = 0;
     }
 
-    auto ScheduleTask(std::unique_ptr<Task> && task) {
+    auto ScheduleTask(std::unique_ptr<Task> && task) -> TaskHandle {
+        auto handle = task->GetHandle();
         FetchWorker()->PushTask(std::move(task));
+        return handle;
     }
 
     auto Wait() {
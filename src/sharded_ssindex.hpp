@@ -0,0 +1,146 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <filesystem>
+
+#include "ssindex.hpp"
+
+namespace ssindex {
+
+/// Sharded Space-Saving Index
+///
+/// |ShardedSsIndex| hashes keys to |shard_num| independent |SsIndex|es, each
+/// of them has its own memtable, batch holder and directory, so writes to
+/// different shards don't contend on the same mutex. All the shards share
+/// one task scheduler, and the memtable budget of a single index is split
+/// among them, so that the memory footprint doesn't grow with the number
+/// of shards.
+///
+/// Shards are chosen by the high half of the key hash, while partitions
+/// within a shard are chosen by the low bits, so every shard still uses
+/// all of its partitions.
+template<typename KeyType, typename ValueType>
+class ShardedSsIndex {
+public:
+    ValueType key_not_found = IndexUtils<ValueType>::KeyNotFound();
+
+    explicit ShardedSsIndex(const std::string & directory,
+                            size_t shard_num,
+                            size_t worker_num = std::thread::hardware_concurrency(),
+                            size_t memtable_budget = MemtableFlushThreshold,
+                            WriteControllerOptions write_options = WriteControllerOptions{})
+        : shard_num_(shard_num == 0 ? 1 : shard_num),
+          scheduler_(new Scheduler(worker_num == 0 ? 1 : worker_num)) {
+        std::filesystem::create_directory(directory);
+        for (size_t i = 0; i < shard_num_; ++i) {
+            auto shard_directory = (std::filesystem::path(directory) / ("shard_" + std::to_string(i))).string();
+            shards_.emplace_back(std::make_unique<SsIndex<KeyType, ValueType>>(shard_directory, write_options, scheduler_));
+            shards_.back()->SetMemtableFlushThreshold(memtable_budget / shard_num_);
+        }
+    }
+
+    ~ShardedSsIndex() {
+        /// shards wait for their own tasks, so they go before the scheduler
+        shards_.clear();
+        scheduler_->Stop();
+        delete scheduler_;
+    }
+
+    void Set(const KeyType & key, const ValueType & value) {
+        shards_[GetShard(key)]->Set(key, value);
+    }
+
+    auto Get(const KeyType & key, Status * status = nullptr) -> ValueType {
+        return shards_[GetShard(key)]->Get(key, status);
+    }
+
+    /// |status|, if given, is set to the first error of the shards
+    auto MultiGet(const std::vector<KeyType> & keys, Status * status = nullptr) -> std::vector<ValueType> {
+        if (status != nullptr) {
+            *status = Status::SUCCESS;
+        }
+        std::vector<std::vector<size_t>> indexes(shard_num_);
+        std::vector<std::vector<KeyType>> shard_keys(shard_num_);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto shard = GetShard(keys[i]);
+            indexes[shard].emplace_back(i);
+            shard_keys[shard].emplace_back(keys[i]);
+        }
+        std::vector<ValueType> values(keys.size(), key_not_found);
+        for (size_t shard = 0; shard < shard_num_; ++shard) {
+            if (shard_keys[shard].empty()) {
+                continue;
+            }
+            Status s = Status::SUCCESS;
+            auto shard_values = shards_[shard]->MultiGet(shard_keys[shard], &s);
+            if (s != Status::SUCCESS && status != nullptr && *status == Status::SUCCESS) {
+                *status = s;
+            }
+            for (size_t j = 0; j < shard_values.size(); ++j) {
+                values[indexes[shard][j]] = shard_values[j];
+            }
+        }
+        return values;
+    }
+
+    /// Optimize all the shards concurrently
+    void Optimize() {
+        std::vector<std::thread> threads{};
+        for (auto & shard : shards_) {
+            auto * ptr = shard.get();
+            threads.emplace_back([ptr] { ptr->Optimize(); });
+        }
+        for (auto & thread : threads) {
+            thread.join();
+        }
+    }
+
+    void WaitTaskComplete() {
+        for (auto & shard : shards_) {
+            shard->WaitTaskComplete();
+        }
+    }
+
+    auto GetUsage() -> uint64_t {
+        uint64_t sum = 0;
+        for (auto & shard : shards_) {
+            sum += shard->GetUsage();
+        }
+        return sum;
+    }
+
+    auto GetWriteStallStats() -> WriteStallStats {
+        WriteStallStats sum{};
+        for (auto & shard : shards_) {
+            auto stats = shard->GetWriteStallStats();
+            sum.stall_micros_ += stats.stall_micros_;
+            sum.stall_count_ += stats.stall_count_;
+            sum.delay_micros_ += stats.delay_micros_;
+            sum.delay_count_ += stats.delay_count_;
+        }
+        return sum;
+    }
+
+    auto GetShard(const KeyType & key) const -> size_t {
+        size_t len = 0;
+        auto buf = IndexUtils<KeyType>::RawBuffer(key, &len);
+        return static_cast<size_t>((HASH(buf.get(), len) >> 32) % shard_num_);
+    }
+
+    auto GetShardNum() const -> size_t {
+        return shard_num_;
+    }
+
+private:
+    size_t shard_num_;
+
+    /// Task scheduler shared by all the shards
+    Scheduler * scheduler_;
+
+    std::vector<std::unique_ptr<SsIndex<KeyType, ValueType>>> shards_;
+};
+
+}  // namespace ssindex
@@ -0,0 +1,191 @@
+#include "simd_kernels.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace ssindex {
+
+static_assert(NumHashFunctions == 3, "decode kernels assume 3-wise hashing");
+
+namespace {
+
+inline auto fieldMask(uint64_t len) -> uint64_t {
+    return len >= 64 ? ~0LLU : (1LLU << len) - 1;
+}
+
+inline auto readField(const SlotField & field, uint64_t vertex) -> uint64_t {
+    uint64_t pos = vertex * field.stride_ + field.base_;
+    uint64_t index = pos / 64;
+    uint64_t offset = pos % 64;
+    uint64_t bits = field.words_[index] >> offset;
+    if (offset != 0) {
+        bits |= field.words_[index + 1] << (64 - offset);
+    }
+    return bits & fieldMask(field.len_);
+}
+
+}  // namespace
+
+void DecodeSlotsScalar(const DecodeParams & params, const uint64_t * vertices, const uint64_t * signatures, uint64_t * values) {
+    for (size_t k = 0; k < DecodeBatchSize; ++k) {
+        if (params.fp_.len_ != 0) {
+            uint64_t fp = 0;
+            for (size_t i = 0; i < NumHashFunctions; ++i) {
+                fp ^= readField(params.fp_, vertices[i * DecodeBatchSize + k]);
+            }
+            if (fp != signatures[k]) {
+                values[k] = params.not_found_;
+                continue;
+            }
+        }
+        uint64_t value = 0;
+        for (size_t i = 0; i < NumHashFunctions; ++i) {
+            value ^= readField(params.value_, vertices[i * DecodeBatchSize + k]);
+        }
+        values[k] = value > params.max_value_ ? params.not_found_ : value + params.min_value_;
+    }
+}
+
+#if defined(__x86_64__)
+
+namespace {
+
+/// vertices and strides are below 2^32, so a 32x32 multiply is enough
+__attribute__((target("avx2")))
+inline auto readFieldAvx2(const SlotField & field, __m256i vertex) -> __m256i {
+    auto pos = _mm256_add_epi64(_mm256_mul_epu32(vertex, _mm256_set1_epi64x(static_cast<long long>(field.stride_))),
+                                _mm256_set1_epi64x(static_cast<long long>(field.base_)));
+    auto index = _mm256_srli_epi64(pos, 6);
+    auto offset = _mm256_and_si256(pos, _mm256_set1_epi64x(63));
+    auto words = reinterpret_cast<const long long *>(field.words_);
+    auto lo = _mm256_i64gather_epi64(words, index, 8);
+    auto hi = _mm256_i64gather_epi64(words, _mm256_add_epi64(index, _mm256_set1_epi64x(1)), 8);
+    /// a shift by 64 yields 0, so an aligned field takes nothing from |hi|
+    auto bits = _mm256_or_si256(_mm256_srlv_epi64(lo, offset),
+                                _mm256_sllv_epi64(hi, _mm256_sub_epi64(_mm256_set1_epi64x(64), offset)));
+    return _mm256_and_si256(bits, _mm256_set1_epi64x(static_cast<long long>(fieldMask(field.len_))));
+}
+
+__attribute__((target("avx512f")))
+inline auto readFieldAvx512(const SlotField & field, __m512i vertex) -> __m512i {
+    auto pos = _mm512_add_epi64(_mm512_mul_epu32(vertex, _mm512_set1_epi64(static_cast<long long>(field.stride_))),
+                                _mm512_set1_epi64(static_cast<long long>(field.base_)));
+    auto index = _mm512_srli_epi64(pos, 6);
+    auto offset = _mm512_and_si512(pos, _mm512_set1_epi64(63));
+    auto lo = _mm512_i64gather_epi64(index, field.words_, 8);
+    auto hi = _mm512_i64gather_epi64(_mm512_add_epi64(index, _mm512_set1_epi64(1)), field.words_, 8);
+    auto bits = _mm512_or_si512(_mm512_srlv_epi64(lo, offset),
+                                _mm512_sllv_epi64(hi, _mm512_sub_epi64(_mm512_set1_epi64(64), offset)));
+    return _mm512_and_si512(bits, _mm512_set1_epi64(static_cast<long long>(fieldMask(field.len_))));
+}
+
+}  // namespace
+
+__attribute__((target("avx2")))
+void DecodeSlotsAvx2(const DecodeParams & params, const uint64_t * vertices, const uint64_t * signatures, uint64_t * values) {
+    constexpr size_t lanes = 4;
+    /// unsigned comparison through the signed one
+    const auto sign = _mm256_set1_epi64x(static_cast<long long>(1LLU << 63));
+    const auto max_value = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(params.max_value_)), sign);
+    const auto min_value = _mm256_set1_epi64x(static_cast<long long>(params.min_value_));
+    const auto not_found = _mm256_set1_epi64x(static_cast<long long>(params.not_found_));
+    for (size_t k = 0; k < DecodeBatchSize; k += lanes) {
+        auto value = _mm256_setzero_si256();
+        auto fp = _mm256_setzero_si256();
+        for (size_t i = 0; i < NumHashFunctions; ++i) {
+            auto vertex = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(vertices + i * DecodeBatchSize + k));
+            value = _mm256_xor_si256(value, readFieldAvx2(params.value_, vertex));
+            if (params.fp_.len_ != 0) {
+                fp = _mm256_xor_si256(fp, readFieldAvx2(params.fp_, vertex));
+            }
+        }
+        auto accepted = _mm256_set1_epi64x(-1);
+        if (params.fp_.len_ != 0) {
+            accepted = _mm256_cmpeq_epi64(fp, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(signatures + k)));
+        }
+        auto overflow = _mm256_cmpgt_epi64(_mm256_xor_si256(value, sign), max_value);
+        accepted = _mm256_andnot_si256(overflow, accepted);
+        auto result = _mm256_blendv_epi8(not_found, _mm256_add_epi64(value, min_value), accepted);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(values + k), result);
+    }
+}
+
+__attribute__((target("avx512f")))
+void DecodeSlotsAvx512(const DecodeParams & params, const uint64_t * vertices, const uint64_t * signatures, uint64_t * values) {
+    static_assert(DecodeBatchSize == 8, "one AVX-512 register per batch");
+    auto value = _mm512_setzero_si512();
+    auto fp = _mm512_setzero_si512();
+    for (size_t i = 0; i < NumHashFunctions; ++i) {
+        auto vertex = _mm512_loadu_si512(vertices + i * DecodeBatchSize);
+        value = _mm512_xor_si512(value, readFieldAvx512(params.value_, vertex));
+        if (params.fp_.len_ != 0) {
+            fp = _mm512_xor_si512(fp, readFieldAvx512(params.fp_, vertex));
+        }
+    }
+    __mmask8 accepted = 0xFF;
+    if (params.fp_.len_ != 0) {
+        accepted = _mm512_cmpeq_epu64_mask(fp, _mm512_loadu_si512(signatures));
+    }
+    accepted &= _mm512_cmple_epu64_mask(value, _mm512_set1_epi64(static_cast<long long>(params.max_value_)));
+    auto result = _mm512_mask_blend_epi64(accepted,
+                                          _mm512_set1_epi64(static_cast<long long>(params.not_found_)),
+                                          _mm512_add_epi64(value, _mm512_set1_epi64(static_cast<long long>(params.min_value_))));
+    _mm512_storeu_si512(values, result);
+}
+
+auto SupportsAvx2() -> bool {
+    return __builtin_cpu_supports("avx2");
+}
+
+auto SupportsAvx512() -> bool {
+    return __builtin_cpu_supports("avx512f");
+}
+
+#else
+
+auto SupportsAvx2() -> bool {
+    return false;
+}
+
+auto SupportsAvx512() -> bool {
+    return false;
+}
+
+#endif
+
+namespace {
+
+struct KernelEntry {
+    DecodeSlotsFn kernel_;
+    const char * name_;
+};
+
+auto selectKernel() -> KernelEntry {
+#if defined(__x86_64__)
+    if (SupportsAvx512()) {
+        return {DecodeSlotsAvx512, "avx512"};
+    }
+    if (SupportsAvx2()) {
+        return {DecodeSlotsAvx2, "avx2"};
+    }
+#endif
+    return {DecodeSlotsScalar, "scalar"};
+}
+
+auto selectedKernel() -> const KernelEntry & {
+    static const KernelEntry entry = selectKernel();
+    return entry;
+}
+
+}  // namespace
+
+auto GetDecodeSlotsKernel() -> DecodeSlotsFn {
+    return selectedKernel().kernel_;
+}
+
+auto GetDecodeSlotsKernelName() -> const char * {
+    return selectedKernel().name_;
+}
+
+}  // namespace ssindex
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "index_common.hpp"
+
+namespace ssindex {
+
+/// Number of keys decoded by one call of a |DecodeSlotsFn|
+static constexpr size_t DecodeBatchSize = 8;
+
+/// A field stored in every slot of a bit array, the field of vertex |t|
+/// starts at bit |t * stride_ + base_| of |words_|. The words must be
+/// padded by one word, see |BitVec::Resize|.
+struct SlotField {
+    const uint64_t * words_ = nullptr;
+    uint64_t stride_ = 0;
+    uint64_t base_ = 0;
+    /// Bits of the field, in [0, 64], 0 means the field doesn't exist
+    uint64_t len_ = 0;
+};
+
+struct DecodeParams {
+    SlotField fp_;
+    SlotField value_;
+    uint64_t min_value_ = 0;
+    uint64_t max_value_ = 0;
+    uint64_t not_found_ = 0;
+};
+
+/// Decode |DecodeBatchSize| keys of a block. |vertices| holds the vertex
+/// indices of the keys, hash-major (i.e. |vertices[i * DecodeBatchSize + k]|
+/// is the i-th vertex of the k-th key), and |signatures| the expected
+/// fingerprints. For each key, the fields of its vertices are xor-ed, the
+/// fingerprint is checked, and the value or |not_found_| is written out.
+///
+/// Vertex indices must be less than 2^32.
+using DecodeSlotsFn = void (*)(const DecodeParams & params,
+                               const uint64_t * vertices,
+                               const uint64_t * signatures,
+                               uint64_t * values);
+
+void DecodeSlotsScalar(const DecodeParams & params, const uint64_t * vertices, const uint64_t * signatures, uint64_t * values);
+
+#if defined(__x86_64__)
+void DecodeSlotsAvx2(const DecodeParams & params, const uint64_t * vertices, const uint64_t * signatures, uint64_t * values);
+
+void DecodeSlotsAvx512(const DecodeParams & params, const uint64_t * vertices, const uint64_t * signatures, uint64_t * values);
+#endif
+
+auto SupportsAvx2() -> bool;
+
+auto SupportsAvx512() -> bool;
+
+/// The fastest kernel supported by the running CPU, it's detected once
+auto GetDecodeSlotsKernel() -> DecodeSlotsFn;
+
+auto GetDecodeSlotsKernelName() -> const char *;
+
+}  // namespace ssindex
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ssindex.hpp"
+
+namespace ssindex {
+
+/// Space-Saving Filter
+///
+/// |SsFilter| answers approximate membership queries: |MayContain| is true
+/// for every inserted key, and true for a key never inserted with a
+/// probability of about 2^-fp_bits per batch it's probed against.
+///
+/// It's an |SsIndex| whose values are all the same, so the memtables,
+/// flushes, compactions and batches are those of the index, while its
+/// blocks store no value bits and hold the fingerprints only (see
+/// |IndexBlock::TryBuild|). A key costs about 1.3 * fp_bits bits.
+template<typename KeyType>
+class SsFilter {
+public:
+    explicit SsFilter(std::string directory,
+                      uint64_t fp_bits = DefaultFilterFpBits,
+                      WriteControllerOptions write_options = WriteControllerOptions{},
+                      Scheduler * scheduler = nullptr)
+        : index_(std::move(directory), write_options, scheduler) {
+        /// without fingerprints, every key would be a member
+        fp_bits = fp_bits == 0 ? 1 : fp_bits;
+        index_.SetFpBits(fp_bits, fp_bits);
+    }
+
+    void Insert(const KeyType & key) {
+        index_.Set(key, Member);
+    }
+
+    auto MayContain(const KeyType & key) -> bool {
+        return index_.Get(key) != index_.key_not_found;
+    }
+
+    /// Batched |MayContain|
+    auto MayContain(const std::vector<KeyType> & keys) -> std::vector<bool> {
+        auto values = index_.MultiGet(keys);
+        std::vector<bool> result(values.size());
+        for (size_t i = 0; i < values.size(); ++i) {
+            result[i] = values[i] != index_.key_not_found;
+        }
+        return result;
+    }
+
+    /// Number of entries of the memtable to trigger a flush
+    void SetMemtableFlushThreshold(size_t threshold) {
+        index_.SetMemtableFlushThreshold(threshold);
+    }
+
+    void Optimize() {
+        index_.Optimize();
+    }
+
+    void WaitTaskComplete() {
+        index_.WaitTaskComplete();
+    }
+
+    auto GetUsage() -> uint64_t {
+        return index_.GetUsage();
+    }
+
+private:
+    /// Value of all the keys
+    static constexpr uint8_t Member = 0;
+
+    SsIndex<KeyType, uint8_t> index_;
+};
+
+}  // namespace ssindex
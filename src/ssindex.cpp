@@ -2,104 +2,304 @@
 #include "index_common.hpp"
 #include "task_flush_memtable.hpp"
 #include "task_compaction.hpp"
+#include "task_build_locator.hpp"
+#include "task_evict_blocks.hpp"
+#include "bulk_loader.hpp"
 
 namespace ssindex {
 
 template<typename KeyType, typename ValueType>
 void SsIndex<KeyType, ValueType>::Set(const KeyType & key, const ValueType & value) {
+    auto hash = IndexUtils<KeyType>::Hash(key);
+    write_controller_.MaybeThrottle();
     std::lock_guard<std::shared_mutex> w_latch{memtable_mutex_};
-    memtable_.data_->insert_or_assign(key, value);
-    if (memtable_.data_->size() == MemtableFlushThreshold) {
-        /// schedule a flush task and reset the memtable
-        std::lock_guard<std::shared_mutex> q_r_latch{waiting_queue_mutex_};
-        waiting_queue_.emplace_back(std::move(memtable_));
-        memtable_.id_ = FetchMemtableId();
-        memtable_.data_ = std::make_shared<std::unordered_map<KeyType, ValueType>>();
-        std::cout << "Enqueue Immutable | Current Size: " << waiting_queue_.size() << std::endl;
-        auto partitioner = [this](const KeyType & key) -> uint64_t {
-            size_t len = 0;
-            auto buf = IndexUtils<KeyType>::RawBuffer(key, &len);
-            return GetBlockPartition(buf.get(), len);
-        };
+    insertIntoMemtable(key, value, hash);
+}
 
-        auto task = std::make_unique<FlushMemtableTask<KeyType, ValueType>>(*waiting_queue_.back().data_, waiting_queue_.back().id_, partition_num_, partitioner, seed_, fp_bits_);
-        auto task_id = task->memtable_id_;
-        auto pre = [task_id]() {
-            std::cout << "Start flushing memtable, id: " << task_id << std::endl;
-        };
-        //auto memtable_id = task->memtable_id_;
-        auto * raw_ptr = task.get();
-        auto updateIndex = [this, raw_ptr]() {
-            std::lock_guard<std::shared_mutex> q_w_latch{waiting_queue_mutex_};
-            for (auto iter = waiting_queue_.begin(); iter != waiting_queue_.end(); iter++) {
-                if (iter->id_ == raw_ptr->memtable_id_) {
-                    waiting_queue_.erase(iter);
-                    break;
-                }
-            }
+template<typename KeyType, typename ValueType>
+void SsIndex<KeyType, ValueType>::Write(const WriteBatch<KeyType, ValueType> & batch) {
+    if (batch.Empty()) {
+        return;
+    }
+    write_controller_.MaybeThrottle();
+    std::unique_lock<std::shared_mutex> w_latch{memtable_mutex_};
+    for (auto & entry : batch.Entries()) {
+        /// the memtable may rotate in the middle of the batch, the rest of
+        /// the entries go to the new one once the flushes allow it, as
+        /// if they were written by a new batch
+        if (insertIntoMemtable(entry.key_, entry.value_, entry.hash_)) {
+            w_latch.unlock();
+            write_controller_.MaybeThrottle();
+            w_latch.lock();
+        }
+    }
+}
 
-            std::lock_guard<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
-            batch_holder_.AppendBatch(std::move(raw_ptr->file_handle_), std::move(raw_ptr->blocks_));
-
-            /// schedule a compaction task if needed
-            /// TODO: should we always check the compaction prerequisite?
-            uint64_t start = 0;
-            size_t count = 0;
-            std::vector<typename BatchItem<KeyType, ValueType>::Batch> candidates{};
-            auto need_compaction = batch_holder_.FindCompactionCandidates(&start, &count, candidates);
-            //need_compaction = false; /// turn off compaction
-            if (need_compaction) {
-                auto task = std::make_unique<CompactionTask<KeyType, ValueType>>(candidates, partition_num_);
-                auto pre = []() {
-                    std::cout << "Start Compaction" << std::endl;
-                };
-                auto * raw_ptr_ = task.get();
-                auto updateIndex = [this, raw_ptr_, start, count]() {
-                    std::lock_guard<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
-                    batch_holder_.CommitCompaction(start, count, std::move(raw_ptr_->file_handle_), std::move(raw_ptr_->blocks_));
-
-                    std::cout << "Compaction Finished" << std::endl;
-                };
-                task->SetPreExecute(pre);
-                task->SetPostExecute(updateIndex);
-                scheduler_->ScheduleTask(std::move(task));
-            }
+template<typename KeyType, typename ValueType>
+auto SsIndex<KeyType, ValueType>::insertIntoMemtable(const KeyType & key, const ValueType & value, uint64_t hash) -> bool {
+    auto [iter, inserted] = memtable_.data_->Insert(hash % partition_num_, key, value);
+    if (inserted) {
+        memtable_.filter_->Add(hash);
+    } else {
+        if (drop_listener_) {
+            drop_listener_(*iter);
+        }
+        iter->second = value;
+    }
+    if (read_cache_ != nullptr) {
+        read_cache_->Erase(key);
+    }
+    if (memtable_.data_->Size() >= memtable_flush_threshold_) {
+        scheduleFlush();
+        return true;
+    }
+    return false;
+}
+
+template<typename KeyType, typename ValueType>
+auto SsIndex<KeyType, ValueType>::scheduleFlush() -> TaskHandle {
+    /// schedule a flush task and reset the memtable
+    std::lock_guard<std::shared_mutex> q_r_latch{waiting_queue_mutex_};
+    waiting_queue_.emplace_back(std::move(memtable_));
+    memtable_.id_ = FetchMemtableId();
+    memtable_.data_ = std::make_shared<PartitionedMemtable<KeyType, ValueType>>(partition_num_);
+    memtable_.filter_ = std::make_shared<MemtableFilter>(memtable_flush_threshold_);
+    std::cout << "Enqueue Immutable | Current Size: " << waiting_queue_.size() << std::endl;
+    write_controller_.SetImmutableNum(waiting_queue_.size());
+
+    /// the memtables whose flush failed past the retries go first, the
+    /// newer batches are held back until they're published anyway
+    for (auto & immutable : failed_flushes_) {
+        scheduleFlushTask(immutable, 0);
+    }
+    failed_flushes_.clear();
+    return scheduleFlushTask(waiting_queue_.back(), 0);
+}
 
-            std::cout << "Flush Memtable Finished" << std::endl;
+template<typename KeyType, typename ValueType>
+auto SsIndex<KeyType, ValueType>::scheduleFlushTask(const Memtable & immutable, size_t attempt) -> TaskHandle {
+    auto task = std::make_unique<FlushMemtableTask<KeyType, ValueType>>(immutable.data_, immutable.id_, seed_, fp_bits_, working_directory_);
+    auto task_id = task->memtable_id_;
+    auto pre = [task_id]() {
+        std::cout << "Start flushing memtable, id: " << task_id << std::endl;
+    };
+    auto * raw_ptr = task.get();
+    auto updateIndex = [this, raw_ptr]() {
+        publishFlush(raw_ptr->memtable_id_, std::move(raw_ptr->file_handle_), std::move(raw_ptr->blocks_));
+    };
+    task->SetPreExecute(pre);
+    task->SetPostExecute(updateIndex);
+    /// a failed flush is retried, then left to the next rotation, and its
+    /// memtable stays readable in |waiting_queue_| meanwhile
+    task->SetOnFinish([this, immutable, attempt](Status s) {
+        if (s == Status::SUCCESS || s == Status::CANCELLED) {
+            return;
+        }
+        if (attempt < FlushRetryNum) {
+            std::cerr << "Cannot flush memtable, retrying | " << immutable.id_ << std::endl;
+            scheduleFlushTask(immutable, attempt + 1);
+            return;
+        }
+        std::cerr << "Cannot flush memtable, waiting for the next rotation | " << immutable.id_ << std::endl;
+        std::lock_guard<std::shared_mutex> q_w_latch{waiting_queue_mutex_};
+        failed_flushes_.emplace_back(immutable);
+    });
+    auto handle = scheduler_->ScheduleTask(std::move(task));
+    flush_tasks_.Add(handle);
+    return handle;
+}
+
+template<typename KeyType, typename ValueType>
+void SsIndex<KeyType, ValueType>::publishFlush(uint64_t memtable_id,
+                                               typename BatchHolder<KeyType, ValueType>::FileHandlePtr file,
+                                               typename BatchHolder<KeyType, ValueType>::Blocks blocks) {
+    std::unique_lock<std::shared_mutex> q_w_latch{waiting_queue_mutex_};
+    flushed_batches_.emplace(memtable_id, std::make_pair(std::move(blocks), std::move(file)));
+
+    /// batches are published in the order of memtable rotation, so a batch
+    /// flushed ahead of an older memtable waits for it, and the memtable
+    /// keeps serving its keys until then
+    std::unique_lock<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
+    bool published = false;
+    while (!waiting_queue_.empty()) {
+        auto iter = flushed_batches_.find(waiting_queue_.front().id_);
+        if (iter == flushed_batches_.end()) {
+            break;
+        }
+        batch_holder_.AppendBatch(iter->second.second, iter->second.first);
+        trackBatch(batch_holder_.next_id_ - 1);
+        flushed_batches_.erase(iter);
+        waiting_queue_.erase(waiting_queue_.begin());
+        published = true;
+    }
+    write_controller_.SetImmutableNum(waiting_queue_.size());
+    if (!published) {
+        std::cout << "Flush Memtable Finished, waiting for the older ones | " << memtable_id << std::endl;
+        return;
+    }
+    write_controller_.SetBatchNum(batch_holder_.items_.size());
+    invalidateReadCache();
+    maybeScheduleLocatorBuild();
+
+    /// schedule a compaction task if needed
+    /// TODO: should we always check the compaction prerequisite?
+    uint64_t start = 0;
+    size_t count = 0;
+    std::vector<typename BatchItem<KeyType, ValueType>::Batch> candidates{};
+    auto need_compaction = batch_holder_.FindCompactionCandidates(&start, &count, candidates);
+    //need_compaction = false; /// turn off compaction
+    if (need_compaction) {
+        uint64_t input_bytes = 0;
+        for (auto & candidate : candidates) {
+            input_bytes += candidate.second->GetDataSize();
+        }
+        write_controller_.AddPendingCompactionBytes(input_bytes);
+
+        auto task = std::make_unique<CompactionTask<KeyType, ValueType>>(candidates, seed_, compaction_fp_bits_, working_directory_);
+        task->SetDropListener(drop_listener_);
+        auto pre = []() {
+            std::cout << "Start Compaction" << std::endl;
+        };
+        auto * raw_ptr_ = task.get();
+        auto updateIndex = [this, raw_ptr_, start, count]() {
+            std::unique_lock<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
+            commitCompaction(start, count, std::move(raw_ptr_->file_handle_), std::move(raw_ptr_->blocks_));
+            imm_w_latch.unlock();
+            enforceBlockBudget();
+
+            std::cout << "Compaction Finished" << std::endl;
         };
         task->SetPreExecute(pre);
         task->SetPostExecute(updateIndex);
-        scheduler_->ScheduleTask(std::move(task));
+        /// the backlog is gone once the compaction is committed, but
+        /// also once it has failed or been cancelled
+        task->SetOnFinish([this, input_bytes](Status) {
+            write_controller_.SubPendingCompactionBytes(input_bytes);
+        });
+        compaction_tasks_.Add(scheduler_->ScheduleTask(std::move(task)));
     }
+
+    std::cout << "Flush Memtable Finished" << std::endl;
+    imm_w_latch.unlock();
+    q_w_latch.unlock();
+    enforceBlockBudget();
 }
 
 template<typename KeyType, typename ValueType>
-auto SsIndex<KeyType, ValueType>::Get(const KeyType & key) -> ValueType {
+void SsIndex<KeyType, ValueType>::maybeScheduleEviction() {
+    if (!block_residency_->OverBudget() || eviction_scheduled_.exchange(true)) {
+        return;
+    }
+    auto task = std::make_unique<EvictBlocksTask<ValueType>>(block_residency_.get(), &batch_holder_mutex_);
+    /// the blocks faulted in once it's started are left to the next one
+    task->SetPreExecute([this]() {
+        eviction_scheduled_.store(false);
+    });
+    eviction_tasks_.Add(scheduler_->ScheduleTask(std::move(task)));
+}
+
+template<typename KeyType, typename ValueType>
+auto SsIndex<KeyType, ValueType>::Get(const KeyType & key, Status * status) -> ValueType {
+    if (read_cache_ == nullptr) {
+        return GetIf(key, nullptr, status);
+    }
+    ValueType value;
+    if (read_cache_->Lookup(key, &value)) {
+        if (status != nullptr) {
+            *status = Status::SUCCESS;
+        }
+        return value;
+    }
+    auto ticket = read_cache_->GetTicket(key);
+    Status s = Status::SUCCESS;
+    value = GetIf(key, nullptr, &s);
+    /// a failed read is not an answer
+    if (s == Status::SUCCESS) {
+        read_cache_->Insert(key, value, ticket);
+    }
+    if (status != nullptr) {
+        *status = s;
+    }
+    return value;
+}
+
+template<typename KeyType, typename ValueType>
+auto SsIndex<KeyType, ValueType>::getFromMemtables(const KeyType & key, uint64_t hash, ValueType * value) -> bool {
+    uint64_t partition = hash % partition_num_;
     std::shared_lock<std::shared_mutex> mem_r_latch{memtable_mutex_};
-    if (auto iter = memtable_.data_->find(key); iter != memtable_.data_->end()) {
-        return iter->second;
+    if (memtable_.data_->Find(partition, key, value)) {
+        return true;
     }
     mem_r_latch.unlock();
 
+    /// the newest immutable memtable holds the newest version
     std::shared_lock<std::shared_mutex> q_r_latch{waiting_queue_mutex_};
-    for (auto & imm : waiting_queue_) {
-        if (auto iter = imm.data_->find(key); iter != imm.data_->end()) {
-            return iter->second;
+    for (auto imm = waiting_queue_.rbegin(); imm != waiting_queue_.rend(); imm++) {
+        if (imm->filter_->MayContain(hash) && imm->data_->Find(partition, key, value)) {
+            return true;
         }
     }
-    q_r_latch.unlock();
+    return false;
+}
+
+template<typename KeyType, typename ValueType>
+auto SsIndex<KeyType, ValueType>::GetIf(const KeyType & key, const std::function<bool(const ValueType &)> & accept, Status * status) -> ValueType {
+    Status s = Status::SUCCESS;
+    if (status == nullptr) {
+        status = &s;
+    }
+    *status = Status::SUCCESS;
+    /// hashed once for the memtables, the filters and the blocks
+    auto hash = IndexUtils<KeyType>::Hash(key);
+    if (ValueType value; getFromMemtables(key, hash, &value)) {
+        return value;
+    }
 
     size_t key_buf_len = 0;
     auto buf = IndexUtils<KeyType>::RawBuffer(key, &key_buf_len);
-    uint64_t partition = GetBlockPartition(buf.get(), key_buf_len);
-    assert(partition >= 0 && partition < partition_num_);
-    IndexEdge<ValueType> ie{buf.get(), key_buf_len, 0, seed_};
+    uint64_t ie_seed = seed_;
+    IndexEdge<ValueType> ie{buf.get(), key_buf_len, 0, ie_seed};
+    auto probe = [&](const BatchItem<KeyType, ValueType> & item) -> ValueType {
+        /// each batch has its own number of partitions
+        auto & blocks = item.data_.first;
+        uint64_t partition = hash % blocks.size();
+        if ((*status = acquireBlock(item.id_, partition)) != Status::SUCCESS) {
+            return key_not_found;
+        }
+        auto & block = blocks.at(partition);
+        /// the block may have been built with a retried seed
+        if (block.GetSeed() != ie_seed) {
+            ie_seed = block.GetSeed();
+            ie = IndexEdge<ValueType>{buf.get(), key_buf_len, 0, ie_seed};
+        }
+        return block.GetValue(ie);
+    };
 
     std::shared_lock<std::shared_mutex> imm_r_latch{batch_holder_mutex_};
     for (auto iter = batch_holder_.rbegin(); iter != batch_holder_.rend(); iter++) {
-        assert(iter->data_.first.size() == partition_num_);
-        auto ret = iter->data_.first.at(partition).GetValue(ie);
-        if (ret != key_not_found) {
+        if (locator_ != nullptr && locator_->IsCovered(iter->id_)) {
+            /// this batch and all the older ones are covered by the locator,
+            /// only the batch each segment gives has to be probed
+            for (size_t segment = 0; segment < locator_->GetSegmentNum(); ++segment) {
+                auto owner = batch_holder_.Find(locator_->Locate(segment, buf.get(), key_buf_len, hash));
+                if (owner == nullptr) {
+                    continue;
+                }
+                auto ret = probe(*owner);
+                if (*status != Status::SUCCESS) {
+                    return key_not_found;
+                }
+                if (ret != key_not_found && (!accept || accept(ret))) {
+                    return ret;
+                }
+            }
+            return key_not_found;
+        }
+        auto ret = probe(*iter);
+        if (*status != Status::SUCCESS) {
+            return key_not_found;
+        }
+        if (ret != key_not_found && (!accept || accept(ret))) {
             return ret;
         }
     }
@@ -108,59 +308,404 @@ auto SsIndex<KeyType, ValueType>::Get(const KeyType & key) -> ValueType {
 }
 
 template<typename KeyType, typename ValueType>
-void SsIndex<KeyType, ValueType>::Optimize() {
-    auto partitioner = [this](const KeyType & key) -> uint64_t {
-        size_t len = 0;
-        auto buf = IndexUtils<KeyType>::RawBuffer(key, &len);
-        return GetBlockPartition(buf.get(), len);
+auto SsIndex<KeyType, ValueType>::GetVerified(const KeyType & key, Status * status) -> ValueType {
+    Status s = Status::SUCCESS;
+    if (status == nullptr) {
+        status = &s;
+    }
+    *status = Status::SUCCESS;
+    /// hashed once for the memtables, the filters and the blocks
+    auto hash = IndexUtils<KeyType>::Hash(key);
+    if (ValueType value; getFromMemtables(key, hash, &value)) {
+        return value;
+    }
+
+    size_t key_buf_len = 0;
+    auto buf = IndexUtils<KeyType>::RawBuffer(key, &key_buf_len);
+    uint64_t ie_seed = seed_;
+    IndexEdge<ValueType> ie{buf.get(), key_buf_len, 0, ie_seed};
+    auto probe = [&](const BatchItem<KeyType, ValueType> & item) -> ValueType {
+        auto & blocks = item.data_.first;
+        uint64_t partition = hash % blocks.size();
+        if ((*status = acquireBlock(item.id_, partition)) != Status::SUCCESS) {
+            return key_not_found;
+        }
+        auto & block = blocks.at(partition);
+        if (block.GetSeed() != ie_seed) {
+            ie_seed = block.GetSeed();
+            ie = IndexEdge<ValueType>{buf.get(), key_buf_len, 0, ie_seed};
+        }
+        if (block.GetValue(ie) == key_not_found) {
+            return key_not_found;
+        }
+        ValueType value = key_not_found;
+        return item.data_.second->Lookup(partition, key, &value) == Status::SUCCESS ? value : key_not_found;
     };
 
-    auto task = std::make_unique<FlushMemtableTask<KeyType, ValueType>>(
-            *memtable_.data_,
-            memtable_.id_,
-            partition_num_,
-            partitioner,
-            seed_, fp_bits_);
+    std::shared_lock<std::shared_mutex> imm_r_latch{batch_holder_mutex_};
+    for (auto iter = batch_holder_.rbegin(); iter != batch_holder_.rend(); iter++) {
+        if (locator_ != nullptr && locator_->IsCovered(iter->id_)) {
+            /// the segment locating a key present in the batches is exact,
+            /// the others are rejected by the files
+            for (size_t segment = 0; segment < locator_->GetSegmentNum(); ++segment) {
+                auto owner = batch_holder_.Find(locator_->Locate(segment, buf.get(), key_buf_len, hash));
+                auto ret = owner == nullptr ? key_not_found : probe(*owner);
+                if (*status != Status::SUCCESS) {
+                    return key_not_found;
+                }
+                if (ret != key_not_found) {
+                    return ret;
+                }
+            }
+            return key_not_found;
+        }
+        auto ret = probe(*iter);
+        if (*status != Status::SUCCESS) {
+            return key_not_found;
+        }
+        if (ret != key_not_found) {
+            return ret;
+        }
+    }
 
-    auto * raw_ptr = task.get();
-    auto updateIndex = [this, raw_ptr]() {
-        memtable_ = std::move(Memtable{FetchMemtableId(), std::make_shared<std::unordered_map<KeyType, ValueType>>()});
+    return key_not_found;
+}
 
-        std::lock_guard<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
-        batch_holder_.AppendBatch(std::move(raw_ptr->file_handle_), std::move(raw_ptr->blocks_));
+template<typename KeyType, typename ValueType>
+auto SsIndex<KeyType, ValueType>::MultiGet(const std::vector<KeyType> & keys, Status * status) -> std::vector<ValueType> {
+    Status s = Status::SUCCESS;
+    if (status == nullptr) {
+        status = &s;
+    }
+    *status = Status::SUCCESS;
+    std::vector<ValueType> values(keys.size(), key_not_found);
+    /// hash the keys once, for the memtables, the filters and the blocks
+    std::vector<uint64_t> hashes(keys.size(), 0);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        hashes[i] = IndexUtils<KeyType>::Hash(keys[i]);
+    }
+    std::vector<size_t> pending{};
+    {
+        std::shared_lock<std::shared_mutex> mem_r_latch{memtable_mutex_};
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (!memtable_.data_->Find(hashes[i] % partition_num_, keys[i], &values[i])) {
+                pending.emplace_back(i);
+            }
+        }
+    }
+    {
+        std::shared_lock<std::shared_mutex> q_r_latch{waiting_queue_mutex_};
+        size_t remaining = 0;
+        for (auto i : pending) {
+            bool found = false;
+            for (auto imm = waiting_queue_.rbegin(); imm != waiting_queue_.rend(); imm++) {
+                if (imm->filter_->MayContain(hashes[i]) && imm->data_->Find(hashes[i] % partition_num_, keys[i], &values[i])) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                pending[remaining++] = i;
+            }
+        }
+        pending.resize(remaining);
+    }
+    if (pending.empty()) {
+        return values;
+    }
+
+    /// build the edges once
+    std::vector<std::unique_ptr<char[]>> bufs(keys.size());
+    std::vector<size_t> lens(keys.size(), 0);
+    std::vector<IndexEdge<ValueType>> edges(keys.size());
+    std::vector<uint64_t> edge_seeds(keys.size(), seed_);
+    for (auto i : pending) {
+        bufs[i] = IndexUtils<KeyType>::RawBuffer(keys[i], &lens[i]);
+        edges[i] = IndexEdge<ValueType>{bufs[i].get(), lens[i], 0, seed_};
+    }
+
+    /// probe a block with a group of keys, the keys not found are kept
+    std::vector<IndexEdge<ValueType>> probe_edges{};
+    std::vector<ValueType> probe_values{};
+    auto probe = [&](const IndexBlock<ValueType> & block, std::vector<size_t> & group) {
+        probe_edges.clear();
+        for (auto i : group) {
+            /// the block may have been built with a retried seed
+            if (edge_seeds[i] != block.GetSeed()) {
+                edge_seeds[i] = block.GetSeed();
+                edges[i] = IndexEdge<ValueType>{bufs[i].get(), lens[i], 0, edge_seeds[i]};
+            }
+            probe_edges.emplace_back(edges[i]);
+        }
+        probe_values.resize(group.size());
+        block.GetValues(probe_edges.data(), probe_edges.size(), probe_values.data());
+        size_t remaining = 0;
+        for (size_t j = 0; j < group.size(); ++j) {
+            if (probe_values[j] != key_not_found) {
+                values[group[j]] = probe_values[j];
+            } else {
+                group[remaining++] = group[j];
+            }
+        }
+        group.resize(remaining);
     };
-    task->SetPostExecute(updateIndex);
-    scheduler_->ScheduleTask(std::move(task));
 
-    /// wait all the running flush & compaction task to finish
-    scheduler_->Wait();
+    /// probe a batch with a group of keys, grouped by the partitions of
+    /// the batch, the keys not found are kept
+    std::vector<size_t> run{};
+    std::vector<size_t> missed{};
+    auto probeBatch = [&](const BatchItem<KeyType, ValueType> & item, std::vector<size_t> & group) {
+        auto & blocks = item.data_.first;
+        auto partitionOf = [&](size_t i) -> uint64_t {
+            return hashes[i] % blocks.size();
+        };
+        std::sort(group.begin(), group.end(), [&](size_t i, size_t j) {
+            return partitionOf(i) < partitionOf(j);
+        });
+        missed.clear();
+        for (size_t begin = 0, end = 0; begin < group.size(); begin = end) {
+            auto part = partitionOf(group[begin]);
+            for (end = begin; end < group.size() && partitionOf(group[end]) == part; ++end) {}
+            run.assign(group.begin() + begin, group.begin() + end);
+            if ((*status = acquireBlock(item.id_, part)) != Status::SUCCESS) {
+                return;
+            }
+            probe(blocks.at(part), run);
+            missed.insert(missed.end(), run.begin(), run.end());
+        }
+        group.swap(missed);
+    };
+
+    std::shared_lock<std::shared_mutex> imm_r_latch{batch_holder_mutex_};
+    for (auto iter = batch_holder_.rbegin(); iter != batch_holder_.rend() && !pending.empty(); iter++) {
+        if (locator_ != nullptr && locator_->IsCovered(iter->id_)) {
+            /// regroup the keys by the batch each segment gives, the keys
+            /// not found go on with the next segment
+            for (size_t segment = 0; segment < locator_->GetSegmentNum() && !pending.empty(); ++segment) {
+                std::unordered_map<const BatchItem<KeyType, ValueType> *, std::vector<size_t>> owners{};
+                for (auto i : pending) {
+                    auto owner = batch_holder_.Find(locator_->Locate(segment, bufs[i].get(), lens[i], hashes[i]));
+                    owners[owner].emplace_back(i);
+                }
+                pending.clear();
+                for (auto & owner : owners) {
+                    if (owner.first != nullptr) {
+                        probeBatch(*owner.first, owner.second);
+                        if (*status != Status::SUCCESS) {
+                            return values;
+                        }
+                    }
+                    pending.insert(pending.end(), owner.second.begin(), owner.second.end());
+                }
+            }
+            break;
+        }
+        probeBatch(*iter, pending);
+        if (*status != Status::SUCCESS) {
+            break;
+        }
+    }
+
+    return values;
+}
+
+template<typename KeyType, typename ValueType>
+void SsIndex<KeyType, ValueType>::Optimize() {
+    {
+        std::lock_guard<std::shared_mutex> w_latch{memtable_mutex_};
+        if (!memtable_.data_->Empty()) {
+            scheduleFlush();
+        }
+    }
+
+    /// wait for all the pending flushes, the compactions they scheduled
+    /// are superseded by the optimization, so cancel the queued ones and
+    /// only wait for those already running
+    flush_tasks_.Wait();
+    compaction_tasks_.Cancel();
+    compaction_tasks_.Wait();
 
     /// Compaction all the archived data
     std::vector<typename BatchItem<KeyType, ValueType>::Batch> candidates{};
     uint64_t start = 0;
     size_t count = 0;
-    batch_holder_.FetchOptimizationCandidates(&start, &count, candidates);
-    auto task_ = std::make_unique<CompactionTask<KeyType, ValueType>>(candidates, partition_num_);
+    {
+        std::shared_lock<std::shared_mutex> imm_r_latch{batch_holder_mutex_};
+        if (batch_holder_.items_.empty()) {
+            return;
+        }
+        batch_holder_.FetchOptimizationCandidates(&start, &count, candidates);
+    }
+    auto task_ = std::make_unique<CompactionTask<KeyType, ValueType>>(candidates, seed_, compaction_fp_bits_, working_directory_);
+    {
+        std::shared_lock<std::shared_mutex> imm_r_latch{batch_holder_mutex_};
+        task_->SetDropListener(drop_listener_);
+    }
     auto pre = []() {
         std::cout << "Start Optimization" << std::endl;
     };
     auto * raw_ptr_ = task_.get();
     auto updateIndex_ = [this, raw_ptr_, start, count]() {
-        std::lock_guard<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
-        batch_holder_.CommitCompaction(start, count, std::move(raw_ptr_->file_handle_), std::move(raw_ptr_->blocks_));
+        std::unique_lock<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
+        commitCompaction(start, count, std::move(raw_ptr_->file_handle_), std::move(raw_ptr_->blocks_));
+        imm_w_latch.unlock();
+        enforceBlockBudget();
 
         std::cout << "Optimization Finished" << std::endl;
     };
     task_->SetPreExecute(pre);
     task_->SetPostExecute(updateIndex_);
-    scheduler_->ScheduleTask(std::move(task_));
+    scheduler_->ScheduleTask(std::move(task_)).Wait();
+}
 
-    scheduler_->Wait();
+template<typename KeyType, typename ValueType>
+void SsIndex<KeyType, ValueType>::commitCompaction(uint64_t start, size_t count,
+        const typename BatchHolder<KeyType, ValueType>::FileHandlePtr & file,
+        const typename BatchHolder<KeyType, ValueType>::Blocks & blocks) {
+    auto sources = batch_holder_.CollectIds(start, count);
+    if (block_residency_ != nullptr) {
+        for (auto source : sources) {
+            block_residency_->DropBatch(source);
+        }
+    }
+    batch_holder_.CommitCompaction(start, count, file, blocks);
+    write_controller_.SetBatchNum(batch_holder_.items_.size());
+    auto target = batch_holder_.next_id_ - 1;
+    trackBatch(target);
+    invalidateReadCache();
+
+    if (locator_ != nullptr) {
+        locator_->OnCompaction(sources, target);
+    }
+    if (locator_building_) {
+        locator_compaction_log_.emplace_back(std::move(sources), target);
+    }
+}
+
+template<typename KeyType, typename ValueType>
+auto SsIndex<KeyType, ValueType>::getUncoveredBatchNum() -> size_t {
+    size_t num = 0;
+    for (auto iter = batch_holder_.rbegin(); iter != batch_holder_.rend(); iter++) {
+        if (locator_ != nullptr && locator_->IsCovered(iter->id_)) {
+            break;
+        }
+        num++;
+    }
+    return num;
+}
+
+template<typename KeyType, typename ValueType>
+auto SsIndex<KeyType, ValueType>::scheduleLocatorBuild(bool full) -> TaskHandle {
+    /// absorb the newest segments as long as they're not larger than what
+    /// the new one is built from
+    size_t absorbed = 0;
+    std::unordered_set<uint64_t> absorbed_batches{};
+    if (locator_ != nullptr) {
+        uint64_t entry_num = 0;
+        for (auto & item : batch_holder_.items_) {
+            if (!locator_->IsCovered(item.id_)) {
+                entry_num += item.data_.second->GetEntryNum();
+            }
+        }
+        while (absorbed < locator_->GetSegmentNum() && (full || locator_->GetSegmentEntryNum(absorbed) <= entry_num)) {
+            entry_num += locator_->GetSegmentEntryNum(absorbed);
+            locator_->CollectSegmentBatches(absorbed, &absorbed_batches);
+            absorbed++;
+        }
+    }
+    std::vector<std::pair<uint64_t, typename BatchHolder<KeyType, ValueType>::FileHandlePtr>> batches{};
+    std::vector<uint64_t> ids{};
+    std::unordered_set<uint64_t> covered{};
+    for (auto & item : batch_holder_.items_) {
+        if (full || locator_ == nullptr || !locator_->IsCovered(item.id_) || absorbed_batches.count(item.id_) != 0) {
+            batches.emplace_back(item.id_, item.data_.second);
+            ids.emplace_back(item.id_);
+        }
+        covered.insert(item.id_);
+    }
+    locator_building_ = true;
+    locator_compaction_log_.clear();
+
+    auto task = std::make_unique<BuildLocatorTask<KeyType, ValueType>>(std::move(batches), seed_);
+    auto * raw_ptr = task.get();
+    auto installLocator = [this, raw_ptr, ids = std::move(ids), absorbed, covered = std::move(covered)]() mutable {
+        std::lock_guard<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
+        /// a partial segment is useless without the ones it's built on,
+        /// which are gone if the locator is disabled meanwhile
+        bool complete = ids.size() == covered.size();
+        if (locator_rebuild_threshold_ != 0 && (locator_ != nullptr || complete)) {
+            if (locator_ == nullptr) {
+                locator_ = std::make_shared<BatchLocator<KeyType>>();
+            }
+            locator_->AddSegment(std::move(raw_ptr->blocks_), ids, raw_ptr->entry_num_, absorbed, std::move(covered));
+            /// batches of the snapshot may have been compacted meanwhile
+            for (auto & entry : locator_compaction_log_) {
+                locator_->OnCompaction(entry.first, entry.second);
+            }
+            invalidateReadCache();
+        }
+        locator_compaction_log_.clear();
+        locator_building_ = false;
+        std::cout << "Batch Locator Built" << std::endl;
+    };
+    task->SetPostExecute(installLocator);
+    auto handle = scheduler_->ScheduleTask(std::move(task));
+    locator_tasks_.Add(handle);
+    return handle;
+}
+
+template<typename KeyType, typename ValueType>
+void SsIndex<KeyType, ValueType>::maybeScheduleLocatorBuild() {
+    /// a single batch is probed directly, without any locator
+    if (locator_rebuild_threshold_ == 0 || locator_building_ || batch_holder_.items_.size() < 2) {
+        return;
+    }
+    if (getUncoveredBatchNum() >= locator_rebuild_threshold_) {
+        scheduleLocatorBuild(false);
+    }
+}
+
+template<typename KeyType, typename ValueType>
+void SsIndex<KeyType, ValueType>::RebuildBatchLocator() {
+    locator_tasks_.Wait();
+    TaskHandle handle{};
+    {
+        std::lock_guard<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
+        if (locator_rebuild_threshold_ == 0 || batch_holder_.items_.empty()) {
+            return;
+        }
+        if (!locator_building_) {
+            handle = scheduleLocatorBuild(true);
+        }
+    }
+    handle.Wait();
+    locator_tasks_.Wait();
+}
+
+template<typename KeyType, typename ValueType>
+auto SsIndex<KeyType, ValueType>::BulkLoad(const std::string & input_file, size_t parallelism, size_t memory_budget) -> Status {
+    BulkLoader<KeyType, ValueType> loader{working_directory_, seed_, compaction_fp_bits_, parallelism, memory_budget};
+    auto s = loader.Load(input_file);
+    if (s != Status::SUCCESS) {
+        return s;
+    }
+    std::cout << "Bulk Loaded | Entry Num: " << loader.GetEntryNum() << std::endl;
+
+    {
+        std::lock_guard<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
+        batch_holder_.AppendBatch(std::move(loader.file_handle_), std::move(loader.blocks_));
+        write_controller_.SetBatchNum(batch_holder_.items_.size());
+        trackBatch(batch_holder_.next_id_ - 1);
+        invalidateReadCache();
+        maybeScheduleLocatorBuild();
+    }
+    enforceBlockBudget();
+    return Status::SUCCESS;
 }
 
 template<typename KeyType, typename ValueType>
 auto SsIndex<KeyType, ValueType>::FlushAndBuildIndexBlocks() -> Status {
-    if (memtable_.data_->empty()) {
+    if (memtable_.data_->Empty()) {
         return Status::SUCCESS;
     }
 
@@ -197,6 +742,10 @@ auto SsIndex<KeyType, ValueType>::Flush() -> Status {
 
 template class SsIndex<std::string, uint64_t>;
 template class SsIndex<std::string, uint32_t>;
-// template class SsIndex<uint64_t, uint64_t>;
+template class SsIndex<std::string, uint8_t>;
+template class SsIndex<uint64_t, uint64_t>;
+template class SsIndex<uint64_t, uint32_t>;
+template class SsIndex<Key128, uint64_t>;
+template class SsIndex<Key128, uint32_t>;
 
 }  // namespace ssindex
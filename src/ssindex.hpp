@@ -7,10 +7,19 @@
 #include <vector>
 #include <queue>
 #include <unordered_map>
+#include <map>
+#include <filesystem>
 
 #include "index_archived_file.hpp"
 #include "index_block.hpp"
 #include "scheduler.hpp"
+#include "write_controller.hpp"
+#include "batch_locator.hpp"
+#include "read_cache.hpp"
+#include "memtable_filter.hpp"
+#include "memtable.hpp"
+#include "write_batch.hpp"
+#include "block_residency.hpp"
 //#include "task_compaction.hpp"
 //#include "task_flush_memtable.hpp"
 
@@ -57,6 +66,29 @@ struct BatchHolder {
         }
     }
 
+    /// Ids of the |count| batches starting from the batch |start|
+    auto CollectIds(uint64_t start, size_t count) const -> std::vector<uint64_t> {
+        std::vector<uint64_t> ids{};
+        for (size_t i = 0; i < items_.size(); ++i) {
+            if (items_[i].id_ == start) {
+                for (size_t j = i; j < i + count && j < items_.size(); ++j) {
+                    ids.emplace_back(items_[j].id_);
+                }
+                break;
+            }
+        }
+        return ids;
+    }
+
+    auto Find(uint64_t id) const -> const Item * {
+        for (auto & item : items_) {
+            if (item.id_ == id) {
+                return &item;
+            }
+        }
+        return nullptr;
+    }
+
     void FetchOptimizationCandidates(uint64_t * start, size_t * count, std::vector<Batch> & candidates) {
         *start = items_.at(0).id_;
         *count = items_.size();
@@ -132,54 +164,211 @@ public:
     ValueType key_not_found = IndexUtils<ValueType>::KeyNotFound();
 
     //using MemtableData = std::unordered_map<KeyType, ValueType>;
-    using MemtableData = std::shared_ptr<std::unordered_map<KeyType, ValueType>>;
+    using MemtableData = std::shared_ptr<PartitionedMemtable<KeyType, ValueType>>;
 
+    /// |filter_| holds all the keys of |data_|, see |MemtableFilter|
     struct Memtable {
         uint64_t id_;
         MemtableData data_;
+        std::shared_ptr<MemtableFilter> filter_;
     };
 
-    explicit SsIndex(std::string directory)
+    /// |scheduler| can be shared by multiple indexes, it's not owned by the
+    /// index and must outlive it. A single-worker scheduler is created when
+    /// it's not given.
+    explicit SsIndex(std::string directory,
+                     WriteControllerOptions write_options = WriteControllerOptions{},
+                     Scheduler * scheduler = nullptr)
         : working_directory_(std::move(directory)),
+          memtable_(std::move(Memtable{FetchMemtableId(), std::make_shared<PartitionedMemtable<KeyType, ValueType>>(DefaultPartitionNum),
+                                       std::make_shared<MemtableFilter>(MemtableFlushThreshold)})),
           seed_(0x12345678),
           fp_bits_(DefaultFpBits),
-          scheduler_(new Scheduler(1)),
-          memtable_(std::move(Memtable{FetchMemtableId(), std::make_shared<std::unordered_map<KeyType, ValueType>>()})),
-          partition_num_(DefaultPartitionNum) {
-        std::filesystem::create_directory(working_directory_);
+          compaction_fp_bits_(0),
+          partition_num_(DefaultPartitionNum),
+          memtable_flush_threshold_(MemtableFlushThreshold),
+          owns_scheduler_(scheduler == nullptr),
+          scheduler_(scheduler == nullptr ? new Scheduler(1) : scheduler),
+          locator_rebuild_threshold_(0),
+          locator_building_(false),
+          write_controller_(write_options) {
+        std::filesystem::create_directories(working_directory_);
     }
 
     ~SsIndex() {
-        scheduler_->Stop();
+        /// queued compactions are pure optimizations, but the data of
+        /// immutable memtables must reach the archived files
+        compaction_tasks_.Cancel();
+        flush_tasks_.Wait();
+        compaction_tasks_.Wait();
+        locator_tasks_.Cancel();
+        locator_tasks_.Wait();
+        eviction_tasks_.Cancel();
+        eviction_tasks_.Wait();
+        if (owns_scheduler_) {
+            scheduler_->Stop();
+            delete scheduler_;
+        }
     }
 
     void Set(const KeyType & key, const ValueType & value);
 
-    auto Get(const KeyType & key) -> ValueType;
+    /// |Set| all the entries of |batch| in order, throttled before the
+    /// first entry and after each memtable it fills (with the memtable
+    /// lock released), so that a large batch can't outrun the flushes
+    void Write(const WriteBatch<KeyType, ValueType> & batch);
+
+    /// |status|, if given, is set to the error of a block that failed to
+    /// be faulted in (see |EnableBlockResidency|), which is not a miss
+    auto Get(const KeyType & key, Status * status = nullptr) -> ValueType;
+
+    /// |Get| skipping the values rejected by |accept|, e.g. the false
+    /// positives of newer batches that the caller is able to detect, so
+    /// that the older batches are probed as well
+    auto GetIf(const KeyType & key, const std::function<bool(const ValueType &)> & accept, Status * status = nullptr) -> ValueType;
+
+    /// Exact |Get|: a block hit is confirmed by the archived file of the
+    /// batch, which reads the single page that could hold the key (see
+    /// |IndexArchivedFile::Lookup|), so an absent key is never answered
+    /// with a random value
+    auto GetVerified(const KeyType & key, Status * status = nullptr) -> ValueType;
+
+    /// Batched |Get|, keys of the same partition are probed together on
+    /// each block through |IndexBlock::GetValues|
+    auto MultiGet(const std::vector<KeyType> & keys, Status * status = nullptr) -> std::vector<ValueType>;
 
     void Optimize();
 
+    /// Build one optimized batch from a flat "<key>\t<value>" file, with
+    /// the false positive validation bits of the compacted batches, as
+    /// |Optimize| does, and |parallelism| partitions built at the same time. A non-zero
+    /// |memory_budget| builds each partition in external memory.
+    auto BulkLoad(const std::string & input_file,
+                  size_t parallelism = std::thread::hardware_concurrency(),
+                  size_t memory_budget = 0) -> Status;
+
+    /// Number of entries of the memtable to trigger a flush
+    void SetMemtableFlushThreshold(size_t threshold) {
+        std::lock_guard<std::shared_mutex> w_latch{memtable_mutex_};
+        memtable_flush_threshold_ = threshold == 0 ? 1 : threshold;
+        if (memtable_.data_->Empty()) {
+            memtable_.filter_ = std::make_shared<MemtableFilter>(memtable_flush_threshold_);
+        }
+    }
+
+    /// False positive validation bits of the flushed batches and of the
+    /// compacted ones, it must be set before any write
+    void SetFpBits(uint64_t fp_bits, uint64_t compaction_fp_bits) {
+        std::lock_guard<std::shared_mutex> w_latch{memtable_mutex_};
+        std::lock_guard<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
+        fp_bits_ = fp_bits;
+        compaction_fp_bits_ = compaction_fp_bits;
+    }
+
+    /// |listener| is called for every entry dropped because of a newer
+    /// version of its key, i.e. overwritten in the memtable by |Set|, or
+    /// dropped by a compaction from the thread running it
+    void SetDropListener(std::function<void(const std::pair<KeyType, ValueType> &)> listener) {
+        std::lock_guard<std::shared_mutex> mem_w_latch{memtable_mutex_};
+        std::lock_guard<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
+        drop_listener_ = std::move(listener);
+    }
+
+    /// Cache the answers of |Get| for the hot keys within |memory_budget|
+    /// bytes (see |ReadCache|), and 0 disables the cache. It must be set
+    /// before any read.
+    void EnableReadCache(size_t memory_budget) {
+        std::lock_guard<std::shared_mutex> mem_w_latch{memtable_mutex_};
+        std::lock_guard<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
+        read_cache_ = memory_budget == 0 ? nullptr : std::make_unique<ReadCache<KeyType, ValueType>>(memory_budget);
+    }
+
+    auto GetReadCacheStats() -> ReadCacheStats {
+        return read_cache_ == nullptr ? ReadCacheStats{} : read_cache_->GetStats();
+    }
+
+    /// Keep the bit arrays of the blocks within |memory_budget| bytes (see
+    /// |BlockResidency|): the cold blocks picked by |policy|, CLOCK if it's
+    /// not given, are evicted to block files and faulted back in on access.
+    /// It must be set before any read.
+    void EnableBlockResidency(size_t memory_budget, std::unique_ptr<ResidencyPolicy> policy = nullptr) {
+        {
+            std::lock_guard<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
+            block_residency_ = std::make_unique<BlockResidency<ValueType>>(memory_budget, working_directory_, std::move(policy));
+            for (auto & item : batch_holder_.items_) {
+                block_residency_->AddBatch(item.id_, item.data_.first);
+            }
+        }
+        enforceBlockBudget();
+    }
+
+    auto GetBlockResidencyStats() -> BlockResidencyStats {
+        return block_residency_ == nullptr ? BlockResidencyStats{} : block_residency_->GetStats();
+    }
+
+    /// Maintain a |BatchLocator|, so that |Get| probes a batch per locator
+    /// segment no matter how many batches exist. Once |rebuild_threshold|
+    /// batches are not covered by it, a segment is built from them in
+    /// background, and 0 disables the locator.
+    void EnableBatchLocator(size_t rebuild_threshold = DefaultLocatorRebuildThreshold) {
+        std::lock_guard<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
+        locator_rebuild_threshold_ = rebuild_threshold;
+        if (rebuild_threshold == 0) {
+            locator_.reset();
+            invalidateReadCache();
+        }
+    }
+
+    auto GetLocatorSegmentNum() -> size_t {
+        std::shared_lock<std::shared_mutex> imm_r_latch{batch_holder_mutex_};
+        return locator_ == nullptr ? 0 : locator_->GetSegmentNum();
+    }
+
+    /// Build the locator over all the current batches, as a single
+    /// segment, and wait for it
+    void RebuildBatchLocator();
+
     inline uint64_t GetBlockPartition(const char * kbuf, const size_t klen) {
         return HASH(kbuf, klen) % partition_num_;
     }
 
     void WaitTaskComplete() {
-        scheduler_->Wait();
+        flush_tasks_.Wait();
+        compaction_tasks_.Wait();
+        locator_tasks_.Wait();
+        eviction_tasks_.Wait();
+    }
+
+    /// Number of immutable memtables not published as batches yet
+    auto GetImmutableNum() -> size_t {
+        std::shared_lock<std::shared_mutex> q_r_latch{waiting_queue_mutex_};
+        return waiting_queue_.size();
+    }
+
+    auto GetWriteStallStats() -> WriteStallStats {
+        return write_controller_.GetStats();
     }
 
     uint64_t GetUsage() {
-        uint64_t sum = 0;
+        std::shared_lock<std::shared_mutex> imm_r_latch{batch_holder_mutex_};
+        uint64_t sum = locator_ == nullptr ? 0 : locator_->GetFootprint();
+        sum += read_cache_ == nullptr ? 0 : read_cache_->GetFootprint();
+        /// bit arrays may be faulted in meanwhile, the residency counts them
+        sum += block_residency_ == nullptr ? 0 : block_residency_->GetResidentBytes();
         for (auto iter = batch_holder_.rbegin(); iter != batch_holder_.rend(); iter++) {
             auto & blocks = iter->data_.first;
             for (size_t i = 0; i < blocks.size(); i++) {
-                sum += blocks.at(i).GetFootprint();
+                sum += block_residency_ == nullptr ? blocks.at(i).GetFootprint() : blocks.at(i).GetMetaFootprint();
             }
+            /// none once the file is frozen
+            sum += iter->data_.second->GetBufferUsage();
+            sum += iter->data_.second->GetFenceUsage();
         }
         return sum;
     }
 
     void PrintInfo() {
-        std::cout << "[Memory]\nMemtable_" << memtable_.id_ << " | Entry Num: " << memtable_.data_.get()->size() << std::endl;
+        std::cout << "[Memory]\nMemtable_" << memtable_.id_ << " | Entry Num: " << memtable_.data_->Size() << std::endl;
         for (auto iter = waiting_queue_.begin(); iter != waiting_queue_.end(); iter++) {
             std::cout << "Imm | " << iter->id_ << std::endl;
         }
@@ -204,6 +393,104 @@ private:
 
     auto FlushAndBuildIndexBlocks() -> Status;
 
+    /// Look |key| up in the memtable and the immutable ones, |hash| is its
+    /// |IndexUtils::Hash|
+    auto getFromMemtables(const KeyType & key, uint64_t hash, ValueType * value) -> bool;
+
+    /// Insert an entry into the memtable and rotate it once full, return
+    /// whether it's rotated, the caller must hold |memtable_mutex_|
+    auto insertIntoMemtable(const KeyType & key, const ValueType & value, uint64_t hash) -> bool;
+
+    /// Rotate the memtable and schedule a flush task for it, the caller
+    /// must hold |memtable_mutex_|
+    auto scheduleFlush() -> TaskHandle;
+
+    /// Schedule the flush of an immutable memtable, |attempt| is the number
+    /// of its failed flushes so far
+    auto scheduleFlushTask(const Memtable & immutable, size_t attempt) -> TaskHandle;
+
+    /// Publish the batch flushed from memtable |memtable_id|, along with the
+    /// newer ones held back by it
+    void publishFlush(uint64_t memtable_id,
+                      typename BatchHolder<KeyType, ValueType>::FileHandlePtr file,
+                      typename BatchHolder<KeyType, ValueType>::Blocks blocks);
+
+    /// Replace the compacted batches and remap them in the locator, the
+    /// caller must hold |batch_holder_mutex_|
+    void commitCompaction(uint64_t start, size_t count,
+                          const typename BatchHolder<KeyType, ValueType>::FileHandlePtr & file,
+                          const typename BatchHolder<KeyType, ValueType>::Blocks & blocks);
+
+    /// The batches changed, so the cached answers of absent keys may have
+    /// changed as well, the caller must hold |batch_holder_mutex_|
+    void invalidateReadCache() {
+        if (read_cache_ != nullptr) {
+            read_cache_->Invalidate();
+        }
+    }
+
+    /// Make a block resident before probing it, and leave the eviction of
+    /// the blocks beyond the budget to a background task, the caller must
+    /// hold |batch_holder_mutex_|
+    auto acquireBlock(uint64_t batch_id, uint64_t partition) -> Status {
+        if (block_residency_ == nullptr) {
+            return Status::SUCCESS;
+        }
+        auto s = block_residency_->Acquire(batch_id, partition);
+        maybeScheduleEviction();
+        return s;
+    }
+
+    /// Schedule an |EvictBlocksTask| if the blocks exceed the budget and
+    /// none is pending yet
+    void maybeScheduleEviction();
+
+    /// Track the blocks of a new batch, the caller must hold
+    /// |batch_holder_mutex_| exclusively and enforce the budget once it's
+    /// released
+    void trackBatch(uint64_t batch_id) {
+        if (block_residency_ == nullptr) {
+            return;
+        }
+        for (auto & item : batch_holder_.items_) {
+            if (item.id_ == batch_id) {
+                block_residency_->AddBatch(item.id_, item.data_.first);
+                break;
+            }
+        }
+    }
+
+    /// Evict blocks down to the budget: the victims are written to the
+    /// block files with the batches locked shared, so the reads go on, and
+    /// released with the batches locked exclusively. The caller must not
+    /// hold |batch_holder_mutex_|.
+    ///
+    /// The victims which failed to be written stay resident, and they're
+    /// counted in |BlockResidencyStats::spill_failures_|.
+    void enforceBlockBudget() {
+        if (block_residency_ == nullptr || !block_residency_->OverBudget()) {
+            return;
+        }
+        {
+            std::shared_lock<std::shared_mutex> imm_r_latch{batch_holder_mutex_};
+            block_residency_->PrepareEviction();
+        }
+        std::lock_guard<std::shared_mutex> imm_w_latch{batch_holder_mutex_};
+        block_residency_->Evict();
+    }
+
+    /// Number of the newest batches not covered by the locator, the caller
+    /// must hold |batch_holder_mutex_|
+    auto getUncoveredBatchNum() -> size_t;
+
+    /// Schedule the build of a locator segment over the uncovered batches
+    /// and those of the segments it replaces (see |BatchLocator|), or over
+    /// all the current batches if |full|, the caller must hold
+    /// |batch_holder_mutex_|
+    auto scheduleLocatorBuild(bool full) -> TaskHandle;
+
+    void maybeScheduleLocatorBuild();
+
     auto buildBlock(std::vector<std::pair<KeyType, ValueType>> & kvs, IndexBlock<ValueType> & block) -> Status;
 
     auto Flush() -> Status;
@@ -220,6 +507,14 @@ private:
     std::vector<Memtable> waiting_queue_;
     std::shared_mutex waiting_queue_mutex_;
 
+    /// Batches flushed ahead of an older immutable memtable, by memtable id,
+    /// guarded by |waiting_queue_mutex_|
+    std::map<uint64_t, typename BatchItem<KeyType, ValueType>::Batch> flushed_batches_;
+
+    /// Immutable memtables whose flush failed past the retries, flushed
+    /// again at the next rotation, guarded by |waiting_queue_mutex_|
+    std::vector<Memtable> failed_flushes_;
+
     BatchHolder<KeyType, ValueType> batch_holder_;
     std::shared_mutex batch_holder_mutex_;
 
@@ -236,11 +531,54 @@ private:
     /// False positive validation bits
     uint64_t fp_bits_;
 
-    /// Number of partitions
+    /// False positive validation bits of compacted batches
+    uint64_t compaction_fp_bits_;
+
+    /// Called for the entries dropped by newer versions
+    std::function<void(const std::pair<KeyType, ValueType> &)> drop_listener_;
+
+    /// Number of partitions of the memtables, the batches pick their own
+    /// (see |ChoosePartitionNum|)
     uint64_t partition_num_;
 
-    /// Task scheduler
+    /// Number of entries of the memtable to trigger a flush
+    size_t memtable_flush_threshold_;
+
+    /// Task scheduler, and whether it's owned by the index
+    bool owns_scheduler_;
     Scheduler * scheduler_;
+
+    /// Pending flush tasks
+    TaskGroup flush_tasks_;
+
+    /// Pending compaction tasks
+    TaskGroup compaction_tasks_;
+
+    /// Batch locator, guarded by |batch_holder_mutex_|
+    std::shared_ptr<BatchLocator<KeyType>> locator_;
+
+    /// Number of uncovered batches to rebuild the locator, 0 for disabled
+    size_t locator_rebuild_threshold_;
+
+    /// Whether a locator build is in flight, and the compactions committed
+    /// since it's scheduled, which are replayed on the new locator
+    bool locator_building_;
+    std::vector<std::pair<std::vector<uint64_t>, uint64_t>> locator_compaction_log_;
+
+    TaskGroup locator_tasks_;
+
+    /// Write stall & backpressure
+    WriteController write_controller_;
+
+    /// Hot-key cache of |Get|, nullptr for disabled
+    std::unique_ptr<ReadCache<KeyType, ValueType>> read_cache_;
+
+    /// Memory budget of the blocks, nullptr for disabled
+    std::unique_ptr<BlockResidency<ValueType>> block_residency_;
+
+    /// Eviction tasks scheduled by the reads, and whether one is pending
+    TaskGroup eviction_tasks_;
+    std::atomic_bool eviction_scheduled_{false};
 };
 
 }  // namespace ssindex
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "index_common.hpp"
+#include "index_archived_file.hpp"
+#include "scheduler.hpp"
+#include "index_block.hpp"
+#include "batch_locator.hpp"
+
+#include <unordered_map>
+#include <vector>
+#include <memory>
+
+namespace ssindex {
+
+/// |BuildLocatorTask| builds the blocks of a |BatchLocator| from the
+/// archived files of a snapshot of the batches. Batches are scanned from
+/// the oldest to the newest, so every key ends up mapped to the id of the
+/// newest batch holding it. The locator picks its number of partitions
+/// from the number of entries of the batches, whatever theirs.
+template<typename KeyType, typename ValueType>
+struct BuildLocatorTask : public Task {
+    using FileHandlePtr = std::shared_ptr<IndexArchivedFile<KeyType, ValueType>>;
+    using Blocks = typename BatchLocator<KeyType>::Blocks;
+
+    /// |batches| are pairs of batch id and archived file, oldest first
+    explicit BuildLocatorTask(std::vector<std::pair<uint64_t, FileHandlePtr>> batches,
+                              uint64_t seed = 0x12345678)
+        : batches_(std::move(batches)),
+          partition_num_(0),
+          entry_num_(0),
+          seed_(seed) {}
+
+    ~BuildLocatorTask() override = default;
+
+    Status Execute() override {
+        for (auto & batch : batches_) {
+            entry_num_ += batch.second->GetEntryNum();
+        }
+        partition_num_ = ChoosePartitionNum(entry_num_);
+        blocks_ = Blocks(partition_num_);
+        std::vector<FileHandlePtr> files{};
+        for (auto & batch : batches_) {
+            files.emplace_back(batch.second);
+        }
+        /// every partition of the batches is read once, see |RepartitionedReader|
+        RepartitionedReader<KeyType, ValueType> reader{std::move(files), partition_num_};
+        uint64_t group_num = reader.GetGroupNum();
+        using Owners = std::unordered_map<KeyType, uint64_t, typename KeyHasher<KeyType>::type>;
+        for (uint64_t group = 0; group < group_num; ++group) {
+            std::vector<Owners> owners(partition_num_ / group_num);
+            auto s = reader.ScanGroup(group, [&](size_t batch, const std::pair<KeyType, ValueType> & entry) {
+                owners[IndexUtils<KeyType>::Hash(entry.first) % partition_num_ / group_num].insert_or_assign(entry.first, batches_[batch].first);
+            });
+            if (s != Status::SUCCESS) {
+                return s;
+            }
+            for (uint64_t i = 0; i < owners.size(); ++i) {
+                s = buildSinglePartition(owners[i], blocks_[group + i * group_num], seed_);
+                if (s != Status::SUCCESS) {
+                    return s;
+                }
+                Owners{}.swap(owners[i]);
+            }
+        }
+        return Status::SUCCESS;
+    }
+
+    auto buildSinglePartition(
+            const std::unordered_map<KeyType, uint64_t, typename KeyHasher<KeyType>::type> & owners,
+            IndexBlock<uint64_t> & block,
+            uint64_t seed) -> Status {
+        if (owners.empty()) {
+            return Status::SUCCESS;
+        }
+        const size_t round = 20;
+        for (size_t i = 0; i < round; ++i) {
+            std::vector<IndexEdge<uint64_t>> ies;
+            ies.reserve(owners.size());
+            for (auto & owner : owners) {
+                size_t length = 0;
+                auto buf = IndexUtils<KeyType>::RawBuffer(owner.first, &length);
+                ies.emplace_back(IndexEdge<uint64_t>(buf.get(), length, owner.second, seed));
+            }
+            /// ids are validated by the blocks of the batches, so no
+            /// false positive validation bits here
+            if (block.TryBuild(ies, seed, 0) == Status::SUCCESS) {
+                return Status::SUCCESS;
+            }
+            seed += 114514;
+        }
+        return Status::ERROR;
+    }
+
+    /// input
+    std::vector<std::pair<uint64_t, FileHandlePtr>> batches_;
+
+    /// output
+    Blocks blocks_;
+
+    uint64_t partition_num_;
+
+    /// Number of entries of the batches, duplicated keys included
+    uint64_t entry_num_;
+
+    uint64_t seed_;
+};
+
+}  // namespace ssindex
@@ -0,0 +1,242 @@
+#pragma once
+
+#include "index_common.hpp"
+#include "index_archived_file.hpp"
+#include "scheduler.hpp"
+#include "index_block.hpp"
+#include "external_entry_file.hpp"
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+
+namespace ssindex {
+
+/// Build the |IndexBlock| of a partition from its entries, where the newest
+/// version of a key goes first (i.e. before any older one). |data| is left
+/// sorted by key with only the newest versions, so that callers can write
+/// it as a sorted run; |drop_listener|, if any, is called for every older
+/// version dropped. The seed is bumped until the block can be built.
+template<typename KeyType, typename ValueType>
+auto BuildPartitionBlock(std::vector<std::pair<KeyType, ValueType>> & data,
+                         IndexBlock<ValueType> & block,
+                         uint64_t seed,
+                         uint64_t fp_bits,
+                         const std::function<void(const std::pair<KeyType, ValueType> &)> & drop_listener = nullptr) -> Status {
+    if (data.size() == 0) {
+        return Status::SUCCESS;
+    }
+    std::stable_sort(data.begin(), data.end(),
+            [](const std::pair<KeyType, ValueType> & v1, const std::pair<KeyType, ValueType> & v2) -> bool {
+        return v1.first < v2.first;
+    });
+    if (drop_listener) {
+        for (size_t i = 1; i < data.size(); ++i) {
+            if (data[i].first == data[i - 1].first) {
+                drop_listener(data[i]);
+            }
+        }
+    }
+    data.erase(std::unique(data.begin(), data.end(),
+            [](const std::pair<KeyType, ValueType> & v1, const std::pair<KeyType, ValueType> & v2) -> bool {
+        return v1.first == v2.first;
+    }), data.end());
+
+    const size_t round = 20;
+    for (size_t i = 0; i < round; ++i) {
+        std::vector<IndexEdge<ValueType>> ies;
+        ies.reserve(data.size());
+        for (size_t j = 0; j < data.size(); ++j) {
+            size_t length = 0;
+            auto buf = IndexUtils<KeyType>::RawBuffer(data[j].first, &length);
+            ies.emplace_back(IndexEdge<ValueType>(buf.get(), length, data[j].second, seed));
+        }
+        if (block.TryBuild(ies, seed, fp_bits) == Status::SUCCESS) {
+            return Status::SUCCESS;
+        }
+        seed += 114514;
+    }
+    return Status::ERROR;
+}
+
+/// |BuildPartitionTask| builds the |IndexBlock|s of the partitions of a
+/// batch within a single partition of an archived file. The file has fewer
+/// partitions than the batch, or as many (see |ForEachGroupPartition|), and
+/// partitions of a file are independent, so one task per partition of the
+/// file lets a whole batch be built in parallel.
+///
+/// Entries of the partition are read in write order, and when a key shows
+/// up multiple times the last written value wins. Once a block is built,
+/// the newest versions of its partition are written to the output file, if
+/// any, as a sorted run.
+///
+/// With a non-zero |memory_budget|, partitions are sorted in external
+/// memory (see |ExternalEntryFile|), streamed into an |ExternalEdgeFile|
+/// and built by |IndexBlock::TryBuildExternal| instead, so that partitions
+/// larger than the memory can be built.
+template<typename KeyType, typename ValueType>
+struct BuildPartitionTask : public Task {
+    using FileHandlePtr = std::shared_ptr<IndexArchivedFile<KeyType, ValueType>>;
+    using Blocks = std::vector<IndexBlock<ValueType>>;
+    using Entry = std::pair<KeyType, ValueType>;
+
+    /// |blocks| holds the |block_num| blocks of the batch, the task only
+    /// builds those of |partition_id|
+    explicit BuildPartitionTask(FileHandlePtr file_handle,
+                                uint64_t partition_id,
+                                Blocks * blocks,
+                                uint64_t seed = 0x12345678,
+                                uint64_t fp_bits = 0,
+                                size_t memory_budget = 0,
+                                std::string spill_directory = default_working_directory)
+        : file_handle_(std::move(file_handle)),
+          partition_id_(partition_id),
+          blocks_(blocks),
+          seed_(seed),
+          fp_bits_(fp_bits),
+          memory_budget_(memory_budget),
+          spill_directory_(std::move(spill_directory)),
+          output_latch_(nullptr) {}
+
+    ~BuildPartitionTask() override = default;
+
+    /// |output| is shared by the tasks of all the partitions, which write
+    /// it with |output_latch| held
+    void SetOutput(FileHandlePtr output, std::mutex * output_latch) {
+        output_ = std::move(output);
+        output_latch_ = output_latch;
+    }
+
+    Status Execute() override {
+        uint64_t group_num = file_handle_->GetPartitionNum();
+        uint64_t block_num = blocks_->size();
+        if (memory_budget_ != 0) {
+            return buildExternal(group_num, block_num);
+        }
+        std::vector<std::vector<Entry>> parts(block_num / group_num);
+        auto s = file_handle_->ScanData(partition_id_, [&parts, group_num, block_num](const Entry & entry) {
+            parts[IndexUtils<KeyType>::Hash(entry.first) % block_num / group_num].emplace_back(entry);
+        });
+        if (s != Status::SUCCESS) {
+            return s;
+        }
+        for (uint64_t i = 0; i < parts.size(); ++i) {
+            uint64_t part = partition_id_ + i * group_num;
+            auto & data = parts[i];
+            /// the newest version goes first, so that it survives the dedup
+            std::reverse(data.begin(), data.end());
+            s = BuildPartitionBlock(data, (*blocks_)[part], seed_, fp_bits_);
+            if (s != Status::SUCCESS) {
+                return s;
+            }
+            if (output_ != nullptr) {
+                /// |data| is sorted now
+                std::lock_guard<std::mutex> latch{*output_latch_};
+                for (auto & entry : data) {
+                    s = output_->WriteData(part, entry.first, entry.second);
+                    if (s != Status::SUCCESS) {
+                        return s;
+                    }
+                }
+            }
+            std::vector<Entry>{}.swap(data);
+        }
+        return Status::SUCCESS;
+    }
+
+    /// The memory budget is shared by the partitions of the batch
+    auto buildExternal(uint64_t group_num, uint64_t block_num) -> Status {
+        std::vector<std::unique_ptr<ExternalEntryFile<KeyType, ValueType>>> parts{};
+        for (uint64_t i = 0; i < block_num / group_num; ++i) {
+            parts.emplace_back(std::make_unique<ExternalEntryFile<KeyType, ValueType>>(
+                    FetchNextSpillFilePrefix(spill_directory_), memory_budget_ / (block_num / group_num)));
+        }
+        auto s = file_handle_->ScanData(partition_id_, [&parts, group_num, block_num](const Entry & entry) {
+            parts[IndexUtils<KeyType>::Hash(entry.first) % block_num / group_num]->Append(entry);
+        });
+        if (s != Status::SUCCESS) {
+            return s;
+        }
+        for (uint64_t i = 0; i < parts.size(); ++i) {
+            s = buildSinglePartitionExternal(*parts[i], partition_id_ + i * group_num, seed_, fp_bits_);
+            if (s != Status::SUCCESS) {
+                return s;
+            }
+            parts[i].reset();
+        }
+        return Status::SUCCESS;
+    }
+
+    auto buildSinglePartitionExternal(
+            ExternalEntryFile<KeyType, ValueType> & entries,
+            uint64_t part,
+            uint64_t seed,
+            uint64_t fp_bits) -> Status {
+        auto s = entries.Finish();
+        if (s != Status::SUCCESS) {
+            return s;
+        }
+
+        auto & block = (*blocks_)[part];
+        const size_t round = 20;
+        bool built = false;
+        for (size_t i = 0; i < round && !built; ++i) {
+            ExternalEdgeFile<ValueType> edges{FetchNextSpillFilePrefix(spill_directory_), memory_budget_};
+            s = entries.Scan([&edges, seed](const Entry & entry) {
+                size_t length = 0;
+                auto buf = IndexUtils<KeyType>::RawBuffer(entry.first, &length);
+                edges.Append(IndexEdge<ValueType>(buf.get(), length, entry.second, seed));
+            });
+            if (s != Status::SUCCESS) {
+                return s;
+            }
+            s = edges.Finish();
+            if (s != Status::SUCCESS) {
+                return s;
+            }
+            built = block.TryBuildExternal(edges, seed, fp_bits) == Status::SUCCESS;
+            seed += 114514;
+        }
+        if (!built) {
+            return Status::ERROR;
+        }
+        if (output_ == nullptr) {
+            return Status::SUCCESS;
+        }
+
+        /// the newest versions are merged again, straight into the output
+        std::lock_guard<std::mutex> latch{*output_latch_};
+        auto write_status = Status::SUCCESS;
+        s = entries.Scan([this, part, &write_status](const Entry & entry) {
+            if (write_status == Status::SUCCESS) {
+                write_status = output_->WriteData(part, entry.first, entry.second);
+            }
+        });
+        return s != Status::SUCCESS ? s : write_status;
+    }
+
+    /// input
+    FileHandlePtr file_handle_;
+    uint64_t partition_id_;
+
+    /// output, owned by the caller
+    Blocks * blocks_;
+
+    uint64_t seed_;
+
+    uint64_t fp_bits_;
+
+    /// Memory budget of the spilled entries & edges, 0 for building in memory
+    size_t memory_budget_;
+
+    /// Directory of the spilled entries & edges
+    std::string spill_directory_;
+
+    /// File the sorted runs are written to, none if it's null
+    FileHandlePtr output_;
+    std::mutex * output_latch_;
+};
+
+}  // namespace ssindex
@@ -4,15 +4,23 @@
 #include "ssindex.hpp"
 #include "scheduler.hpp"
 #include "index_block.hpp"
+#include "task_build_partition.hpp"
 
 #include <unordered_map>
+#include <functional>
 #include <vector>
 #include <memory>
+#include <algorithm>
 
 namespace ssindex {
 
-/// TODO: the current implementation doesn't deal with multi-version garbage
-/// collection, we need to implement it later.
+/// Only the newest version of each key survives, and each partition of the
+/// compacted file is a sorted run.
+///
+/// The compacted batch picks its number of partitions from the number of
+/// entries of the candidates (see |ChoosePartitionNum|), whatever theirs,
+/// so that partitions of a growing batch are split and its blocks stay
+/// about the same size.
 template<typename KeyType, typename ValueType>
 struct CompactionTask : public Task {
     using FileHandlePtr = std::shared_ptr<IndexArchivedFile<KeyType, ValueType>>;
@@ -20,21 +28,26 @@ struct CompactionTask : public Task {
     using Batch = std::pair<Blocks, FileHandlePtr>;
 
     explicit CompactionTask(const std::vector<Batch> & candidates,
-                               uint64_t block_num,
                                /*std::function<uint64_t(const KeyType &)> partitioner,*/
                                uint64_t seed = 0x12345678,
-                               uint64_t fp_bits = 0
+                               uint64_t fp_bits = 0,
+                               const std::string & directory = default_working_directory
                                )
             : candidates_(candidates),
-              block_num_(block_num),
+              block_num_(ChoosePartitionNum(countEntries(candidates))),
               seed_(seed),
               fp_bits_(fp_bits),
-              file_handle_(std::make_shared<IndexArchivedFile<KeyType, ValueType>>(FetchNextArchivedFileName(), block_num))
+              file_handle_(std::make_shared<IndexArchivedFile<KeyType, ValueType>>(FetchNextArchivedFileName(directory), block_num_))
               /*partitioner_(partitioner)*/ {
     }
 
     ~CompactionTask() override = default;
 
+    /// |listener| is called for every entry dropped by a newer version
+    void SetDropListener(std::function<void(const std::pair<KeyType, ValueType> &)> listener) {
+        drop_listener_ = std::move(listener);
+    }
+
     void SetAcceptor(std::shared_ptr<IndexArchivedFile<KeyType, ValueType>> & acc_1, std::vector<IndexBlock<ValueType>> & acc_2) {
         SetPostExecute([this, &acc_1, &acc_2]{
             acc_1 = std::move(file_handle_);
@@ -45,82 +58,75 @@ struct CompactionTask : public Task {
     /// TODO: increase |level_| in new batch
     Status Execute() override {
         //std::cout << "/// Compaction Start ...... ///" << std::endl;
-        /// build each partition one by one
-        for (uint64_t part = 0; part < block_num_; ++part) {
-            /// for a single partition, load the data, build blocks & new file
-            /// handle, and emplace the results back.
-            std::vector<std::pair<KeyType, ValueType>> part_raw_data{};
-            for (auto file_iter = candidates_.begin(); file_iter != candidates_.end(); ++file_iter) {
-                IndexArchivedFile<KeyType, ValueType> * file_handle_ptr = file_iter->second.get();
-                auto data_collector = [this, part](const std::pair<KeyType, ValueType> & entry) {
-                    file_handle_->WriteData(part, entry.first, entry.second);
-                };
-                auto s = file_handle_ptr->ReadData(part, part_raw_data, data_collector);
+        /// every partition of the candidates is read once, group by group
+        /// (see |RepartitionedReader|), and a group is split into the
+        /// partitions of the compacted batch
+        std::vector<FileHandlePtr> files{};
+        for (auto & candidate : candidates_) {
+            files.emplace_back(candidate.second);
+        }
+        RepartitionedReader<KeyType, ValueType> reader{std::move(files), block_num_};
+        uint64_t group_num = reader.GetGroupNum();
+        blocks_ = Blocks(block_num_);
+        for (uint64_t group = 0; group < group_num; ++group) {
+            std::vector<std::vector<std::pair<KeyType, ValueType>>> parts(block_num_ / group_num);
+            auto s = reader.ScanGroup(group, [this, group_num, &parts](size_t, const std::pair<KeyType, ValueType> & entry) {
+                parts[IndexUtils<KeyType>::Hash(entry.first) % block_num_ / group_num].emplace_back(entry);
+            });
+            if (s != Status::SUCCESS) {
+                return s;
+            }
+            for (uint64_t i = 0; i < parts.size(); ++i) {
+                uint64_t part = group + i * group_num;
+                auto & part_raw_data = parts[i];
+                /// candidates are read from the oldest to the newest, the newest
+                /// version goes first, so that it survives the dedup
+                std::reverse(part_raw_data.begin(), part_raw_data.end());
+                s = BuildPartitionBlock(part_raw_data, blocks_[part], seed_, fp_bits_, drop_listener_);
                 if (s != Status::SUCCESS) {
                     return s;
                 }
+                /// only the newest versions are kept, as a sorted run
+                for (auto & entry : part_raw_data) {
+                    s = file_handle_->WriteData(part, entry.first, entry.second);
+                    if (s != Status::SUCCESS) {
+                        return s;
+                    }
+                }
+                std::vector<std::pair<KeyType, ValueType>>{}.swap(part_raw_data);
             }
-            IndexBlock<ValueType> part_blk{};
-            auto s = buildSinglePartition(part_raw_data, part_blk, seed_, fp_bits_);
-            if (s != Status::SUCCESS) {
-                return s;
-            }
-            blocks_.emplace_back(part_blk);
         }
 
         //std::cout << "/// Compaction Finished ...... ///" << std::endl;
-        return Status::SUCCESS;
+        /// the batch is read-only from now on
+        return file_handle_->Freeze();
     }
 
-    /// TODO: merge this method with flush memtable task
-    auto buildSinglePartition(
-            std::vector<std::pair<KeyType, ValueType>> & data,
-            IndexBlock<ValueType> & block,
-            uint64_t seed,
-            uint64_t fp_bits) -> Status {
-        if (data.size() == 0) {
-            return Status::SUCCESS;
+    /// Number of entries of |candidates|, the versions dropped included
+    static auto countEntries(const std::vector<Batch> & candidates) -> uint64_t {
+        uint64_t num = 0;
+        for (auto & candidate : candidates) {
+            num += candidate.second->GetEntryNum();
         }
-        std::stable_sort(data.begin(), data.end(),
-                         [](const std::pair<KeyType, ValueType> & v1, const std::pair<KeyType, ValueType> & v2) -> bool {
-                             return v1.first < v2.first;
-                         });
-        data.erase(std::unique(data.begin(), data.end(),
-                               [](const std::pair<KeyType, ValueType> & v1, const std::pair<KeyType, ValueType> & v2) -> bool {
-                                   return v1.first == v2.first;
-                               }), data.end());
-
-        const size_t round = 20;
-        for (size_t i = 0; i < round; ++i) {
-            std::vector<IndexEdge<ValueType>> ies;
-            ies.reserve(data.size());
-            for (size_t j = 0; j < data.size(); ++j) {
-                size_t length = 0;
-                auto buf = IndexUtils<KeyType>::RawBuffer(data[j].first, &length);
-                ies.emplace_back(IndexEdge<ValueType>(buf.get(), length, data[j].second, seed));
-            }
-            if (block.TryBuild(ies, seed, fp_bits) == Status::SUCCESS) {
-                return Status::SUCCESS;
-            }
-            seed += 114514;
-            //block = IndexBlock<ValueType>{};
-        }
-        return Status::ERROR;
+        return num;
     }
 
     /// input
     std::vector<Batch> candidates_;
 
+    /// declared before |file_handle_|, which is created with it
+    uint64_t block_num_;
+
     /// outputs
     FileHandlePtr file_handle_;
     Blocks blocks_;
 
-    uint64_t block_num_;
-
     uint64_t seed_;
 
     uint64_t fp_bits_;
 
+    std::function<void(const std::pair<KeyType, ValueType> &)> drop_listener_;
+
     //std::function<uint64_t(const KeyType &)> partitioner_;
 };
 
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "index_common.hpp"
+#include "scheduler.hpp"
+#include "block_residency.hpp"
+
+#include <mutex>
+#include <shared_mutex>
+
+namespace ssindex {
+
+/// |EvictBlocksTask| evicts the blocks of an index down to its budget off
+/// the read path (see |BlockResidency|): the victims are written to the
+/// block files with the batches locked shared, so the reads go on, then
+/// released once the batches are locked exclusively.
+template<typename ValueType>
+struct EvictBlocksTask : public Task {
+    /// |batch_latch| is the batch lock of the index owning |residency|
+    explicit EvictBlocksTask(BlockResidency<ValueType> * residency, std::shared_mutex * batch_latch)
+        : residency_(residency), batch_latch_(batch_latch) {}
+
+    ~EvictBlocksTask() override = default;
+
+    Status Execute() override {
+        {
+            std::shared_lock<std::shared_mutex> r_latch{*batch_latch_};
+            /// the victims which failed to be written stay resident, and
+            /// they're counted in |BlockResidencyStats::spill_failures_|
+            residency_->PrepareEviction();
+        }
+        std::lock_guard<std::shared_mutex> w_latch{*batch_latch_};
+        residency_->Evict();
+        return Status::SUCCESS;
+    }
+
+    BlockResidency<ValueType> * residency_;
+
+    std::shared_mutex * batch_latch_;
+};
+
+}  // namespace ssindex
@@ -4,29 +4,36 @@
 #include "ssindex.hpp"
 #include "scheduler.hpp"
 #include "index_block.hpp"
+#include "task_build_partition.hpp"
+#include "memtable.hpp"
 
 #include <unordered_map>
 #include <vector>
 #include <memory>
+#include <algorithm>
 
 namespace ssindex {
 
 template<typename KeyType, typename ValueType>
 struct FlushMemtableTask : public Task {
-    explicit FlushMemtableTask(const std::unordered_map<KeyType, ValueType> & candidate,
+    /// The task shares the immutable memtable with the readers, which
+    /// must never change it, and the archived file is only created when
+    /// the task runs, so that the rotation doesn't copy or allocate. The
+    /// batch picks its number of partitions from the size of the memtable
+    /// (see |ChoosePartitionNum|), and one block is built per partition
+    /// from the tables of the memtable holding its keys.
+    explicit FlushMemtableTask(std::shared_ptr<const PartitionedMemtable<KeyType, ValueType>> candidate,
                                uint64_t memtable_id,
-                               uint64_t block_num,
-                               std::function<uint64_t(const KeyType &)> partitioner,
                                uint64_t seed = 0x12345678,
-                               uint64_t fp_bits = 0
+                               uint64_t fp_bits = 0,
+                               const std::string & directory = default_working_directory
                                )
-        : candidate_(candidate),
+        : candidate_(std::move(candidate)),
           memtable_id_(memtable_id),
-          block_num_(block_num),
+          block_num_(ChoosePartitionNum(candidate_->Size())),
           seed_(seed),
           fp_bits_(fp_bits),
-          file_handle_(std::make_shared<IndexArchivedFile<KeyType, ValueType>>(FetchNextArchivedFileName(), block_num)),
-          partitioner_(partitioner) {
+          directory_(directory) {
     }
 
     ~FlushMemtableTask() override = default;
@@ -39,69 +46,48 @@ struct FlushMemtableTask : public Task {
     }
 
     Status Execute() override {
-        //file_handle_ = std::make_unique<IndexArchivedFile<KeyType, ValueType>>(FetchNextArchivedFileName(), block_num_);
-        for (auto iter = candidate_.begin(); iter != candidate_.end(); ++iter) {
-            auto partition = static_cast<size_t>(partitioner_(iter->first));
-            auto s = file_handle_->WriteData(partition, iter->first, iter->second);
-            if (s != Status::SUCCESS) {
-                return s;
+        file_handle_ = std::make_shared<IndexArchivedFile<KeyType, ValueType>>(FetchNextArchivedFileName(directory_), block_num_);
+        /// tables and blocks nest into groups (see |ForEachGroupPartition|),
+        /// every table is iterated once and split into the blocks of its group
+        auto table_num = candidate_->PartitionNum();
+        auto group_num = std::min<uint64_t>(table_num, block_num_);
+        blocks_ = std::vector<IndexBlock<ValueType>>(block_num_);
+        for (uint64_t group = 0; group < group_num; ++group) {
+            std::vector<std::vector<std::pair<KeyType, ValueType>>> parts(block_num_ / group_num);
+            ForEachGroupPartition(table_num, group_num, group, [&](uint64_t table_id) {
+                auto & table = candidate_->Partition(table_id);
+                if (parts.size() == 1) {
+                    parts[0].insert(parts[0].end(), table.begin(), table.end());
+                    return;
+                }
+                for (auto & entry : table) {
+                    parts[IndexUtils<KeyType>::Hash(entry.first) % block_num_ / group_num].emplace_back(entry);
+                }
+            });
+            for (uint64_t i = 0; i < parts.size(); ++i) {
+                uint64_t part = group + i * group_num;
+                auto & data = parts[i];
+                auto s = BuildPartitionBlock(data, blocks_[part], seed_, fp_bits_);
+                if (s != Status::SUCCESS) {
+                    return s;
+                }
+                /// |data| is sorted now, so the partition is written as a sorted run
+                for (auto & entry : data) {
+                    s = file_handle_->WriteData(part, entry.first, entry.second);
+                    if (s != Status::SUCCESS) {
+                        return s;
+                    }
+                }
+                std::vector<std::pair<KeyType, ValueType>>{}.swap(data);
             }
         }
 
-        for (uint64_t i = 0; i < block_num_; ++i) {
-            std::vector<std::pair<KeyType, ValueType>> data{};
-            auto s = file_handle_->ReadData(i, data);
-            if (s != Status::SUCCESS) {
-                return s;
-            }
-            IndexBlock<ValueType> blk{};
-            s = buildSinglePartition(data, blk, seed_, fp_bits_);
-            if (s != Status::SUCCESS) {
-                return s;
-            }
-            blocks_.emplace_back(blk);
-        }
-
-        return Status::SUCCESS;
-    }
-
-    auto buildSinglePartition(
-            std::vector<std::pair<KeyType, ValueType>> & data,
-            IndexBlock<ValueType> & block,
-            uint64_t seed,
-            uint64_t fp_bits) -> Status {
-        if (data.size() == 0) {
-            return Status::SUCCESS;
-        }
-        std::stable_sort(data.begin(), data.end(),
-                [](const std::pair<KeyType, ValueType> & v1, const std::pair<KeyType, ValueType> & v2) -> bool {
-            return v1.first < v2.first;
-        });
-        data.erase(std::unique(data.begin(), data.end(),
-                [](const std::pair<KeyType, ValueType> & v1, const std::pair<KeyType, ValueType> & v2) -> bool {
-            return v1.first == v2.first;
-        }), data.end());
-
-        const size_t round = 20;
-        for (size_t i = 0; i < round; ++i) {
-            std::vector<IndexEdge<ValueType>> ies;
-            ies.reserve(data.size());
-            for (size_t j = 0; j < data.size(); ++j) {
-                size_t length = 0;
-                auto buf = IndexUtils<KeyType>::RawBuffer(data[j].first, &length);
-                ies.emplace_back(IndexEdge<ValueType>(buf.get(), length, data[j].second, seed));
-            }
-            if (block.TryBuild(ies, seed, fp_bits) == Status::SUCCESS) {
-                return Status::SUCCESS;
-            }
-            seed += 114514;
-            //block = IndexBlock<ValueType>{};
-        }
-        return Status::ERROR;
+        /// the batch is read-only from now on
+        return file_handle_->Freeze();
     }
 
     /// input
-    std::unordered_map<KeyType, ValueType> candidate_;
+    std::shared_ptr<const PartitionedMemtable<KeyType, ValueType>> candidate_;
 
     /// outputs
     std::shared_ptr<IndexArchivedFile<KeyType, ValueType>> file_handle_;
@@ -115,7 +101,7 @@ struct FlushMemtableTask : public Task {
 
     uint64_t fp_bits_;
 
-    std::function<uint64_t(const KeyType &)> partitioner_;
+    std::string directory_;
 };
 
 }  // namespace ssindex
\ No newline at end of file
@@ -0,0 +1,244 @@
+#include "value_log.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace ssindex {
+
+/// A segment file of a |ValueLog|, mapped as a whole
+class ValueLogSegment {
+public:
+    explicit ValueLogSegment(uint64_t id, std::string path) : id_(id), path_(std::move(path)) {}
+
+    ~ValueLogSegment() {
+        if (addr_ != nullptr) {
+            munmap(addr_, capacity_);
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    auto Open(size_t capacity) -> Status {
+        fd_ = ::open(path_.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd_ < 0 || ftruncate(fd_, static_cast<off_t>(capacity)) != 0) {
+            return Status::ERROR;
+        }
+        void * addr = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (addr == MAP_FAILED) {
+            return Status::ERROR;
+        }
+        addr_ = static_cast<char *>(addr);
+        capacity_ = capacity;
+        return Status::SUCCESS;
+    }
+
+    /// Shrink the file to the records, the map is kept but never read
+    /// beyond them
+    void Seal() {
+        sealed_ = true;
+        if (ftruncate(fd_, static_cast<off_t>(size_.load())) != 0) {
+            std::cerr << "Cannot shrink value log segment | " << path_ << std::endl;
+        }
+    }
+
+    uint64_t id_;
+
+    std::string path_;
+
+    int fd_ = -1;
+
+    char * addr_ = nullptr;
+
+    size_t capacity_ = 0;
+
+    /// Bytes of the records, published after the records are written
+    std::atomic<size_t> size_{0};
+
+    /// Bytes of the dead records
+    std::atomic<size_t> dead_{0};
+
+    /// Guarded by the mutex of the log
+    bool sealed_ = false;
+};
+
+namespace {
+
+struct RecordHeader {
+    uint32_t klen_;
+    uint32_t vlen_;
+};
+
+inline auto recordSize(size_t klen, size_t vlen) -> size_t {
+    return (sizeof(RecordHeader) + klen + vlen + 7) & ~size_t(7);
+}
+
+constexpr uint64_t offsetMask = (1LLU << ValueRefOffsetBits) - 1;
+
+/// Parse the record at |offset|, it fails unless the whole record lies in
+/// the published bytes
+auto parseRecord(const ValueLogSegment & segment, uint64_t offset, ValueView * view) -> Status {
+    size_t size = segment.size_.load(std::memory_order_acquire);
+    if (offset % 8 != 0 || offset + sizeof(RecordHeader) > size) {
+        return Status::NOT_FOUND;
+    }
+    RecordHeader header{};
+    memcpy(&header, segment.addr_ + offset, sizeof(header));
+    if (offset + recordSize(header.klen_, header.vlen_) > size) {
+        return Status::NOT_FOUND;
+    }
+    const char * key = segment.addr_ + offset + sizeof(RecordHeader);
+    view->key_ = std::string_view{key, header.klen_};
+    view->value_ = std::string_view{key + header.klen_, header.vlen_};
+    return Status::SUCCESS;
+}
+
+}  // namespace
+
+ValueLog::ValueLog(std::string directory, size_t segment_size)
+        : directory_(std::move(directory)),
+          segment_size_(segment_size),
+          next_segment_id_(0) {
+    std::filesystem::create_directories(directory_);
+}
+
+ValueLog::~ValueLog() = default;
+
+auto ValueLog::openSegment() -> Status {
+    auto id = next_segment_id_++;
+    auto path = (std::filesystem::path(directory_) / (std::to_string(id) + ".vlog")).string();
+    auto segment = std::make_shared<ValueLogSegment>(id, path);
+    auto s = segment->Open(segment_size_);
+    if (s != Status::SUCCESS) {
+        std::cerr << "Cannot open value log segment | " << path << std::endl;
+        return s;
+    }
+    segments_.emplace(id, segment);
+    active_ = std::move(segment);
+    return Status::SUCCESS;
+}
+
+auto ValueLog::Append(const char * key, size_t klen, const char * value, size_t vlen,
+                      ValueRef * ref, bool * sealed) -> Status {
+    size_t record = recordSize(klen, vlen);
+    if (record > segment_size_ || klen > UINT32_MAX || vlen > UINT32_MAX) {
+        return Status::ERROR;
+    }
+    std::lock_guard<std::shared_mutex> w_latch{mutex_};
+    if (sealed != nullptr) {
+        *sealed = false;
+    }
+    if (active_ != nullptr && active_->size_.load() + record > active_->capacity_) {
+        active_->Seal();
+        active_.reset();
+        if (sealed != nullptr) {
+            *sealed = true;
+        }
+    }
+    if (active_ == nullptr) {
+        auto s = openSegment();
+        if (s != Status::SUCCESS) {
+            return s;
+        }
+    }
+
+    size_t offset = active_->size_.load();
+    RecordHeader header{static_cast<uint32_t>(klen), static_cast<uint32_t>(vlen)};
+    char * dest = active_->addr_ + offset;
+    memcpy(dest, &header, sizeof(header));
+    memcpy(dest + sizeof(header), key, klen);
+    memcpy(dest + sizeof(header) + klen, value, vlen);
+    active_->size_.store(offset + record, std::memory_order_release);
+    *ref = (active_->id_ << ValueRefOffsetBits) | offset;
+    return Status::SUCCESS;
+}
+
+auto ValueLog::findSegment(uint64_t segment_id) const -> std::shared_ptr<ValueLogSegment> {
+    std::shared_lock<std::shared_mutex> r_latch{mutex_};
+    auto iter = segments_.find(segment_id);
+    return iter == segments_.end() ? nullptr : iter->second;
+}
+
+auto ValueLog::Read(ValueRef ref, ValueView * view) const -> Status {
+    auto segment = findSegment(ref >> ValueRefOffsetBits);
+    if (segment == nullptr) {
+        return Status::NOT_FOUND;
+    }
+    auto s = parseRecord(*segment, ref & offsetMask, view);
+    if (s != Status::SUCCESS) {
+        return s;
+    }
+    view->segment_ = std::move(segment);
+    return Status::SUCCESS;
+}
+
+void ValueLog::MarkDead(ValueRef ref) {
+    auto segment = findSegment(ref >> ValueRefOffsetBits);
+    ValueView view{};
+    if (segment == nullptr || parseRecord(*segment, ref & offsetMask, &view) != Status::SUCCESS) {
+        return;
+    }
+    segment->dead_ += recordSize(view.key_.size(), view.value_.size());
+}
+
+auto ValueLog::CollectCandidates(double ratio) const -> std::vector<uint64_t> {
+    std::shared_lock<std::shared_mutex> r_latch{mutex_};
+    std::vector<uint64_t> candidates{};
+    for (auto & [id, segment] : segments_) {
+        if (segment->sealed_ && double(segment->dead_.load()) >= ratio * double(segment->size_.load())) {
+            candidates.emplace_back(id);
+        }
+    }
+    return candidates;
+}
+
+auto ValueLog::ScanSegment(uint64_t segment_id, const std::function<void(ValueRef, const ValueView &)> & consumer) const -> Status {
+    auto segment = findSegment(segment_id);
+    if (segment == nullptr) {
+        return Status::NOT_FOUND;
+    }
+    size_t size = segment->size_.load(std::memory_order_acquire);
+    for (uint64_t offset = 0; offset < size;) {
+        ValueView view{};
+        auto s = parseRecord(*segment, offset, &view);
+        if (s != Status::SUCCESS) {
+            return Status::ERROR;
+        }
+        view.segment_ = segment;
+        consumer((segment_id << ValueRefOffsetBits) | offset, view);
+        offset += recordSize(view.key_.size(), view.value_.size());
+    }
+    return Status::SUCCESS;
+}
+
+void ValueLog::DropSegment(uint64_t segment_id) {
+    std::lock_guard<std::shared_mutex> w_latch{mutex_};
+    auto iter = segments_.find(segment_id);
+    if (iter == segments_.end() || iter->second == active_) {
+        return;
+    }
+    /// the file goes away, but the map lives on until the last view
+    std::filesystem::remove(iter->second->path_);
+    segments_.erase(iter);
+}
+
+auto ValueLog::GetSegmentNum() const -> size_t {
+    std::shared_lock<std::shared_mutex> r_latch{mutex_};
+    return segments_.size();
+}
+
+auto ValueLog::GetDiskUsage() const -> uint64_t {
+    std::shared_lock<std::shared_mutex> r_latch{mutex_};
+    uint64_t sum = 0;
+    for (auto & [id, segment] : segments_) {
+        sum += segment->size_.load();
+    }
+    return sum;
+}
+
+}  // namespace ssindex
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <shared_mutex>
+
+#include "index_common.hpp"
+
+namespace ssindex {
+
+/// Reference of a record in a |ValueLog|: the segment id in the high bits,
+/// and the offset within the segment in the low |ValueRefOffsetBits| bits
+using ValueRef = uint64_t;
+
+static constexpr uint64_t ValueRefOffsetBits = 40;
+
+class ValueLogSegment;
+
+/// A record read from a |ValueLog|. It points right into the mapped
+/// segment, which stays mapped as long as the view is alive, even if the
+/// segment is collected meanwhile.
+struct ValueView {
+    std::string_view key_;
+    std::string_view value_;
+    std::shared_ptr<const ValueLogSegment> segment_;
+};
+
+/// Value Log
+///
+/// Records are appended to fixed-size segment files, which are mapped in
+/// memory, so that a read is a bounds check and a pointer into the map.
+/// A record is "<key length><value length><key><value>", 8-byte aligned,
+/// and once a record doesn't fit, the segment is sealed and a new one is
+/// opened.
+///
+/// The log doesn't know which records are live, the owner reports the
+/// dead ones through |MarkDead|, and collects the sealed segments holding
+/// enough garbage by moving their live records (see |ScanSegment|) and
+/// dropping them.
+class ValueLog {
+public:
+    explicit ValueLog(std::string directory, size_t segment_size = DefaultValueLogSegmentSize);
+
+    ~ValueLog();
+
+    /// Append a record, |*sealed| is set if the active segment got sealed
+    auto Append(const char * key, size_t klen, const char * value, size_t vlen,
+                ValueRef * ref, bool * sealed = nullptr) -> Status;
+
+    /// Read the record of |ref|, a reference not pointing to a record
+    /// boundary of a live segment fails with |Status::NOT_FOUND|. A random
+    /// reference may still hit a boundary, so the key must be checked.
+    auto Read(ValueRef ref, ValueView * view) const -> Status;
+
+    /// Account the record of |ref| as garbage, references of dropped
+    /// segments are ignored
+    void MarkDead(ValueRef ref);
+
+    /// Sealed segments having at least |ratio| of their bytes as garbage
+    auto CollectCandidates(double ratio) const -> std::vector<uint64_t>;
+
+    /// Visit all the records of a segment
+    auto ScanSegment(uint64_t segment_id, const std::function<void(ValueRef, const ValueView &)> & consumer) const -> Status;
+
+    /// Drop a segment and remove its file
+    void DropSegment(uint64_t segment_id);
+
+    auto GetSegmentNum() const -> size_t;
+
+    /// Number of bytes of the records in all the segments
+    auto GetDiskUsage() const -> uint64_t;
+
+private:
+    /// Open a new active segment, the caller must hold |mutex_|
+    auto openSegment() -> Status;
+
+    auto findSegment(uint64_t segment_id) const -> std::shared_ptr<ValueLogSegment>;
+
+    std::string directory_;
+
+    size_t segment_size_;
+
+    mutable std::shared_mutex mutex_;
+
+    std::map<uint64_t, std::shared_ptr<ValueLogSegment>> segments_;
+
+    /// Segment records are appended to, it's also in |segments_|
+    std::shared_ptr<ValueLogSegment> active_;
+
+    uint64_t next_segment_id_;
+};
+
+}  // namespace ssindex
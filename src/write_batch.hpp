@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include "index_common.hpp"
+
+namespace ssindex {
+
+/// A batch of writes applied by |SsIndex::Write| under a single memtable
+/// lock acquisition. Keys are hashed when they're put into the batch,
+/// i.e. out of the lock, and a key put twice takes the last value.
+template<typename KeyType, typename ValueType>
+class WriteBatch {
+public:
+    struct Entry {
+        KeyType key_;
+        ValueType value_;
+        /// |IndexUtils::Hash| of the key
+        uint64_t hash_;
+    };
+
+    explicit WriteBatch(size_t reserved = 0) {
+        entries_.reserve(reserved);
+    }
+
+    void Put(const KeyType & key, const ValueType & value) {
+        entries_.emplace_back(Entry{key, value, IndexUtils<KeyType>::Hash(key)});
+    }
+
+    auto Entries() const -> const std::vector<Entry> & {
+        return entries_;
+    }
+
+    auto Size() const -> size_t {
+        return entries_.size();
+    }
+
+    auto Empty() const -> bool {
+        return entries_.empty();
+    }
+
+    void Clear() {
+        entries_.clear();
+    }
+
+private:
+    std::vector<Entry> entries_;
+};
+
+}  // namespace ssindex
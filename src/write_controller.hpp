@@ -0,0 +1,192 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#include "index_common.hpp"
+
+namespace ssindex {
+
+/// Thresholds of the write controller, a threshold of 0 disables the
+/// corresponding check.
+struct WriteControllerOptions {
+    /// Number of immutable memtables waiting to be flushed
+    uint64_t slowdown_immutable_num_ = DefaultSlowdownImmutableNum;
+    uint64_t stop_immutable_num_ = DefaultStopImmutableNum;
+
+    /// Bytes of archived data waiting to be compacted
+    uint64_t slowdown_pending_compaction_bytes_ = DefaultSlowdownPendingCompactionBytes;
+    uint64_t stop_pending_compaction_bytes_ = DefaultStopPendingCompactionBytes;
+
+    /// Number of batches in the batch holder. Batches are only merged by
+    /// compactions, which don't run automatically with the default
+    /// |CompactionThreshold|, so both checks are off by default.
+    uint64_t slowdown_batch_num_ = 0;
+    uint64_t stop_batch_num_ = 0;
+
+    /// Delay per write when a slowdown threshold is just reached, it grows
+    /// linearly up to |max_delay_micros_| at the stop threshold
+    uint64_t min_delay_micros_ = 1;
+    uint64_t max_delay_micros_ = 100;
+};
+
+struct WriteStallStats {
+    /// Time writers spent blocked by a hard stall
+    uint64_t stall_micros_ = 0;
+    uint64_t stall_count_ = 0;
+
+    /// Time writers spent sleeping because of a slowdown
+    uint64_t delay_micros_ = 0;
+    uint64_t delay_count_ = 0;
+};
+
+/// |WriteController| matches the write rate with what the background
+/// flushes & compactions can sustain. The index reports its backlog
+/// (immutable memtables, pending compaction bytes, batches), and each
+/// writer calls |MaybeThrottle| before touching the memtable:
+///
+/// 1) Below every slowdown threshold, writes go through untouched.
+/// 2) Between a slowdown and the stop threshold, each write is charged a
+/// delay that grows with the backlog. Delays are accumulated and slept
+/// in chunks, since sleeping for a few microseconds is not accurate.
+/// 3) At a stop threshold, writers block until the backlog is drained.
+class WriteController {
+public:
+    /// Accumulated delay is slept once it exceeds this value
+    static constexpr uint64_t DelayChunkMicros = 1000;
+
+    explicit WriteController(WriteControllerOptions options = WriteControllerOptions{})
+        : options_(options),
+          immutable_num_(0),
+          pending_compaction_bytes_(0),
+          batch_num_(0),
+          delay_debt_micros_(0),
+          throttled_(false) {}
+
+    void SetImmutableNum(uint64_t num) {
+        update([this, num] { immutable_num_ = num; });
+    }
+
+    void SetBatchNum(uint64_t num) {
+        update([this, num] { batch_num_ = num; });
+    }
+
+    void AddPendingCompactionBytes(uint64_t bytes) {
+        update([this, bytes] { pending_compaction_bytes_ += bytes; });
+    }
+
+    void SubPendingCompactionBytes(uint64_t bytes) {
+        update([this, bytes] { pending_compaction_bytes_ -= std::min(bytes, pending_compaction_bytes_); });
+    }
+
+    /// Block or delay the calling writer according to the current backlog
+    void MaybeThrottle() {
+        if (!throttled_.load(std::memory_order_acquire)) {
+            return;
+        }
+        std::unique_lock<std::mutex> latch{mutex_};
+        if (isStopped()) {
+            auto start = std::chrono::steady_clock::now();
+            while (isStopped()) {
+                cv_.wait(latch);
+            }
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+            stats_.stall_micros_ += static_cast<uint64_t>(elapsed);
+            stats_.stall_count_++;
+        }
+
+        double pressure = slowdownPressure();
+        if (pressure <= 0) {
+            return;
+        }
+        auto delay = static_cast<uint64_t>(options_.min_delay_micros_ +
+                (options_.max_delay_micros_ - options_.min_delay_micros_) * pressure);
+        delay_debt_micros_ += delay;
+        if (delay_debt_micros_ < DelayChunkMicros) {
+            return;
+        }
+        uint64_t sleep_micros = delay_debt_micros_;
+        delay_debt_micros_ = 0;
+        stats_.delay_micros_ += sleep_micros;
+        stats_.delay_count_++;
+        latch.unlock();
+
+        std::this_thread::sleep_for(std::chrono::microseconds(sleep_micros));
+    }
+
+    auto GetStats() -> WriteStallStats {
+        std::lock_guard<std::mutex> latch{mutex_};
+        return stats_;
+    }
+
+    auto GetOptions() const -> const WriteControllerOptions & {
+        return options_;
+    }
+
+private:
+    template<typename Updater>
+    void update(Updater && updater) {
+        std::lock_guard<std::mutex> latch{mutex_};
+        updater();
+        throttled_.store(isStopped() || slowdownPressure() > 0, std::memory_order_release);
+        cv_.notify_all();
+    }
+
+    static auto reached(uint64_t value, uint64_t threshold) -> bool {
+        return threshold != 0 && value >= threshold;
+    }
+
+    /// How far |value| is between the two thresholds, in [0, 1]. Without
+    /// a stop threshold, the delay saturates at twice the slowdown one.
+    static auto progress(uint64_t value, uint64_t slowdown, uint64_t stop) -> double {
+        if (slowdown == 0 || value < slowdown) {
+            return 0;
+        }
+        if (stop == 0) {
+            stop = slowdown * 2;
+        }
+        if (stop <= slowdown) {
+            return 1;
+        }
+        return std::min(1.0, double(value - slowdown + 1) / double(stop - slowdown));
+    }
+
+    auto isStopped() const -> bool {
+        return reached(immutable_num_, options_.stop_immutable_num_) ||
+               reached(pending_compaction_bytes_, options_.stop_pending_compaction_bytes_) ||
+               reached(batch_num_, options_.stop_batch_num_);
+    }
+
+    auto slowdownPressure() const -> double {
+        return std::max({
+            progress(immutable_num_, options_.slowdown_immutable_num_, options_.stop_immutable_num_),
+            progress(pending_compaction_bytes_, options_.slowdown_pending_compaction_bytes_, options_.stop_pending_compaction_bytes_),
+            progress(batch_num_, options_.slowdown_batch_num_, options_.stop_batch_num_)
+        });
+    }
+
+    WriteControllerOptions options_;
+
+    /// Backlog reported by the index
+    uint64_t immutable_num_;
+    uint64_t pending_compaction_bytes_;
+    uint64_t batch_num_;
+
+    /// Delay charged to writers but not slept yet
+    uint64_t delay_debt_micros_;
+
+    WriteStallStats stats_;
+
+    /// Whether any threshold is reached, lets writers skip the mutex
+    std::atomic_bool throttled_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+}  // namespace ssindex
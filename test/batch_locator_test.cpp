@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include "../src/ssindex.hpp"
+
+namespace {
+
+/// Batch |b| holds keys [b * 10000, b * 10000 + 20000), so every key but
+/// the first ones shows up in two batches
+auto ExpectedValue(uint64_t key, uint64_t batch_num) -> uint64_t {
+    uint64_t batch = std::min(key / 10000, batch_num - 1);
+    return key * 10 + batch;
+}
+
+auto CountWrong(ssindex::SsIndex<std::string, uint64_t> & index, uint64_t batch_num) -> uint64_t {
+    uint64_t wrong = 0;
+    for (uint64_t key = 0; key < batch_num * 10000 + 10000; ++key) {
+        if (index.Get(std::to_string(key)) != ExpectedValue(key, batch_num)) {
+            wrong++;
+        }
+    }
+    return wrong;
+}
+
+}  // namespace
+
+TEST(TestBatchLocator, Basic) {
+    std::string work_directory = "/tmp/ssindex_locator/";
+    std::filesystem::remove_all(work_directory);
+
+    uint64_t batch_num = 8;
+    auto index = ssindex::SsIndex<std::string, uint64_t>(work_directory);
+    index.SetMemtableFlushThreshold(20000);
+    index.EnableBatchLocator();
+
+    for (uint64_t b = 0; b < batch_num; ++b) {
+        for (uint64_t key = b * 10000; key < b * 10000 + 20000; ++key) {
+            index.Set(std::to_string(key), key * 10 + b);
+        }
+    }
+    index.WaitTaskComplete();
+
+    /// every batch is covered, a single block is probed per key
+    index.RebuildBatchLocator();
+    EXPECT_EQ(0, CountWrong(index, batch_num));
+    /// an absent key is rejected by the block of an arbitrary batch, i.e.
+    /// at the false positive rate of a single batch (8 bits)
+    uint64_t false_positives = 0;
+    for (uint64_t i = 0; i < 1000; ++i) {
+        if (index.Get("not exist " + std::to_string(i)) != index.key_not_found) {
+            false_positives++;
+        }
+    }
+    EXPECT_LT(false_positives, 16);
+
+    /// batched lookups go through the locator as well
+    std::vector<std::string> keys{};
+    for (uint64_t key = 0; key < batch_num * 10000 + 10000; ++key) {
+        keys.emplace_back(std::to_string(key));
+    }
+    auto values = index.MultiGet(keys);
+    for (uint64_t key = 0; key < keys.size(); ++key) {
+        EXPECT_EQ(ExpectedValue(key, batch_num), values[key]);
+    }
+
+    /// a new batch is probed before the locator
+    for (uint64_t key = batch_num * 10000; key < batch_num * 10000 + 20000; ++key) {
+        index.Set(std::to_string(key), key * 10 + batch_num);
+    }
+    index.WaitTaskComplete();
+    batch_num++;
+    for (uint64_t key = (batch_num - 1) * 10000; key < batch_num * 10000 + 10000; ++key) {
+        EXPECT_EQ(ExpectedValue(key, batch_num), index.Get(std::to_string(key)));
+    }
+
+    /// compacted batches are remapped in the locator
+    index.RebuildBatchLocator();
+    index.Optimize();
+    EXPECT_EQ(0, CountWrong(index, batch_num));
+    std::cout << "Memory Usage: " << index.GetUsage() << " Bytes" << std::endl;
+}
+
+TEST(TestBatchLocator, Incremental) {
+    std::string work_directory = "/tmp/ssindex_locator_incremental/";
+    std::filesystem::remove_all(work_directory);
+
+    uint64_t batch_num = 16;
+    auto index = ssindex::SsIndex<std::string, uint64_t>(work_directory);
+    index.SetMemtableFlushThreshold(20000);
+    /// a segment is built every other flush, from the new batches only
+    index.EnableBatchLocator(2);
+
+    for (uint64_t b = 0; b < batch_num; ++b) {
+        for (uint64_t key = b * 10000; key < b * 10000 + 20000; ++key) {
+            index.Set(std::to_string(key), key * 10 + b);
+        }
+        index.WaitTaskComplete();
+        /// the segments grow geometrically
+        EXPECT_LE(index.GetLocatorSegmentNum(), 5);
+    }
+    EXPECT_GT(index.GetLocatorSegmentNum(), 0);
+    EXPECT_EQ(0, CountWrong(index, batch_num));
+
+    /// compacted batches are remapped in every segment
+    index.Optimize();
+    EXPECT_EQ(0, CountWrong(index, batch_num));
+    index.RebuildBatchLocator();
+    EXPECT_EQ(1, index.GetLocatorSegmentNum());
+    EXPECT_EQ(0, CountWrong(index, batch_num));
+}
@@ -16,4 +16,39 @@ TEST(TestBitVec, Basic) {
     std::cout << std::bitset<sizeof(ret)*8>(ret) << std::endl;
 
     //bv.printInfo();
-}
\ No newline at end of file
+}
+TEST(TestBitVec, Packed) {
+    using BV = ssindex::BitVec<uint64_t>;
+    const size_t bits_num = 10000;
+
+    for (size_t len : {1, 5, 8, 17, 32, 57}) {
+        BV bv{};
+        bv.Resize(bits_num);
+        std::vector<uint64_t> fields{};
+        for (size_t i = 0; (i + 1) * len <= bits_num; ++i) {
+            uint64_t field = (i * 0x9E3779B97F4A7C15LLU) & BV::lowBits(~0LLU, len);
+            bv.setBitsPacked(i * len, len, field);
+            fields.emplace_back(field);
+        }
+        for (size_t i = 0; i < fields.size(); ++i) {
+            EXPECT_EQ(fields[i], bv.getBitsPacked(i * len, len));
+            EXPECT_EQ(fields[i], bv.getBitsWide(i * len, len));
+            EXPECT_EQ(fields[i], bv.getBitsU64(i * len, len));
+        }
+    }
+
+    /// fields wider than a single unaligned load
+    for (size_t len : {58, 63, 64}) {
+        BV bv{};
+        bv.Resize(bits_num);
+        std::vector<uint64_t> fields{};
+        for (size_t i = 0; (i + 1) * len <= bits_num; ++i) {
+            uint64_t field = (i * 0x9E3779B97F4A7C15LLU) & BV::lowBits(~0LLU, len);
+            bv.setBitsU64(i * len, len, field);
+            fields.emplace_back(field);
+        }
+        for (size_t i = 0; i < fields.size(); ++i) {
+            EXPECT_EQ(fields[i], bv.getBitsWide(i * len, len));
+        }
+    }
+}
@@ -0,0 +1,213 @@
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <algorithm>
+#include <thread>
+
+#include "../src/ssindex.hpp"
+
+namespace {
+
+/// Evicts the blocks in the order they became resident, ignoring accesses
+class FifoPolicy : public ssindex::ResidencyPolicy {
+public:
+    void OnLoad(const ssindex::BlockKey & key) override {
+        std::lock_guard<std::mutex> latch{mutex_};
+        queue_.emplace_back(key);
+        loads_++;
+    }
+
+    void OnAccess(const ssindex::BlockKey & key) override {}
+
+    void OnRemove(const ssindex::BlockKey & key) override {
+        std::lock_guard<std::mutex> latch{mutex_};
+        queue_.erase(std::remove(queue_.begin(), queue_.end(), key), queue_.end());
+    }
+
+    auto PickVictim(ssindex::BlockKey * key) -> bool override {
+        std::lock_guard<std::mutex> latch{mutex_};
+        if (queue_.empty()) {
+            return false;
+        }
+        *key = queue_.front();
+        return true;
+    }
+
+    std::mutex mutex_;
+    std::deque<ssindex::BlockKey> queue_;
+    uint64_t loads_ = 0;
+};
+
+}  // namespace
+
+TEST(TestBlockResidency, Clock) {
+    std::string work_directory = "/tmp/ssindex_block_residency/";
+    std::filesystem::remove_all(work_directory);
+
+    const uint64_t entry_num = 100000;
+    ssindex::SsIndex<uint64_t, uint64_t> index{work_directory};
+    index.SetMemtableFlushThreshold(25000);
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        index.Set(i, i * 3);
+    }
+    /// a single batch, so that no newer batch answers a false positive
+    index.Optimize();
+    index.WaitTaskComplete();
+    auto full_usage = index.GetUsage();
+
+    /// a quarter of the blocks stays resident
+    size_t budget = full_usage / 4;
+    index.EnableBlockResidency(budget);
+    auto stats = index.GetBlockResidencyStats();
+    EXPECT_LE(stats.resident_bytes_, budget);
+    EXPECT_GT(stats.evictions_, 0);
+    EXPECT_LT(index.GetUsage(), full_usage);
+
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        ASSERT_EQ(i * 3, index.Get(i));
+    }
+    std::vector<uint64_t> keys{};
+    for (uint64_t i = 0; i < entry_num; i += 7) {
+        keys.emplace_back(i);
+    }
+    auto values = index.MultiGet(keys);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        ASSERT_EQ(keys[i] * 3, values[i]);
+    }
+    stats = index.GetBlockResidencyStats();
+    EXPECT_GT(stats.faults_, 0);
+
+    /// the blocks faulted in beyond the budget are evicted in the background
+    index.Get(0);
+    index.WaitTaskComplete();
+    EXPECT_LE(index.GetBlockResidencyStats().resident_bytes_, budget);
+}
+
+TEST(TestBlockResidency, ConcurrentReads) {
+    std::string work_directory = "/tmp/ssindex_block_residency_concurrent/";
+    std::filesystem::remove_all(work_directory);
+
+    const uint64_t entry_num = 100000;
+    ssindex::SsIndex<uint64_t, uint64_t> index{work_directory};
+    index.SetMemtableFlushThreshold(25000);
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        index.Set(i, i * 3);
+    }
+    index.Optimize();
+    index.WaitTaskComplete();
+    size_t budget = index.GetUsage() / 4;
+    index.EnableBlockResidency(budget);
+    auto evictions = index.GetBlockResidencyStats().evictions_;
+
+    /// the readers always hold the batches shared between them, which must
+    /// not keep the faulted blocks from being evicted
+    std::vector<std::thread> readers{};
+    for (uint64_t t = 0; t < 4; ++t) {
+        readers.emplace_back([&index, t] {
+            for (uint64_t i = t; i < entry_num; i += 4) {
+                ASSERT_EQ(i * 3, index.Get(i));
+            }
+        });
+    }
+    for (auto & reader : readers) {
+        reader.join();
+    }
+    index.Get(0);
+    index.WaitTaskComplete();
+    auto stats = index.GetBlockResidencyStats();
+    EXPECT_GT(stats.faults_, 0);
+    EXPECT_GT(stats.evictions_, evictions);
+    EXPECT_LE(stats.resident_bytes_, budget);
+}
+
+TEST(TestBlockResidency, PluggablePolicy) {
+    std::string work_directory = "/tmp/ssindex_block_residency_fifo/";
+    std::filesystem::remove_all(work_directory);
+
+    const uint64_t entry_num = 60000;
+    ssindex::SsIndex<uint64_t, uint64_t> index{work_directory};
+    index.SetMemtableFlushThreshold(20000);
+    auto policy = std::make_unique<FifoPolicy>();
+    auto * fifo = policy.get();
+    /// nothing stays resident but the block being probed
+    index.EnableBlockResidency(1, std::move(policy));
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        index.Set(i, i + 1);
+    }
+    index.WaitTaskComplete();
+    /// false positives of the newer batches are rejected by the files
+    for (uint64_t i = 0; i < entry_num; i += 3) {
+        ASSERT_EQ(i + 1, index.GetVerified(i));
+    }
+
+    /// compacted batches are dropped, the new one is tracked
+    index.Optimize();
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        ASSERT_EQ(i + 1, index.Get(i));
+    }
+    /// every probe faults its block in, as none stays resident
+    auto stats = index.GetBlockResidencyStats();
+    EXPECT_GT(stats.faults_, 0);
+    EXPECT_GT(stats.evictions_, 0);
+    EXPECT_GE(fifo->loads_, stats.faults_);
+}
+
+TEST(TestBlockResidency, FaultFailure) {
+    std::string work_directory = "/tmp/ssindex_block_residency_fault/";
+    std::filesystem::remove_all(work_directory);
+
+    const uint64_t entry_num = 20000;
+    ssindex::SsIndex<uint64_t, uint64_t> index{work_directory};
+    index.SetMemtableFlushThreshold(entry_num / 2);
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        index.Set(i, i + 1);
+    }
+    index.Optimize();
+    index.WaitTaskComplete();
+    index.EnableReadCache(1 << 20);
+    /// every block is evicted to the block files
+    index.EnableBlockResidency(1);
+
+    /// a read error is not a miss
+    for (auto & entry : std::filesystem::directory_iterator(work_directory)) {
+        if (entry.path().extension() == ".blk") {
+            std::filesystem::remove(entry.path());
+        }
+    }
+    ssindex::Status s = ssindex::Status::SUCCESS;
+    EXPECT_EQ(index.key_not_found, index.Get(7, &s));
+    EXPECT_EQ(ssindex::Status::ERROR, s);
+    index.MultiGet({7, 8}, &s);
+    EXPECT_EQ(ssindex::Status::ERROR, s);
+    index.GetVerified(7, &s);
+    EXPECT_EQ(ssindex::Status::ERROR, s);
+    /// and the error is not cached as an answer
+    index.Get(7, &s);
+    EXPECT_EQ(ssindex::Status::ERROR, s);
+}
+
+TEST(TestBlockResidency, SpillFailure) {
+    std::string work_directory = "/tmp/ssindex_block_residency_spill/";
+    std::filesystem::remove_all(work_directory);
+
+    const uint64_t entry_num = 20000;
+    ssindex::SsIndex<uint64_t, uint64_t> index{work_directory};
+    index.SetMemtableFlushThreshold(entry_num / 2);
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        index.Set(i, i + 1);
+    }
+    index.Optimize();
+    index.WaitTaskComplete();
+
+    /// the block files can't be created, the archived files stay open
+    std::filesystem::remove_all(work_directory);
+    index.EnableBlockResidency(1);
+    auto stats = index.GetBlockResidencyStats();
+    EXPECT_GT(stats.spill_failures_, 0);
+    EXPECT_EQ(0, stats.evictions_);
+    EXPECT_GT(stats.resident_bytes_, 1);
+
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        ASSERT_EQ(i + 1, index.Get(i));
+    }
+}
@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+#include <fstream>
+
+#include "../src/ssindex.hpp"
+#include "../src/external_entry_file.hpp"
+#include "../src/bulk_loader.hpp"
+
+TEST(TestBulkLoader, Basic) {
+    std::string work_directory = "/tmp/ssindex_bulk/";
+    std::string input_file = "/tmp/bulk_input.tsv";
+    std::filesystem::remove_all(work_directory);
+
+    uint64_t entry_num = 50000;
+    {
+        std::ofstream ofs(input_file);
+        for (uint64_t i = 0; i < entry_num; ++i) {
+            ofs << "key" << i << '\t' << i << '\n';
+        }
+        /// duplicated keys, the last value wins
+        for (uint64_t i = 0; i < 100; ++i) {
+            ofs << "key" << i << '\t' << i + entry_num << '\n';
+        }
+    }
+
+    auto index = ssindex::SsIndex<std::string, uint64_t>(work_directory);
+    EXPECT_EQ(ssindex::Status::SUCCESS, index.BulkLoad(input_file, 4));
+
+    uint64_t wrong = 0;
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        uint64_t expected = i < 100 ? i + entry_num : i;
+        if (index.Get("key" + std::to_string(i)) != expected) {
+            wrong++;
+        }
+    }
+    EXPECT_EQ(0, wrong);
+    /// the partitions are rewritten as sorted runs of the newest versions
+    for (uint64_t i = 0; i < 200; ++i) {
+        uint64_t expected = i < 100 ? i + entry_num : i;
+        ASSERT_EQ(expected, index.GetVerified("key" + std::to_string(i)));
+    }
+    std::cout << "Memory Usage: " << index.GetUsage() << " Bytes" << std::endl;
+
+    EXPECT_EQ(ssindex::Status::ERROR, index.BulkLoad("/tmp/not_exist.tsv"));
+
+    /// a malformed value fails the load instead of throwing, and the
+    /// partial files are removed
+    auto count_files = [&work_directory] {
+        auto it = std::filesystem::directory_iterator(work_directory);
+        return std::distance(std::filesystem::begin(it), std::filesystem::end(it));
+    };
+    auto file_num = count_files();
+    {
+        std::ofstream ofs(input_file);
+        ofs << "key0\t0\n" << "key1\tnot_a_number\n";
+    }
+    EXPECT_EQ(ssindex::Status::ERROR, index.BulkLoad(input_file));
+    EXPECT_EQ(ssindex::Status::ERROR, index.BulkLoad(input_file, 2, 32 << 10));
+    EXPECT_EQ(file_num, count_files());
+}
+
+TEST(TestBulkLoader, ExternalMemory) {
+    std::string work_directory = "/tmp/ssindex_bulk_ext/";
+    std::string input_file = "/tmp/bulk_input_ext.tsv";
+    std::filesystem::remove_all(work_directory);
+
+    uint64_t entry_num = 50000;
+    {
+        std::ofstream ofs(input_file);
+        for (uint64_t i = 0; i < entry_num; ++i) {
+            ofs << "key" << i << '\t' << i << '\n';
+        }
+        for (uint64_t i = 0; i < 100; ++i) {
+            ofs << "key" << i << '\t' << i + entry_num << '\n';
+        }
+    }
+
+    auto index = ssindex::SsIndex<std::string, uint64_t>(work_directory);
+    EXPECT_EQ(ssindex::Status::SUCCESS, index.BulkLoad(input_file, 4, 32 << 10));
+
+    uint64_t wrong = 0;
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        uint64_t expected = i < 100 ? i + entry_num : i;
+        if (index.Get("key" + std::to_string(i)) != expected) {
+            wrong++;
+        }
+    }
+    EXPECT_EQ(0, wrong);
+    /// the partitions are sorted in external memory and rewritten as
+    /// sorted runs, only the file of the batch is left
+    for (uint64_t i = 0; i < 200; ++i) {
+        uint64_t expected = i < 100 ? i + entry_num : i;
+        ASSERT_EQ(expected, index.GetVerified("key" + std::to_string(i)));
+    }
+    auto it = std::filesystem::directory_iterator(work_directory);
+    EXPECT_EQ(1, std::distance(std::filesystem::begin(it), std::filesystem::end(it)));
+}
+
+TEST(TestBulkLoader, ExternalEntryFile) {
+    std::filesystem::create_directories(ssindex::default_working_directory);
+    ssindex::ExternalEntryFile<std::string, uint64_t> entries{ssindex::FetchNextSpillFilePrefix(), 4 << 10};
+    uint64_t entry_num = 10000;
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        entries.Append({"key" + std::to_string(i), i});
+    }
+    /// duplicated keys in later runs, the last appended value wins
+    for (uint64_t i = 0; i < entry_num; i += 10) {
+        entries.Append({"key" + std::to_string(i), i + entry_num});
+    }
+    EXPECT_EQ(ssindex::Status::SUCCESS, entries.Finish());
+    EXPECT_GT(entries.GetRunNum(), 1);
+
+    for (size_t round = 0; round < 2; ++round) {
+        std::vector<std::pair<std::string, uint64_t>> sorted{};
+        EXPECT_EQ(ssindex::Status::SUCCESS, entries.Scan([&sorted](const std::pair<std::string, uint64_t> & entry) {
+            sorted.emplace_back(entry);
+        }));
+        ASSERT_EQ(entry_num, sorted.size());
+        for (size_t i = 1; i < sorted.size(); ++i) {
+            ASSERT_LT(sorted[i - 1].first, sorted[i].first);
+        }
+        for (auto & entry : sorted) {
+            auto i = std::stoull(entry.first.substr(3));
+            ASSERT_EQ(i % 10 == 0 ? i + entry_num : i, entry.second);
+        }
+    }
+}
+
+TEST(TestBulkLoader, PartitionNum) {
+    std::string work_directory = "/tmp/ssindex_bulk_partition/";
+    std::string input_file = "/tmp/bulk_input_partition.tsv";
+    std::filesystem::remove_all(work_directory);
+    std::filesystem::create_directories(work_directory);
+
+    uint64_t entry_num = 50000;
+    {
+        std::ofstream ofs(input_file);
+        for (uint64_t i = 0; i < entry_num; ++i) {
+            ofs << i << '\t' << i * 2 << '\n';
+        }
+        for (uint64_t i = 0; i < 100; ++i) {
+            ofs << i << '\t' << i + 1 << '\n';
+        }
+    }
+
+    /// the batch picks its partitions from the entries, each of the 4
+    /// partitions of the staging file is split into several blocks
+    for (size_t memory_budget : {size_t{0}, size_t{16 << 10}}) {
+        ssindex::BulkLoader<uint64_t, uint64_t> loader{work_directory, 0x12345678, 8, 2, memory_budget, 4};
+        ASSERT_EQ(ssindex::Status::SUCCESS, loader.Load(input_file));
+        auto block_num = ssindex::ChoosePartitionNum(entry_num + 100);
+        ASSERT_EQ(block_num, loader.blocks_.size());
+        ASSERT_EQ(block_num, loader.file_handle_->GetPartitionNum());
+        EXPECT_EQ(entry_num, loader.file_handle_->GetEntryNum());
+        for (uint64_t i = 0; i < entry_num; ++i) {
+            uint64_t expected = i < 100 ? i + 1 : i * 2;
+            auto part = ssindex::IndexUtils<uint64_t>::Hash(i) % block_num;
+            ASSERT_TRUE(loader.file_handle_->IsSorted(part));
+            uint64_t value = 0;
+            ASSERT_EQ(ssindex::Status::SUCCESS, loader.file_handle_->Lookup(part, i, &value));
+            ASSERT_EQ(expected, value);
+            size_t length = 0;
+            auto buf = ssindex::IndexUtils<uint64_t>::RawBuffer(i, &length);
+            auto & block = loader.blocks_[part];
+            ssindex::IndexEdge<uint64_t> ie{buf.get(), length, 0, block.GetSeed()};
+            ASSERT_EQ(expected, block.GetValue(ie));
+        }
+    }
+}
@@ -38,6 +38,15 @@ TEST(TestEncoding, Basic) {
     std::cout << used << std::endl;
     std::cout << kv_verify.first << ", " << kv_verify.second << std::endl;
 
+    /// narrow values take their own width
+    std::pair<std::string, uint8_t> narrow_verify{};
+    ss = ssindex::Codec<std::pair<std::string, uint8_t>>::EncodeValue(std::make_pair(key, uint8_t(42)), buffff, 100, &used);
+    EXPECT_EQ(ssindex::Status::SUCCESS, ss);
+    EXPECT_EQ(sizeof(uint64_t) + key.size() + sizeof(uint8_t), used);
+    ssindex::Codec<std::pair<std::string, uint8_t>>::DecodeValue(buffff, &narrow_verify, &used);
+    EXPECT_EQ(key, narrow_verify.first);
+    EXPECT_EQ(42, narrow_verify.second);
+
 
     key = std::string{"hello"};
     char * key_buf = new char[1];
@@ -0,0 +1,41 @@
+#include <gtest/gtest.h>
+
+#include "../src/ssindex.hpp"
+
+TEST(TestGetVerified, Exact) {
+    std::string work_directory = "/tmp/ssindex_verified/";
+    std::filesystem::remove_all(work_directory);
+
+    const uint32_t entry_num = 50000;
+    ssindex::SsIndex<std::string, uint32_t> index{work_directory};
+    /// without fingerprints, |Get| answers any key with some value
+    index.SetFpBits(0, 0);
+    index.SetMemtableFlushThreshold(12500);
+    for (uint32_t i = 0; i < entry_num; ++i) {
+        index.Set("key_" + std::to_string(i), i);
+    }
+    /// overwrites land in newer batches
+    for (uint32_t i = 0; i < entry_num; i += 3) {
+        index.Set("key_" + std::to_string(i), i + 1);
+    }
+    index.WaitTaskComplete();
+
+    auto check = [&]() {
+        for (uint32_t i = 0; i < entry_num; ++i) {
+            auto expected = i % 3 == 0 ? i + 1 : i;
+            ASSERT_EQ(expected, index.GetVerified("key_" + std::to_string(i)));
+        }
+        uint64_t answered = 0;
+        for (uint32_t i = 0; i < 2000; ++i) {
+            auto key = "absent_" + std::to_string(i);
+            ASSERT_EQ(index.key_not_found, index.GetVerified(key));
+            if (index.Get(key) != index.key_not_found) {
+                answered++;
+            }
+        }
+        EXPECT_GT(answered, 0);
+    };
+    check();
+    index.Optimize();
+    check();
+}
@@ -86,4 +86,120 @@ TEST(TestIndexArchivedFile, Hybrid) {
     checkExistence(res, std::string("key0"));
     checkExistence(res, std::string("key9961"));
     //file.PrintInfo();
-}
\ No newline at end of file
+}
+
+TEST(TestIndexArchivedFile, Lookup) {
+    std::string file_name = "/tmp/temp_lookup.data";
+    std::filesystem::remove(file_name);
+
+    auto file = ssindex::IndexArchivedFile<uint64_t, uint64_t>(file_name, 2);
+    const uint64_t entry_num = 10000;
+    /// even keys as a sorted run, odd keys in reverse order
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        file.WriteData(0, i * 2, i);
+        file.WriteData(1, (entry_num - i) * 2 + 1, i);
+    }
+    EXPECT_TRUE(file.IsSorted(0));
+    EXPECT_FALSE(file.IsSorted(1));
+    EXPECT_GT(file.GetFenceUsage(), 0);
+
+    /// long string keys are counted along their objects and vectors
+    std::string string_file_name = "/tmp/temp_lookup_string.data";
+    std::filesystem::remove(string_file_name);
+    auto string_file = ssindex::IndexArchivedFile<std::string, uint64_t>(string_file_name, 1);
+    std::string prefix(100, 'k');
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        string_file.WriteData(0, prefix + std::to_string(i), i);
+    }
+    auto page_num = string_file.GetDataSize() / ssindex::FileManager::PageSize;
+    EXPECT_GE(string_file.GetFenceUsage(), page_num * (sizeof(std::string) + prefix.size()));
+
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        uint64_t value = 0;
+        ASSERT_EQ(ssindex::Status::SUCCESS, file.Lookup(0, i * 2, &value));
+        ASSERT_EQ(i, value);
+        ASSERT_EQ(ssindex::Status::NOT_FOUND, file.Lookup(0, i * 2 + 1, &value));
+    }
+    for (uint64_t i = 0; i < entry_num; i += 97) {
+        uint64_t value = 0;
+        ASSERT_EQ(ssindex::Status::SUCCESS, file.Lookup(1, (entry_num - i) * 2 + 1, &value));
+        ASSERT_EQ(i, value);
+        ASSERT_EQ(ssindex::Status::NOT_FOUND, file.Lookup(1, i * 2, &value));
+    }
+}
+
+TEST(TestIndexArchivedFile, RepartitionedReader) {
+    using File = ssindex::IndexArchivedFile<uint64_t, uint64_t>;
+    const uint64_t entry_num = 20000;
+    /// files of 4 & 1 partitions, the latter holding newer versions
+    std::vector<std::shared_ptr<File>> files{};
+    for (uint64_t partition_num : {4LLU, 1LLU}) {
+        std::string file_name = "/tmp/temp_repartition_" + std::to_string(partition_num) + ".data";
+        std::filesystem::remove(file_name);
+        auto file = std::make_shared<File>(file_name, partition_num);
+        for (uint64_t i = 0; i < entry_num; ++i) {
+            file->WriteData(ssindex::IndexUtils<uint64_t>::Hash(i) % partition_num, i, i + files.size());
+        }
+        EXPECT_EQ(entry_num, file->GetEntryNum());
+        EXPECT_EQ(partition_num, file->GetPartitionNum());
+        files.emplace_back(std::move(file));
+    }
+
+    /// split, kept & merged partitions
+    for (uint64_t target_num : {16LLU, 4LLU, 1LLU}) {
+        ssindex::RepartitionedReader<uint64_t, uint64_t> reader{files, target_num};
+        uint64_t group_num = reader.GetGroupNum();
+        EXPECT_EQ(std::min<uint64_t>(target_num, 4), group_num);
+        std::vector<uint64_t> counts(files.size(), 0);
+        for (uint64_t group = 0; group < group_num; ++group) {
+            std::vector<uint64_t> last(entry_num, 0);
+            auto s = reader.ScanGroup(group, [&](size_t file, const std::pair<uint64_t, uint64_t> & entry) {
+                EXPECT_EQ(group, ssindex::IndexUtils<uint64_t>::Hash(entry.first) % target_num % group_num);
+                EXPECT_EQ(entry.first + file, entry.second);
+                /// the versions of a key come in the order of the files
+                EXPECT_LE(last[entry.first], entry.second);
+                last[entry.first] = entry.second;
+                counts[file]++;
+            });
+            EXPECT_EQ(ssindex::Status::SUCCESS, s);
+        }
+        EXPECT_EQ(std::vector<uint64_t>(files.size(), entry_num), counts);
+    }
+}
+
+TEST(TestIndexArchivedFile, Freeze) {
+    std::string file_name = "/tmp/temp_freeze.data";
+    std::filesystem::remove(file_name);
+
+    const uint64_t partition_num = 8;
+    const uint64_t entry_num = 5000;
+    auto file = ssindex::IndexArchivedFile<uint64_t, uint64_t>(file_name, partition_num);
+    /// partition 7 is never written, so its buffer is never allocated
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        EXPECT_EQ(ssindex::Status::SUCCESS, file.WriteData(i % (partition_num - 1), i, i * 2));
+    }
+    EXPECT_EQ((partition_num - 1) * ssindex::FileManager::PageSize, file.GetBufferUsage());
+
+    EXPECT_EQ(ssindex::Status::SUCCESS, file.Freeze());
+    EXPECT_TRUE(file.IsFrozen());
+    EXPECT_EQ(0, file.GetBufferUsage());
+    EXPECT_EQ(ssindex::Status::ERROR, file.WriteData(0, entry_num, 0));
+
+    /// reads go through the pages only
+    uint64_t total = 0;
+    for (uint64_t part = 0; part < partition_num; ++part) {
+        std::vector<std::pair<uint64_t, uint64_t>> res{};
+        EXPECT_EQ(ssindex::Status::SUCCESS, file.ReadData(part, res));
+        for (size_t j = 0; j < res.size(); ++j) {
+            EXPECT_EQ(part + j * (partition_num - 1), res[j].first);
+            EXPECT_EQ(res[j].first * 2, res[j].second);
+        }
+        total += res.size();
+    }
+    EXPECT_EQ(entry_num, total);
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        uint64_t value = 0;
+        ASSERT_EQ(ssindex::Status::SUCCESS, file.Lookup(i % (partition_num - 1), i, &value));
+        ASSERT_EQ(i * 2, value);
+    }
+}
@@ -35,4 +35,301 @@ TEST(TestIndexBlock, Basic) {
         ssindex::IndexEdge<uint64_t> ie(str.data(), str.size(), 0, 0x12345678);
         std::cout << blk.GetValue(ie) << std::endl;
     }
-}
\ No newline at end of file
+}
+TEST(TestIndexBlock, External) {
+    using Block = ssindex::IndexBlock<uint64_t>;
+    std::filesystem::create_directory(ssindex::default_working_directory);
+
+    uint64_t entry_num = 20000;
+    uint64_t seed = 0x12345678;
+    Block blk{};
+    bool built = false;
+    for (size_t round = 0; round < 20 && !built; ++round, seed += 114514) {
+        /// a tiny budget, so that the edges are spilled in many sorted runs
+        ssindex::ExternalEdgeFile<uint64_t> edges{ssindex::FetchNextSpillFilePrefix(), 16 << 10};
+        for (uint64_t i = 0; i < entry_num; ++i) {
+            auto key = std::to_string(i);
+            edges.Append(ssindex::IndexEdge<uint64_t>{key.data(), key.size(), i, seed});
+        }
+        /// duplicated keys, the last appended value wins
+        for (uint64_t i = 0; i < 100; ++i) {
+            auto key = std::to_string(i);
+            edges.Append(ssindex::IndexEdge<uint64_t>{key.data(), key.size(), i + 1, seed});
+        }
+        EXPECT_EQ(ssindex::Status::SUCCESS, edges.Finish());
+        EXPECT_EQ(entry_num, edges.GetEntryNum());
+        built = blk.TryBuildExternal(edges, seed, 8) == ssindex::Status::SUCCESS;
+    }
+    EXPECT_TRUE(built);
+
+    uint64_t wrong = 0;
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        auto str = std::to_string(i);
+        ssindex::IndexEdge<uint64_t> ie(str.data(), str.size(), 0, blk.GetSeed());
+        if (blk.GetValue(ie) != (i < 100 ? i + 1 : i)) {
+            wrong++;
+        }
+    }
+    EXPECT_EQ(0, wrong);
+}
+
+TEST(TestIndexBlock, Layout) {
+    using Block = ssindex::IndexBlock<uint32_t>;
+    const uint64_t num = 10000;
+    const uint64_t seed = 0x12345678;
+
+    for (auto layout : {ssindex::BlockLayout::INTERLEAVED, ssindex::BlockLayout::SPLIT}) {
+        std::vector<ssindex::IndexEdge<uint32_t>> data{};
+        for (uint64_t i = 0; i < num; ++i) {
+            auto key = std::to_string(i);
+            data.emplace_back(key.data(), key.size(), static_cast<uint32_t>(i * 7), seed);
+        }
+        Block blk{};
+        ASSERT_EQ(ssindex::Status::SUCCESS, blk.TryBuild(data, seed, 8, layout));
+        EXPECT_EQ(layout, blk.GetLayout());
+
+        for (uint64_t i = 0; i < num; ++i) {
+            auto key = std::to_string(i);
+            ssindex::IndexEdge<uint32_t> ie(key.data(), key.size(), 0, seed);
+            EXPECT_EQ(i * 7, blk.GetValue(ie));
+        }
+
+        /// 8 fingerprint bits reject most of the absent keys
+        uint64_t false_positive = 0;
+        for (uint64_t i = num; i < num * 2; ++i) {
+            auto key = std::to_string(i);
+            ssindex::IndexEdge<uint32_t> ie(key.data(), key.size(), 0, seed);
+            if (blk.GetValue(ie) != ssindex::IndexUtils<uint32_t>::KeyNotFound()) {
+                false_positive++;
+            }
+        }
+        EXPECT_LT(false_positive, num / 100);
+    }
+}
+
+TEST(TestIndexBlock, UnalignedFingerprint) {
+    using Block = ssindex::IndexBlock<uint32_t>;
+    const uint64_t num = 10000;
+    const uint64_t seed = 0x12345678;
+    const uint64_t fp_bits = 12;
+
+    /// values of 8 bits, i.e. aligned, along fingerprints which are not
+    for (auto layout : {ssindex::BlockLayout::SPLIT, ssindex::BlockLayout::ALIGNED}) {
+        std::vector<ssindex::IndexEdge<uint32_t>> data{};
+        for (uint64_t i = 0; i < num; ++i) {
+            auto key = std::to_string(i);
+            data.emplace_back(key.data(), key.size(), static_cast<uint32_t>(i % 200), seed);
+        }
+        Block blk{};
+        ASSERT_EQ(ssindex::Status::SUCCESS, blk.TryBuild(data, seed, fp_bits, layout));
+
+        for (uint64_t i = 0; i < num; ++i) {
+            auto key = std::to_string(i);
+            ssindex::IndexEdge<uint32_t> ie(key.data(), key.size(), 0, seed);
+            EXPECT_EQ(i % 200, blk.GetValue(ie));
+        }
+
+        /// 12 fingerprint bits reject all but about 1/4096 of the absent keys
+        uint64_t false_positive = 0;
+        for (uint64_t i = num; i < num * 11; ++i) {
+            auto key = std::to_string(i);
+            ssindex::IndexEdge<uint32_t> ie(key.data(), key.size(), 0, seed);
+            if (blk.GetValue(ie) != ssindex::IndexUtils<uint32_t>::KeyNotFound()) {
+                false_positive++;
+            }
+        }
+        EXPECT_LT(false_positive, num * 10 / 1000);
+    }
+}
+
+TEST(TestIndexBlock, Aligned) {
+    using Block = ssindex::IndexBlock<uint64_t>;
+    const uint64_t num = 5000;
+    const uint64_t seed = 0x12345678;
+
+    /// value ranges of 5, 12, 20 and 40 bits, rounded up to whole words
+    for (uint64_t range : {20LLU, 3000LLU, 1000000LLU, 1LLU << 40}) {
+        for (uint64_t fp_bits : {0, 8, 12}) {
+            std::vector<ssindex::IndexEdge<uint64_t>> data{};
+            for (uint64_t i = 0; i < num; ++i) {
+                auto key = std::to_string(i);
+                data.emplace_back(key.data(), key.size(), (i * 0x9E3779B97F4A7C15LLU) % range, seed);
+            }
+            Block aligned{};
+            ASSERT_EQ(ssindex::Status::SUCCESS, aligned.TryBuild(data, seed, fp_bits, ssindex::BlockLayout::ALIGNED));
+
+            for (uint64_t i = 0; i < num; ++i) {
+                auto key = std::to_string(i);
+                ssindex::IndexEdge<uint64_t> ie(key.data(), key.size(), 0, seed);
+                EXPECT_EQ((i * 0x9E3779B97F4A7C15LLU) % range, aligned.GetValue(ie));
+            }
+        }
+    }
+}
+
+TEST(TestIndexBlock, Patched) {
+    using Block = ssindex::IndexBlock<uint64_t>;
+    const uint64_t num = 20000;
+    const uint64_t seed = 0x12345678;
+
+    /// 1% of the values are outliers far beyond the others
+    auto generate = [&]() {
+        std::vector<ssindex::IndexEdge<uint64_t>> data{};
+        for (uint64_t i = 0; i < num; ++i) {
+            auto key = std::to_string(i);
+            uint64_t value = i % 100 == 0 ? (1LLU << 40) + i : i % 200;
+            data.emplace_back(key.data(), key.size(), value, seed);
+        }
+        return data;
+    };
+
+    auto range_data = generate();
+    Block range{};
+    ASSERT_EQ(ssindex::Status::SUCCESS, range.TryBuild(range_data, seed, 8, ssindex::BlockLayout::SPLIT, ssindex::ValueEncoding::RANGE));
+    auto patched_data = generate();
+    Block patched{};
+    ASSERT_EQ(ssindex::Status::SUCCESS, patched.TryBuild(patched_data, seed, 8, ssindex::BlockLayout::SPLIT, ssindex::ValueEncoding::PATCHED));
+
+    EXPECT_EQ(ssindex::ValueEncoding::PATCHED, patched.GetEncoding());
+    EXPECT_EQ(num / 100, patched.GetExceptionNum());
+    EXPECT_LT(patched.GetFootprint() * 2, range.GetFootprint());
+    /// 8 fingerprint & 8 value bits per key times the redundancy, plus the
+    /// exceptions
+    EXPECT_LT(patched.GetFootprint() * 8, num * 24);
+
+    std::vector<ssindex::IndexEdge<uint64_t>> queries{};
+    for (uint64_t i = 0; i < num; ++i) {
+        auto key = std::to_string(i);
+        queries.emplace_back(key.data(), key.size(), 0, seed);
+        uint64_t expected = i % 100 == 0 ? (1LLU << 40) + i : i % 200;
+        EXPECT_EQ(expected, patched.GetValue(queries.back()));
+    }
+    std::vector<uint64_t> values(num);
+    patched.GetValues(queries.data(), queries.size(), values.data());
+    for (uint64_t i = 0; i < num; ++i) {
+        EXPECT_EQ(patched.GetValue(queries[i]), values[i]);
+    }
+
+    /// uniform values gain nothing from patching
+    std::vector<ssindex::IndexEdge<uint64_t>> uniform{};
+    for (uint64_t i = 0; i < num; ++i) {
+        auto key = std::to_string(i);
+        uniform.emplace_back(key.data(), key.size(), i, seed);
+    }
+    Block plain{};
+    ASSERT_EQ(ssindex::Status::SUCCESS, plain.TryBuild(uniform, seed, 8, ssindex::BlockLayout::SPLIT, ssindex::ValueEncoding::PATCHED));
+    EXPECT_EQ(ssindex::ValueEncoding::RANGE, plain.GetEncoding());
+}
+
+TEST(TestIndexBlock, Dictionary) {
+    using Block = ssindex::IndexBlock<uint64_t>;
+    const uint64_t num = 20000;
+    const uint64_t seed = 0x12345678;
+
+    /// a few hundred shard ids scattered over a wide range
+    auto shard_of = [](uint64_t i) -> uint64_t {
+        return (i % 300) * 1000000007LLU + 17;
+    };
+    auto generate = [&]() {
+        std::vector<ssindex::IndexEdge<uint64_t>> data{};
+        for (uint64_t i = 0; i < num; ++i) {
+            auto key = std::to_string(i);
+            data.emplace_back(key.data(), key.size(), shard_of(i), seed);
+        }
+        return data;
+    };
+
+    auto range_data = generate();
+    Block range{};
+    ASSERT_EQ(ssindex::Status::SUCCESS, range.TryBuild(range_data, seed, 8, ssindex::BlockLayout::SPLIT, ssindex::ValueEncoding::RANGE));
+    auto dictionary_data = generate();
+    Block dictionary{};
+    ASSERT_EQ(ssindex::Status::SUCCESS, dictionary.TryBuild(dictionary_data, seed, 8, ssindex::BlockLayout::SPLIT, ssindex::ValueEncoding::DICTIONARY));
+
+    EXPECT_EQ(ssindex::ValueEncoding::DICTIONARY, dictionary.GetEncoding());
+    EXPECT_EQ(300, dictionary.GetDictionarySize());
+    EXPECT_LT(dictionary.GetFootprint() * 2, range.GetFootprint());
+    /// 8 fingerprint & 9 code bits per key times the redundancy, plus the
+    /// dictionary
+    EXPECT_LT(dictionary.GetFootprint() * 8, num * 25);
+
+    std::vector<ssindex::IndexEdge<uint64_t>> queries{};
+    for (uint64_t i = 0; i < num; ++i) {
+        auto key = std::to_string(i);
+        queries.emplace_back(key.data(), key.size(), 0, seed);
+        EXPECT_EQ(shard_of(i), dictionary.GetValue(queries.back()));
+    }
+    std::vector<uint64_t> values(num);
+    dictionary.GetValues(queries.data(), queries.size(), values.data());
+    for (uint64_t i = 0; i < num; ++i) {
+        EXPECT_EQ(shard_of(i), values[i]);
+    }
+
+    /// the dictionary survives a round trip
+    const std::string file_name = "/tmp/ssindex_dictionary_block";
+    {
+        std::ofstream ofs(file_name, std::ios::binary);
+        dictionary.write(ofs);
+    }
+    Block loaded{};
+    {
+        std::ifstream ifs(file_name, std::ios::binary);
+        loaded.read(ifs);
+    }
+    std::remove(file_name.c_str());
+    EXPECT_EQ(ssindex::ValueEncoding::DICTIONARY, loaded.GetEncoding());
+    for (uint64_t i = 0; i < num; ++i) {
+        EXPECT_EQ(shard_of(i), loaded.GetValue(queries[i]));
+    }
+
+    /// distinct values gain nothing from a dictionary
+    std::vector<ssindex::IndexEdge<uint64_t>> uniform{};
+    for (uint64_t i = 0; i < num; ++i) {
+        auto key = std::to_string(i);
+        uniform.emplace_back(key.data(), key.size(), i, seed);
+    }
+    Block plain{};
+    ASSERT_EQ(ssindex::Status::SUCCESS, plain.TryBuild(uniform, seed, 8, ssindex::BlockLayout::SPLIT, ssindex::ValueEncoding::DICTIONARY));
+    EXPECT_EQ(ssindex::ValueEncoding::RANGE, plain.GetEncoding());
+}
+
+TEST(TestIndexBlock, Filter) {
+    using Block = ssindex::IndexBlock<uint8_t>;
+    const uint64_t num = 20000;
+    const uint64_t seed = 0x12345678;
+    const uint64_t fp_bits = 8;
+
+    for (auto layout : {ssindex::BlockLayout::INTERLEAVED, ssindex::BlockLayout::SPLIT, ssindex::BlockLayout::ALIGNED}) {
+        /// a single value leaves the fingerprints only
+        std::vector<ssindex::IndexEdge<uint8_t>> data{};
+        for (uint64_t i = 0; i < num; ++i) {
+            auto key = std::to_string(i);
+            data.emplace_back(key.data(), key.size(), 7, seed);
+        }
+        Block blk{};
+        ASSERT_EQ(ssindex::Status::SUCCESS, blk.TryBuild(data, seed, fp_bits, layout));
+        EXPECT_LT(blk.GetFootprint() * 8, num * (fp_bits + 1) * 1.3);
+
+        std::vector<ssindex::IndexEdge<uint8_t>> queries{};
+        for (uint64_t i = 0; i < num; ++i) {
+            auto key = std::to_string(i);
+            queries.emplace_back(key.data(), key.size(), 0, seed);
+            EXPECT_EQ(7, blk.GetValue(queries.back()));
+        }
+        std::vector<uint8_t> values(num);
+        blk.GetValues(queries.data(), queries.size(), values.data());
+        for (uint64_t i = 0; i < num; ++i) {
+            EXPECT_EQ(7, values[i]);
+        }
+
+        uint64_t false_positives = 0;
+        for (uint64_t i = num; i < num * 2; ++i) {
+            auto key = std::to_string(i);
+            ssindex::IndexEdge<uint8_t> ie{key.data(), key.size(), 0, seed};
+            if (blk.GetValue(ie) != ssindex::IndexUtils<uint8_t>::KeyNotFound()) {
+                false_positives++;
+            }
+        }
+        EXPECT_LT(false_positives, num / 100);
+    }
+}
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <vector>
+
 #include "../src/index_common.hpp"
 
 TEST(TestIndexCommon, Basic) {
@@ -11,4 +13,61 @@ TEST(TestIndexCommon, Basic) {
     size_t length = 0;
     auto buf = ssindex::IndexUtils<std::string>::RawBuffer(data, &length);
     std::cout << buf << " " << length << std::endl;
-}
\ No newline at end of file
+}
+TEST(TestIndexCommon, FixedHash) {
+    /// fixed-length kernels keep the results of the generic hashes
+    uint64_t k8 = 0x0123456789abcdefLLU;
+    ssindex::Key128 k16{0x0123456789abcdefLLU, 0xfedcba9876543210LLU};
+    uint64_t a = 0, b = 0, c = 0;
+    ssindex::HASH(reinterpret_cast<const char *>(&k8), sizeof(k8), 0x12345678, a, b, c);
+    EXPECT_EQ(0x5a08a6237db15c2cLLU, a);
+    EXPECT_EQ(0x3769ddbd7c8c1446LLU, b);
+    EXPECT_EQ(0xb94d1a6e3e244db0LLU, c);
+    ssindex::HASH(reinterpret_cast<const char *>(&k16), sizeof(k16), 0x12345678, a, b, c);
+    EXPECT_EQ(0xf04ad850202df652LLU, a);
+    EXPECT_EQ(0xae5846bcbd67dfeaLLU, b);
+    EXPECT_EQ(0xe9276793a267f153LLU, c);
+    EXPECT_EQ(0x109ea7ea977741fdLLU, ssindex::HASH(reinterpret_cast<const char *>(&k8), sizeof(k8)));
+    EXPECT_EQ(0xd2bb0bdd363cb754LLU, ssindex::HASH(reinterpret_cast<const char *>(&k16), sizeof(k16)));
+
+    size_t length = 0;
+    auto buf = ssindex::IndexUtils<uint64_t>::RawBuffer(k8, &length);
+    EXPECT_EQ(sizeof(uint64_t), length);
+    EXPECT_EQ(0, memcmp(buf.get(), &k8, length));
+    EXPECT_EQ(ssindex::HASH(buf.get(), length), ssindex::IndexUtils<uint64_t>::Hash(k8));
+    EXPECT_EQ(ssindex::HASH(reinterpret_cast<const char *>(&k16), sizeof(k16)), ssindex::IndexUtils<ssindex::Key128>::Hash(k16));
+    std::string text = "partition_of_a_string_key";
+    EXPECT_EQ(ssindex::HASH(text.data(), text.size()), ssindex::IndexUtils<std::string>::Hash(text));
+
+    ssindex::Key128 uuid{};
+    EXPECT_EQ(ssindex::Status::SUCCESS, ssindex::IndexUtils<ssindex::Key128>::FromString("01234567-89ab-cdef-fedc-ba9876543210", &uuid));
+    EXPECT_EQ(k16, uuid);
+    EXPECT_EQ(ssindex::Status::ERROR, ssindex::IndexUtils<ssindex::Key128>::FromString("01234567-89ab-cdef-fedc-ba987654321x", &uuid));
+
+    /// malformed and out-of-range integers are rejected, not thrown
+    uint8_t narrow = 0;
+    EXPECT_EQ(ssindex::Status::SUCCESS, ssindex::IndexUtils<uint8_t>::FromString("255", &narrow));
+    EXPECT_EQ(255, narrow);
+    EXPECT_EQ(ssindex::Status::ERROR, ssindex::IndexUtils<uint8_t>::FromString("256", &narrow));
+    uint64_t wide = 0;
+    EXPECT_EQ(ssindex::Status::ERROR, ssindex::IndexUtils<uint64_t>::FromString("12a", &wide));
+    EXPECT_EQ(ssindex::Status::ERROR, ssindex::IndexUtils<uint64_t>::FromString("", &wide));
+    EXPECT_EQ(ssindex::Status::ERROR, ssindex::IndexUtils<uint64_t>::FromString("99999999999999999999", &wide));
+}
+TEST(TestIndexCommon, ChoosePartitionNum) {
+    EXPECT_EQ(1, ssindex::ChoosePartitionNum(0));
+    EXPECT_EQ(1, ssindex::ChoosePartitionNum(ssindex::DefaultPartitionSize));
+    EXPECT_EQ(2, ssindex::ChoosePartitionNum(ssindex::DefaultPartitionSize + 1));
+    /// the default memtable keeps the default number of partitions
+    EXPECT_EQ(ssindex::DefaultPartitionNum, ssindex::ChoosePartitionNum(ssindex::MemtableFlushThreshold));
+    EXPECT_EQ(ssindex::MaxPartitionNum, ssindex::ChoosePartitionNum(1LLU << 40));
+
+    /// out of 8 and 16 partitions, group 5 out of 8 is made of partition 5
+    /// out of 8, and of partitions 5 & 13 out of 16
+    std::vector<uint64_t> parts{};
+    ssindex::ForEachGroupPartition(8, 8, 5, [&](uint64_t part) { parts.emplace_back(part); });
+    EXPECT_EQ(std::vector<uint64_t>({5}), parts);
+    parts.clear();
+    ssindex::ForEachGroupPartition(16, 8, 5, [&](uint64_t part) { parts.emplace_back(part); });
+    EXPECT_EQ(std::vector<uint64_t>({5, 13}), parts);
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "../src/kv_store.hpp"
+
+auto makeValue(uint64_t key, uint64_t version) -> std::string {
+    /// values of various lengths
+    return std::string(key % 97 + 1, char('a' + version % 26)) + std::to_string(key);
+}
+
+TEST(TestValueLog, AppendAndRead) {
+    std::string work_directory = "/tmp/ssindex_vlog/";
+    std::filesystem::remove_all(work_directory);
+
+    ssindex::ValueLog log{work_directory, 4096};
+    std::vector<ssindex::ValueRef> refs{};
+    for (uint64_t i = 0; i < 1000; ++i) {
+        auto key = std::to_string(i);
+        auto value = makeValue(i, 0);
+        ssindex::ValueRef ref = 0;
+        ASSERT_EQ(log.Append(key.data(), key.size(), value.data(), value.size(), &ref), ssindex::Status::SUCCESS);
+        refs.emplace_back(ref);
+    }
+    EXPECT_GT(log.GetSegmentNum(), 1);
+    for (uint64_t i = 0; i < 1000; ++i) {
+        ssindex::ValueView view{};
+        ASSERT_EQ(log.Read(refs[i], &view), ssindex::Status::SUCCESS);
+        ASSERT_EQ(view.key_, std::to_string(i));
+        ASSERT_EQ(view.value_, makeValue(i, 0));
+    }
+
+    ssindex::ValueView view{};
+    EXPECT_EQ(log.Read(refs[0] + 1, &view), ssindex::Status::NOT_FOUND);
+    EXPECT_EQ(log.Read(UINT64_MAX, &view), ssindex::Status::NOT_FOUND);
+    std::string huge(8192, 'x');
+    ssindex::ValueRef ref = 0;
+    EXPECT_EQ(log.Append("k", 1, huge.data(), huge.size(), &ref), ssindex::Status::ERROR);
+
+    /// a view outlives the segment
+    ASSERT_EQ(log.Read(refs[0], &view), ssindex::Status::SUCCESS);
+    log.MarkDead(refs[0]);
+    log.DropSegment(refs[0] >> ssindex::ValueRefOffsetBits);
+    EXPECT_EQ(view.value_, makeValue(0, 0));
+    ssindex::ValueView dropped{};
+    EXPECT_EQ(log.Read(refs[0], &dropped), ssindex::Status::NOT_FOUND);
+}
+
+TEST(TestKvStore, OverwriteAndCollect) {
+    std::string work_directory = "/tmp/ssindex_kv_store/";
+    std::filesystem::remove_all(work_directory);
+
+    const uint64_t entry_num = 50000;
+    const uint64_t version_num = 3;
+    ssindex::KvStore<std::string> store{work_directory, 0.5, 1 << 20};
+    store.SetMemtableFlushThreshold(20000);
+    for (uint64_t version = 0; version < version_num; ++version) {
+        for (uint64_t i = 0; i < entry_num; ++i) {
+            ASSERT_EQ(store.Put("key_" + std::to_string(i), makeValue(i, version)), ssindex::Status::SUCCESS);
+        }
+    }
+    store.WaitTaskComplete();
+
+    auto check = [&]() {
+        for (uint64_t i = 0; i < entry_num; ++i) {
+            ssindex::ValueView view{};
+            ASSERT_EQ(store.Get("key_" + std::to_string(i), &view), ssindex::Status::SUCCESS);
+            ASSERT_EQ(view.value_, makeValue(i, version_num - 1));
+        }
+        for (uint64_t i = 0; i < 1000; ++i) {
+            ssindex::ValueView view{};
+            ASSERT_EQ(store.Get("absent_" + std::to_string(i), &view), ssindex::Status::NOT_FOUND);
+        }
+    };
+    check();
+
+    store.Optimize();
+    store.WaitTaskComplete();
+    auto before = store.GetLogUsage();
+    store.CollectGarbage();
+    std::cout << "Log Usage: " << before << " -> " << store.GetLogUsage() << std::endl;
+    EXPECT_LT(store.GetLogUsage(), before);
+    check();
+}
+
+TEST(TestKvStore, GetDuringCollection) {
+    std::string work_directory = "/tmp/ssindex_kv_store_gc/";
+    std::filesystem::remove_all(work_directory);
+
+    const uint64_t stable_num = 2000;
+    const uint64_t hot_num = 2000;
+    const uint64_t round_num = 20;
+    ssindex::KvStore<std::string> store{work_directory, 0.3, 1 << 16};
+    store.SetMemtableFlushThreshold(4000);
+    /// the stable keys are never overwritten, their records are moved by
+    /// the collection of the segments filled with the hot ones
+    for (uint64_t i = 0; i < stable_num; ++i) {
+        ASSERT_EQ(store.Put("stable_" + std::to_string(i), makeValue(i, 0)), ssindex::Status::SUCCESS);
+        ASSERT_EQ(store.Put("hot_" + std::to_string(i % hot_num), makeValue(i, 0)), ssindex::Status::SUCCESS);
+    }
+
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> failures{0};
+    std::vector<std::thread> readers{};
+    for (uint64_t t = 0; t < 2; ++t) {
+        readers.emplace_back([&, t]() {
+            for (uint64_t i = t; !done.load(); i = (i + 7) % stable_num) {
+                ssindex::ValueView view{};
+                if (store.Get("stable_" + std::to_string(i), &view) != ssindex::Status::SUCCESS
+                    || view.value_ != makeValue(i, 0)) {
+                    failures.fetch_add(1);
+                }
+            }
+        });
+    }
+    size_t collected = 0;
+    for (uint64_t round = 1; round < round_num; ++round) {
+        for (uint64_t i = 0; i < hot_num; ++i) {
+            ASSERT_EQ(store.Put("hot_" + std::to_string(i), makeValue(i, round)), ssindex::Status::SUCCESS);
+        }
+        collected += store.CollectGarbage();
+    }
+    done.store(true);
+    for (auto & reader : readers) {
+        reader.join();
+    }
+    store.WaitTaskComplete();
+    EXPECT_GT(collected, 0);
+    EXPECT_EQ(0, failures.load());
+}
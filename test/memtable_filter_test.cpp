@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+
+#include <future>
+
+#include "../src/memtable_filter.hpp"
+#include "../src/ssindex.hpp"
+
+namespace {
+
+/// Blocks its worker until the gate is opened
+struct GateTask : public ssindex::Task {
+    explicit GateTask(std::shared_future<void> gate) : gate_(std::move(gate)) {}
+
+    ssindex::Status Execute() override {
+        gate_.wait();
+        return ssindex::Status::SUCCESS;
+    }
+
+    std::shared_future<void> gate_;
+};
+
+/// Runs |hook| on its worker
+struct HookTask : public ssindex::Task {
+    explicit HookTask(std::function<void()> hook) : hook_(std::move(hook)) {}
+
+    ssindex::Status Execute() override {
+        hook_();
+        return ssindex::Status::SUCCESS;
+    }
+
+    std::function<void()> hook_;
+};
+
+}  // namespace
+
+TEST(TestMemtableFilter, Basic) {
+    const uint64_t entry_num = 100000;
+    ssindex::MemtableFilter filter{entry_num};
+    ssindex::KeyHasher<std::string>::type hasher{};
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        filter.Add(hasher("key_" + std::to_string(i)));
+    }
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        ASSERT_TRUE(filter.MayContain(hasher("key_" + std::to_string(i))));
+    }
+
+    uint64_t false_positives = 0;
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        if (filter.MayContain(hasher("absent_" + std::to_string(i)))) {
+            false_positives++;
+        }
+    }
+    double fp_rate = double(false_positives) / double(entry_num);
+    std::cout << "False Positive Rate: " << fp_rate << std::endl;
+    EXPECT_LT(fp_rate, 0.03);
+    EXPECT_LE(filter.GetFootprint(), entry_num * ssindex::MemtableFilter::BitsPerKey / 8 + 128);
+}
+
+TEST(TestMemtableFilter, FixedKeys) {
+    const uint64_t entry_num = 100000;
+    ssindex::MemtableFilter filter{entry_num};
+    ssindex::KeyHasher<uint64_t>::type hasher{};
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        filter.Add(hasher(i));
+    }
+    uint64_t false_positives = 0;
+    for (uint64_t i = entry_num; i < entry_num * 2; ++i) {
+        ASSERT_TRUE(filter.MayContain(hasher(i - entry_num)));
+        if (filter.MayContain(hasher(i))) {
+            false_positives++;
+        }
+    }
+    EXPECT_LT(double(false_positives) / double(entry_num), 0.03);
+}
+
+TEST(TestMemtableFilter, NewestImmutableWins) {
+    std::string work_directory = "/tmp/ssindex_imm_overwrite/";
+    std::filesystem::remove_all(work_directory);
+
+    /// keep the only worker busy, so that the immutable memtables stay queued
+    ssindex::Scheduler scheduler{1};
+    std::promise<void> gate{};
+    scheduler.ScheduleTask(std::make_unique<GateTask>(gate.get_future().share()));
+    {
+        ssindex::SsIndex<uint64_t, uint64_t> index{work_directory, ssindex::WriteControllerOptions{}, &scheduler};
+        index.SetMemtableFlushThreshold(100);
+        for (uint64_t round = 1; round <= 2; ++round) {
+            for (uint64_t i = 0; i < 100; ++i) {
+                index.Set(i, i * round);
+            }
+        }
+        /// two immutable memtables hold every key, the newer one wins
+        for (uint64_t i = 0; i < 100; ++i) {
+            ASSERT_EQ(i * 2, index.Get(i));
+        }
+        std::vector<uint64_t> keys{};
+        for (uint64_t i = 0; i < 100; ++i) {
+            keys.emplace_back(i);
+        }
+        auto values = index.MultiGet(keys);
+        for (uint64_t i = 0; i < 100; ++i) {
+            ASSERT_EQ(i * 2, values[i]);
+        }
+        gate.set_value();
+        index.WaitTaskComplete();
+        for (uint64_t i = 0; i < 100; ++i) {
+            ASSERT_EQ(i * 2, index.Get(i));
+        }
+    }
+    scheduler.Stop();
+}
+
+TEST(TestMemtableFilter, FailedFlushHoldsNewerBatches) {
+    std::string work_directory = "/tmp/ssindex_failed_flush/";
+    std::filesystem::remove_all(work_directory);
+
+    ssindex::Scheduler scheduler{1};
+    std::promise<void> gate{};
+    std::promise<void> reached{};
+    std::promise<void> release{};
+    scheduler.ScheduleTask(std::make_unique<GateTask>(gate.get_future().share()));
+    {
+        ssindex::SsIndex<uint64_t, uint64_t> index{work_directory, ssindex::WriteControllerOptions{}, &scheduler};
+        index.SetMemtableFlushThreshold(100);
+
+        /// the first flush cannot create its file, the second one can
+        std::filesystem::remove_all(work_directory);
+        for (uint64_t i = 0; i < 100; ++i) {
+            index.Set(i, i);
+        }
+        scheduler.ScheduleTask(std::make_unique<HookTask>([&work_directory] {
+            std::filesystem::create_directories(work_directory);
+        }));
+        for (uint64_t i = 0; i < 100; ++i) {
+            index.Set(i, i * 2);
+        }
+        /// hold the worker before the retry of the first flush
+        scheduler.ScheduleTask(std::make_unique<HookTask>([&reached, &release] {
+            reached.set_value();
+            release.get_future().wait();
+        }));
+        gate.set_value();
+        reached.get_future().wait();
+
+        /// the second batch is held back behind the failed memtable, which
+        /// must not shadow the newer values
+        ASSERT_EQ(2, index.GetImmutableNum());
+        for (uint64_t i = 0; i < 100; ++i) {
+            ASSERT_EQ(i * 2, index.Get(i));
+        }
+
+        release.set_value();
+        index.WaitTaskComplete();
+        ASSERT_EQ(0, index.GetImmutableNum());
+        for (uint64_t i = 0; i < 100; ++i) {
+            ASSERT_EQ(i * 2, index.Get(i));
+            ASSERT_EQ(i * 2, index.GetVerified(i));
+        }
+    }
+    scheduler.Stop();
+}
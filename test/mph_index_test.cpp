@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+
+#include "../src/mph_index.hpp"
+
+TEST(TestMphIndex, Basic) {
+    const uint64_t num = 200000;
+    std::vector<std::string> keys{};
+    for (uint64_t i = 0; i < num; ++i) {
+        keys.emplace_back("key_" + std::to_string(i));
+    }
+    /// duplicates are ranked once
+    keys.emplace_back("key_0");
+    keys.emplace_back("key_42");
+
+    ssindex::MphIndex<std::string> index{};
+    ASSERT_EQ(ssindex::Status::SUCCESS, index.Build(keys));
+    ASSERT_EQ(num, index.Size());
+
+    /// every key gets a distinct rank in [0, n)
+    std::vector<bool> seen(num, false);
+    for (uint64_t i = 0; i < num; ++i) {
+        auto rank = index.Get(keys[i]);
+        ASSERT_LT(rank, num);
+        ASSERT_FALSE(seen[rank]);
+        seen[rank] = true;
+    }
+
+    double bits_per_key = index.GetUsage() * 8.0 / double(num);
+    std::cout << "Bits per Key: " << bits_per_key << std::endl;
+    EXPECT_LT(bits_per_key, 3.0);
+
+    for (uint64_t i = 0; i < 1000; ++i) {
+        EXPECT_LT(index.Get("absent_" + std::to_string(i)), num);
+    }
+
+    const std::string file_name = "/tmp/ssindex_mph_index";
+    ASSERT_EQ(ssindex::Status::SUCCESS, index.Save(file_name));
+    ssindex::MphIndex<std::string> loaded{};
+    ASSERT_EQ(ssindex::Status::SUCCESS, loaded.Load(file_name));
+    std::remove(file_name.c_str());
+    ASSERT_EQ(num, loaded.Size());
+    for (uint64_t i = 0; i < num; ++i) {
+        ASSERT_EQ(index.Get(keys[i]), loaded.Get(keys[i]));
+    }
+}
+
+TEST(TestMphIndex, Small) {
+    /// partitions with a handful of keys, or none at all
+    std::vector<std::string> keys{"a", "b", "c"};
+    ssindex::MphIndex<std::string> index{};
+    ASSERT_EQ(ssindex::Status::SUCCESS, index.Build(keys, 1));
+    ASSERT_EQ(3, index.Size());
+    std::vector<bool> seen(3, false);
+    for (auto & key : keys) {
+        auto rank = index.Get(key);
+        ASSERT_LT(rank, 3);
+        ASSERT_FALSE(seen[rank]);
+        seen[rank] = true;
+    }
+}
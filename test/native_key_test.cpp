@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+
+#include "../src/ssindex.hpp"
+
+TEST(TestNativeKey, Uint64) {
+    std::string work_directory = "/tmp/ssindex_native_u64/";
+    std::filesystem::remove_all(work_directory);
+
+    const uint64_t entry_num = 300000;
+    ssindex::SsIndex<uint64_t, uint64_t> index{work_directory};
+    /// sparse ids, as the ids of a real table
+    auto key_of = [](uint64_t i) -> uint64_t {
+        return i * 0x9e3779b97f4a7c15LLU;
+    };
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        index.Set(key_of(i), i);
+    }
+    index.WaitTaskComplete();
+
+    auto count_wrong = [&]() -> uint64_t {
+        uint64_t wrong = 0;
+        for (uint64_t i = 0; i < entry_num; ++i) {
+            if (index.Get(key_of(i)) != i) {
+                wrong++;
+            }
+        }
+        return wrong;
+    };
+    /// a newer batch may shadow a key with a false positive until the
+    /// batches are merged
+    EXPECT_LT(count_wrong(), entry_num / 100);
+    index.Optimize();
+    EXPECT_EQ(0, count_wrong());
+
+    std::vector<uint64_t> keys{};
+    for (uint64_t i = 0; i < entry_num; i += 7) {
+        keys.emplace_back(key_of(i));
+    }
+    auto values = index.MultiGet(keys);
+    for (size_t j = 0; j < keys.size(); ++j) {
+        EXPECT_EQ(j * 7, values[j]);
+    }
+    std::cout << "Memory Usage: " << index.GetUsage() << " Bytes" << std::endl;
+}
+
+TEST(TestNativeKey, Key128) {
+    std::string work_directory = "/tmp/ssindex_native_key128/";
+    std::filesystem::remove_all(work_directory);
+    std::filesystem::create_directories(work_directory);
+
+    /// UUIDs in text form go through the bulk loader
+    const uint64_t entry_num = 100000;
+    auto key_of = [](uint64_t i) -> ssindex::Key128 {
+        return ssindex::Key128{i * 0x9e3779b97f4a7c15LLU, ~i};
+    };
+    auto input_file = work_directory + "input.tsv";
+    {
+        std::ofstream ofs(input_file);
+        for (uint64_t i = 0; i < entry_num; ++i) {
+            auto key = key_of(i);
+            char text[40];
+            snprintf(text, sizeof(text), "%08llx-%04llx-%04llx-%04llx-%012llx",
+                     (unsigned long long)(key.hi_ >> 32), (unsigned long long)((key.hi_ >> 16) & 0xFFFF),
+                     (unsigned long long)(key.hi_ & 0xFFFF), (unsigned long long)(key.lo_ >> 48),
+                     (unsigned long long)(key.lo_ & 0xFFFFFFFFFFFFLLU));
+            ofs << text << "\t" << i << "\n";
+        }
+    }
+
+    ssindex::SsIndex<ssindex::Key128, uint64_t> index{work_directory};
+    ASSERT_EQ(ssindex::Status::SUCCESS, index.BulkLoad(input_file, 4));
+    for (uint64_t i = entry_num; i < entry_num * 2; ++i) {
+        index.Set(key_of(i), i);
+    }
+    index.WaitTaskComplete();
+    index.Optimize();
+
+    uint64_t wrong = 0;
+    for (uint64_t i = 0; i < entry_num * 2; ++i) {
+        if (index.Get(key_of(i)) != i) {
+            wrong++;
+        }
+    }
+    EXPECT_EQ(0, wrong);
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "../src/ssindex.hpp"
+
+TEST(TestReadCache, Basic) {
+    using Cache = ssindex::ReadCache<uint64_t, uint64_t>;
+    Cache cache{Cache::EntryFootprint * Cache::ShardNum * 64};
+    for (uint64_t i = 0; i < 100; ++i) {
+        cache.Insert(i, i * 2, cache.GetTicket(i));
+    }
+    uint64_t value = 0;
+    ASSERT_TRUE(cache.Lookup(7, &value));
+    EXPECT_EQ(14, value);
+
+    /// a write between the ticket and the insert wins
+    auto ticket = cache.GetTicket(1000);
+    cache.Erase(1000);
+    cache.Insert(1000, 1, ticket);
+    EXPECT_FALSE(cache.Lookup(1000, &value));
+
+    cache.Erase(7);
+    EXPECT_FALSE(cache.Lookup(7, &value));
+
+    ticket = cache.GetTicket(8);
+    cache.Invalidate();
+    EXPECT_FALSE(cache.Lookup(8, &value));
+    cache.Insert(8, 16, ticket);
+    EXPECT_FALSE(cache.Lookup(8, &value));
+
+    auto stats = cache.GetStats();
+    EXPECT_EQ(1, stats.hits_);
+    EXPECT_EQ(4, stats.misses_);
+}
+
+TEST(TestReadCache, Clock) {
+    using Cache = ssindex::ReadCache<uint64_t, uint64_t>;
+    Cache cache{Cache::EntryFootprint * Cache::ShardNum * 64};
+    /// hot keys keep being referenced while a scan of cold keys goes by
+    const uint64_t hot_num = 64;
+    for (uint64_t i = 0; i < hot_num; ++i) {
+        cache.Insert(i, i, cache.GetTicket(i));
+    }
+    uint64_t value = 0;
+    for (uint64_t i = hot_num; i < 100000; ++i) {
+        cache.Lookup(i % hot_num, &value);
+        cache.Insert(i, i, cache.GetTicket(i));
+    }
+    uint64_t hot_hits = 0;
+    for (uint64_t i = 0; i < hot_num; ++i) {
+        hot_hits += cache.Lookup(i, &value) ? 1 : 0;
+    }
+    EXPECT_GT(hot_hits, hot_num * 3 / 4);
+}
+
+TEST(TestReadCache, SsIndex) {
+    std::string work_directory = "/tmp/ssindex_read_cache/";
+    std::filesystem::remove_all(work_directory);
+
+    const uint64_t entry_num = 200000;
+    ssindex::SsIndex<uint64_t, uint64_t> index{work_directory};
+    index.EnableReadCache(1 << 20);
+    index.SetMemtableFlushThreshold(50000);
+    std::vector<uint64_t> expected(entry_num);
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        index.Set(i, i);
+        expected[i] = i;
+    }
+    index.Optimize();
+    index.WaitTaskComplete();
+
+    /// Zipfian-like reads, with overwrites in between
+    std::mt19937_64 rng{42};
+    for (uint64_t round = 0; round < 500000; ++round) {
+        auto key = static_cast<uint64_t>(std::pow(double(rng() % entry_num + 1), 2.0) / double(entry_num));
+        key = std::min(key, entry_num - 1);
+        if (round % 100 == 0) {
+            expected[key] = round;
+            index.Set(key, round);
+        }
+        ASSERT_EQ(expected[key], index.Get(key));
+    }
+    index.WaitTaskComplete();
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        ASSERT_EQ(expected[i], index.Get(i));
+    }
+
+    auto stats = index.GetReadCacheStats();
+    double hit_rate = double(stats.hits_) / double(stats.hits_ + stats.misses_);
+    std::cout << "Hit Rate: " << hit_rate << std::endl;
+    EXPECT_GT(stats.hits_, 0);
+}
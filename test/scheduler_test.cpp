@@ -26,6 +26,12 @@ struct SumTask : public ssindex::Task {
     uint64_t * result_;
 };
 
+struct FailTask : public ssindex::Task {
+    Status Execute() override {
+        return Status::ERROR;
+    }
+};
+
 }
 
 TEST(TestScheduler, Basic) {
@@ -54,15 +60,15 @@ TEST(TestScheduler, Basic) {
 TEST(TestScheduler, FlushMemtable) {
     ssindex::Scheduler s{1};
 
-    std::unordered_map<std::string, uint64_t> candidate{};
+    uint64_t partition_num = 8;
+    auto candidate = std::make_shared<ssindex::PartitionedMemtable<std::string, uint64_t>>(partition_num);
     for (uint64_t i = 0; i < 2000; ++i) {
-        candidate[std::to_string(i)] = i;
+        auto key = std::to_string(i);
+        candidate->Insert(ssindex::IndexUtils<std::string>::Hash(key) % partition_num, key, i);
     }
-    uint64_t partition_num = 8;
-    auto partitioner = [&partition_num](const std::string & key) -> uint64_t {
-        return ssindex::HASH(key.data(), key.size()) % partition_num;
-    };
-    auto task = std::make_unique<ssindex::FlushMemtableTask<std::string, uint64_t>>(candidate, 1, partition_num, partitioner);
+    auto task = std::make_unique<ssindex::FlushMemtableTask<std::string, uint64_t>>(candidate, 1);
+    /// the memtable is shared with the task, not copied
+    EXPECT_EQ(2, candidate.use_count());
     std::vector<ssindex::IndexBlock<uint64_t>> blks{};
     std::shared_ptr<ssindex::IndexArchivedFile<std::string, uint64_t>> file{};
     task->SetAcceptor(file, blks);
@@ -73,11 +79,17 @@ TEST(TestScheduler, FlushMemtable) {
 
     std::cout << "SUCCESS" << std::endl;
 
+    /// the buffers of the flushed file are released
+    EXPECT_TRUE(file->IsFrozen());
+    EXPECT_EQ(0, file->GetBufferUsage());
     std::cout << blks.size() << std::endl;
     file->PrintInfo();
 }
 
 TEST(TestScheduler, Compaction) {
+    /// archived file names restart from 0 in each run, don't read stale pages
+    std::filesystem::remove_all(ssindex::default_working_directory);
+    std::filesystem::create_directories(ssindex::default_working_directory);
     ssindex::Scheduler s{1};
     uint64_t partition_num = 8;
 
@@ -88,14 +100,12 @@ TEST(TestScheduler, Compaction) {
     std::vector<ssindex::CompactionTask<std::string, uint64_t>::FileHandlePtr> files{};
     for (uint64_t times = 0; times < 10; times++)
     {
-        std::unordered_map<std::string, uint64_t> candidate{};
+        auto candidate = std::make_shared<ssindex::PartitionedMemtable<std::string, uint64_t>>(partition_num);
         for (uint64_t i = times * 1000; i < times * 1000 + 1000; ++i) {
-            candidate[std::to_string(i)] = i;
+            auto key = std::to_string(i);
+            candidate->Insert(ssindex::IndexUtils<std::string>::Hash(key) % partition_num, key, i);
         }
-        auto partitioner = [&partition_num](const std::string & key) -> uint64_t {
-            return ssindex::HASH(key.data(), key.size()) % partition_num;
-        };
-        auto task = std::make_unique<ssindex::FlushMemtableTask<std::string, uint64_t>>(candidate, 1, partition_num, partitioner);
+        auto task = std::make_unique<ssindex::FlushMemtableTask<std::string, uint64_t>>(candidate, 1);
         std::vector<ssindex::IndexBlock<uint64_t>> blks{};
         std::shared_ptr<ssindex::IndexArchivedFile<std::string, uint64_t>> file{};
         task->SetAcceptor(file, blks);
@@ -110,7 +120,7 @@ TEST(TestScheduler, Compaction) {
     std::vector<ssindex::CompactionTask<std::string, uint64_t>::Batch> batches{};
     for (size_t i = 0; i < 10; i++) batches.emplace_back(std::make_pair(std::move(blocks_s[i]), std::move(files[i])));
 
-    auto task = std::make_unique<ssindex::CompactionTask<std::string, uint64_t>>(batches, partition_num);
+    auto task = std::make_unique<ssindex::CompactionTask<std::string, uint64_t>>(batches);
     std::vector<ssindex::IndexBlock<uint64_t>> blks{};
     std::shared_ptr<ssindex::IndexArchivedFile<std::string, uint64_t>> file{};
     task->SetAcceptor(file, blks);
@@ -121,6 +131,212 @@ TEST(TestScheduler, Compaction) {
 
     std::cout << "SUCCESS" << std::endl;
 
+    /// the compacted batch picks its own number of partitions
+    EXPECT_EQ(ssindex::ChoosePartitionNum(10000), blks.size());
+    EXPECT_EQ(blks.size(), file->GetPartitionNum());
+    EXPECT_EQ(10000, file->GetEntryNum());
     std::cout << blks.size() << std::endl;
     file->PrintInfo();
-}
\ No newline at end of file
+}
+
+TEST(TestScheduler, FutureAndDependency) {
+    ssindex::Scheduler s{2};
+
+    uint64_t first_result = 0;
+    auto first = std::make_unique<ssindex::SumTask>(1, 2);
+    auto * result = first->result_;
+    first->SetPostExecute([result, &first_result]{
+        first_result = *result;
+    });
+    auto first_handle = s.ScheduleTask(std::move(first));
+
+    /// the second task reads the result of the first one
+    auto second = std::make_unique<ssindex::SumTask>(3, 4);
+    uint64_t observed = 0;
+    second->SetPreExecute([&first_result, &observed]{
+        observed = first_result;
+    });
+    second->DependsOn(first_handle);
+    auto second_handle = s.ScheduleTask(std::move(second));
+
+    EXPECT_EQ(ssindex::Status::SUCCESS, second_handle.Wait());
+    EXPECT_TRUE(first_handle.Done());
+    EXPECT_EQ(3, observed);
+
+    s.Stop();
+}
+
+TEST(TestScheduler, Cancellation) {
+    ssindex::Scheduler s{1};
+
+    /// keep the only worker busy so that the following tasks stay queued
+    std::promise<void> gate{};
+    auto gate_future = gate.get_future().share();
+    auto blocker = std::make_unique<ssindex::SumTask>(0, 0);
+    blocker->SetPreExecute([gate_future]{
+        gate_future.wait();
+    });
+    auto blocker_handle = s.ScheduleTask(std::move(blocker));
+
+    bool executed = false;
+    auto victim = std::make_unique<ssindex::SumTask>(1, 1);
+    victim->SetPostExecute([&executed]{
+        executed = true;
+    });
+    auto victim_handle = s.ScheduleTask(std::move(victim));
+
+    auto dependent = std::make_unique<ssindex::SumTask>(2, 2);
+    dependent->DependsOn(victim_handle);
+    auto dependent_handle = s.ScheduleTask(std::move(dependent));
+
+    ssindex::TaskGroup group{};
+    group.Add(victim_handle);
+    EXPECT_EQ(1, group.Cancel());
+    EXPECT_EQ(ssindex::Status::CANCELLED, victim_handle.Wait());
+
+    gate.set_value();
+    EXPECT_EQ(ssindex::Status::SUCCESS, blocker_handle.Wait());
+    EXPECT_EQ(ssindex::Status::CANCELLED, dependent_handle.Wait());
+    EXPECT_FALSE(executed);
+    EXPECT_FALSE(blocker_handle.Cancel());
+
+    s.Stop();
+}
+
+TEST(TestScheduler, Failure) {
+    ssindex::Scheduler s{1};
+
+    bool post_executed = false;
+    auto failing = std::make_unique<ssindex::FailTask>();
+    failing->SetPostExecute([&post_executed]{
+        post_executed = true;
+    });
+    auto failing_handle = s.ScheduleTask(std::move(failing));
+
+    bool executed = false;
+    auto dependent = std::make_unique<ssindex::SumTask>(1, 1);
+    dependent->SetPreExecute([&executed]{
+        executed = true;
+    });
+    dependent->DependsOn(failing_handle);
+    auto dependent_handle = s.ScheduleTask(std::move(dependent));
+
+    /// the failure reaches the dependent task, which never runs
+    EXPECT_EQ(ssindex::Status::ERROR, failing_handle.Wait());
+    EXPECT_EQ(ssindex::Status::ERROR, dependent_handle.Wait());
+    EXPECT_FALSE(executed);
+    EXPECT_FALSE(post_executed);
+
+    s.Stop();
+}
+
+TEST(TestScheduler, GroupCancelWhileWaiting) {
+    ssindex::Scheduler s{1};
+
+    std::promise<void> gate{};
+    auto gate_future = gate.get_future().share();
+    std::promise<void> started{};
+    auto blocker = std::make_unique<ssindex::SumTask>(0, 0);
+    blocker->SetPreExecute([gate_future, &started]{
+        started.set_value();
+        gate_future.wait();
+    });
+    auto blocker_handle = s.ScheduleTask(std::move(blocker));
+
+    ssindex::TaskGroup group{};
+    started.get_future().wait();
+    group.Add(blocker_handle);
+    auto queued_handle = s.ScheduleTask(std::make_unique<ssindex::SumTask>(1, 1));
+    group.Add(queued_handle);
+
+    /// the handles being waited on are still reachable by |Cancel|
+    auto waiter = std::async(std::launch::async, [&group]{
+        return group.Wait();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(1, group.Cancel());
+
+    /// and a task added while waiting is waited on as well
+    auto added_handle = s.ScheduleTask(std::make_unique<ssindex::SumTask>(2, 2));
+    group.Add(added_handle);
+    gate.set_value();
+
+    EXPECT_EQ(ssindex::Status::CANCELLED, waiter.get());
+    EXPECT_TRUE(added_handle.Done());
+    EXPECT_EQ(ssindex::Status::CANCELLED, queued_handle.Wait());
+
+    s.Stop();
+}
+
+TEST(TestScheduler, OnFinish) {
+    ssindex::Scheduler s{1};
+
+    std::promise<void> gate{};
+    auto gate_future = gate.get_future().share();
+    auto blocker = std::make_unique<ssindex::SumTask>(0, 0);
+    blocker->SetPreExecute([gate_future]{
+        gate_future.wait();
+    });
+    std::vector<ssindex::Status> finished(3, ssindex::Status::SUCCESS);
+    blocker->SetOnFinish([&finished](ssindex::Status status) {
+        finished[0] = status;
+    });
+    auto blocker_handle = s.ScheduleTask(std::move(blocker));
+    auto failing = std::make_unique<ssindex::FailTask>();
+    failing->SetOnFinish([&finished](ssindex::Status status) {
+        finished[1] = status;
+    });
+    auto failing_handle = s.ScheduleTask(std::move(failing));
+    auto victim = std::make_unique<ssindex::SumTask>(1, 1);
+    victim->SetOnFinish([&finished](ssindex::Status status) {
+        finished[2] = status;
+    });
+    auto victim_handle = s.ScheduleTask(std::move(victim));
+
+    /// called on every way out, before the waiters are woken up
+    EXPECT_TRUE(victim_handle.Cancel());
+    EXPECT_EQ(ssindex::Status::CANCELLED, finished[2]);
+    finished[0] = ssindex::Status::ERROR;
+    gate.set_value();
+    EXPECT_EQ(ssindex::Status::SUCCESS, blocker_handle.Wait());
+    EXPECT_EQ(ssindex::Status::SUCCESS, finished[0]);
+    EXPECT_EQ(ssindex::Status::ERROR, failing_handle.Wait());
+    EXPECT_EQ(ssindex::Status::ERROR, finished[1]);
+
+    s.Stop();
+}
+
+TEST(TestScheduler, FlushAfterFailedFlush) {
+    std::filesystem::create_directories(ssindex::default_working_directory);
+    ssindex::Scheduler s{2};
+
+    uint64_t partition_num = 8;
+    auto candidate = std::make_shared<ssindex::PartitionedMemtable<std::string, uint64_t>>(partition_num);
+    for (uint64_t i = 0; i < 2000; ++i) {
+        auto key = std::to_string(i);
+        candidate->Insert(ssindex::IndexUtils<std::string>::Hash(key) % partition_num, key, i);
+    }
+
+    /// the first flush fails, the next ones are ordered after it the way
+    /// |SsIndex| orders its flushes
+    auto last = s.ScheduleTask(std::make_unique<ssindex::FailTask>());
+    auto failed_handle = last;
+    std::vector<uint64_t> published{};
+    std::vector<ssindex::TaskHandle> handles{};
+    for (uint64_t id = 1; id < 3; ++id) {
+        auto task = std::make_unique<ssindex::FlushMemtableTask<std::string, uint64_t>>(candidate, id);
+        task->SetPostExecute([&published, id]{
+            published.emplace_back(id);
+        });
+        task->RunsAfter(last);
+        last = s.ScheduleTask(std::move(task));
+        handles.emplace_back(last);
+    }
+
+    EXPECT_EQ(ssindex::Status::ERROR, failed_handle.Wait());
+    EXPECT_EQ(ssindex::Status::SUCCESS, handles[0].Wait());
+    EXPECT_EQ(ssindex::Status::SUCCESS, handles[1].Wait());
+    EXPECT_EQ((std::vector<uint64_t>{1, 2}), published);
+
+    s.Stop();
+}
@@ -0,0 +1,43 @@
+#include <gtest/gtest.h>
+
+#include "../src/sharded_ssindex.hpp"
+
+TEST(TestShardedSsIndex, Basic) {
+    /// no trailing slash, the shards are still within the directory
+    std::string work_directory = "/tmp/ssindex_sharded";
+    std::filesystem::remove_all(work_directory);
+
+    uint64_t entry_num = 200000;
+    auto index = ssindex::ShardedSsIndex<std::string, uint64_t>(work_directory, 4, 4);
+    EXPECT_TRUE(std::filesystem::is_directory(work_directory + "/shard_3"));
+
+    /// writes from multiple threads land on different shards
+    std::vector<std::thread> writers{};
+    for (uint64_t t = 0; t < 4; ++t) {
+        writers.emplace_back([&index, t, entry_num] {
+            for (uint64_t i = t; i < entry_num; i += 4) {
+                index.Set(std::to_string(i), i);
+            }
+        });
+    }
+    for (auto & writer : writers) {
+        writer.join();
+    }
+    index.WaitTaskComplete();
+    index.Optimize();
+
+    std::vector<std::string> keys{};
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        keys.emplace_back(std::to_string(i));
+    }
+    auto values = index.MultiGet(keys);
+    uint64_t wrong = 0;
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        if (values[i] != i) {
+            wrong++;
+        }
+    }
+    EXPECT_EQ(0, wrong);
+    EXPECT_EQ(entry_num - 1, index.Get(std::to_string(entry_num - 1)));
+    std::cout << "Memory Usage: " << index.GetUsage() << " Bytes" << std::endl;
+}
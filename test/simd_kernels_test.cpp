@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "../src/index_block.hpp"
+#include "../src/simd_kernels.hpp"
+
+TEST(TestSimdKernels, Kernels) {
+    std::mt19937_64 rng{0x12345678};
+    std::vector<uint64_t> words(1025);
+    for (auto & word : words) {
+        word = rng();
+    }
+
+    std::vector<ssindex::DecodeSlotsFn> kernels{ssindex::DecodeSlotsScalar};
+#if defined(__x86_64__)
+    if (ssindex::SupportsAvx2()) {
+        kernels.emplace_back(ssindex::DecodeSlotsAvx2);
+    }
+    if (ssindex::SupportsAvx512()) {
+        kernels.emplace_back(ssindex::DecodeSlotsAvx512);
+    }
+#endif
+    std::cout << "Selected Kernel: " << ssindex::GetDecodeSlotsKernelName() << std::endl;
+
+    /// fields of any width, crossing words or not
+    for (uint64_t fp_len : {0, 1, 8, 13}) {
+        for (uint64_t value_len : {1, 7, 32, 57, 64}) {
+            ssindex::DecodeParams params{};
+            uint64_t stride = fp_len + value_len;
+            params.fp_ = ssindex::SlotField{words.data(), stride, 0, fp_len};
+            params.value_ = ssindex::SlotField{words.data(), stride, fp_len, value_len};
+            params.min_value_ = 3;
+            params.max_value_ = value_len == 64 ? ~0LLU : (1LLU << value_len) / 2;
+            params.not_found_ = ~0LLU;
+
+            for (size_t round = 0; round < 100; ++round) {
+                uint64_t vertices[ssindex::NumHashFunctions * ssindex::DecodeBatchSize];
+                uint64_t signatures[ssindex::DecodeBatchSize];
+                for (auto & vertex : vertices) {
+                    vertex = rng() % (64 * 1024 / stride);
+                }
+                for (auto & signature : signatures) {
+                    signature = rng() % 2;
+                }
+                uint64_t expected[ssindex::DecodeBatchSize];
+                ssindex::DecodeSlotsScalar(params, vertices, signatures, expected);
+                for (auto kernel : kernels) {
+                    uint64_t values[ssindex::DecodeBatchSize];
+                    kernel(params, vertices, signatures, values);
+                    for (size_t k = 0; k < ssindex::DecodeBatchSize; ++k) {
+                        EXPECT_EQ(expected[k], values[k]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(TestSimdKernels, GetValues) {
+    const uint64_t num = 10003;
+    const uint64_t seed = 0x12345678;
+
+    for (auto layout : {ssindex::BlockLayout::INTERLEAVED, ssindex::BlockLayout::SPLIT}) {
+        std::vector<ssindex::IndexEdge<uint32_t>> data{};
+        for (uint64_t i = 0; i < num; ++i) {
+            auto key = std::to_string(i);
+            data.emplace_back(key.data(), key.size(), static_cast<uint32_t>(i * 3), seed);
+        }
+        ssindex::IndexBlock<uint32_t> blk{};
+        ASSERT_EQ(ssindex::Status::SUCCESS, blk.TryBuild(data, seed, 8, layout));
+
+        /// present & absent keys
+        std::vector<ssindex::IndexEdge<uint32_t>> queries{};
+        for (uint64_t i = 0; i < num * 2; ++i) {
+            auto key = std::to_string(i);
+            queries.emplace_back(key.data(), key.size(), 0, seed);
+        }
+        std::vector<uint32_t> values(queries.size());
+        blk.GetValues(queries.data(), queries.size(), values.data());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            EXPECT_EQ(blk.GetValue(queries[i]), values[i]);
+        }
+    }
+}
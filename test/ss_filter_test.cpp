@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+
+#include "../src/ss_filter.hpp"
+
+TEST(TestSsFilter, Basic) {
+    std::string work_directory = "/tmp/ssindex_filter/";
+    std::filesystem::remove_all(work_directory);
+
+    const uint64_t entry_num = 200000;
+    ssindex::SsFilter<std::string> filter{work_directory};
+    filter.SetMemtableFlushThreshold(50000);
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        filter.Insert("key_" + std::to_string(i));
+    }
+    filter.WaitTaskComplete();
+
+    auto check = [&]() {
+        std::vector<std::string> keys{};
+        for (uint64_t i = 0; i < entry_num; ++i) {
+            keys.emplace_back("key_" + std::to_string(i));
+            ASSERT_TRUE(filter.MayContain(keys.back()));
+        }
+        auto members = filter.MayContain(keys);
+        for (uint64_t i = 0; i < entry_num; ++i) {
+            ASSERT_TRUE(members[i]);
+        }
+
+        uint64_t false_positives = 0;
+        for (uint64_t i = 0; i < entry_num; ++i) {
+            if (filter.MayContain("absent_" + std::to_string(i))) {
+                false_positives++;
+            }
+        }
+        double fp_rate = double(false_positives) / double(entry_num);
+        std::cout << "False Positive Rate: " << fp_rate << std::endl;
+        EXPECT_LT(fp_rate, 0.005);
+    };
+    check();
+    filter.Optimize();
+    check();
+
+    double bits_per_key = filter.GetUsage() * 8.0 / double(entry_num);
+    std::cout << "Bits per Key: " << bits_per_key << std::endl;
+    EXPECT_LT(bits_per_key, ssindex::DefaultFilterFpBits * 1.5);
+}
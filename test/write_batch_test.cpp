@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include "../src/ssindex.hpp"
+
+TEST(TestWriteBatch, Write) {
+    std::string work_directory = "/tmp/ssindex_write_batch/";
+    std::filesystem::remove_all(work_directory);
+
+    const uint64_t entry_num = 200000;
+    const uint64_t batch_size = 3000;
+    ssindex::SsIndex<uint64_t, uint64_t> index{work_directory};
+    /// batches cross the flush threshold, so the memtable rotates in the
+    /// middle of them
+    index.SetMemtableFlushThreshold(20000);
+    uint64_t dropped = 0;
+    index.SetDropListener([&dropped](const std::pair<uint64_t, uint64_t> &) {
+        dropped++;
+    });
+
+    ssindex::WriteBatch<uint64_t, uint64_t> batch{batch_size};
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        batch.Put(i, i);
+        if (i % 1000 == 0) {
+            /// overwritten within the same batch, the last value wins
+            batch.Put(i, i + 1);
+        }
+        if (batch.Size() >= batch_size) {
+            index.Write(batch);
+            batch.Clear();
+        }
+    }
+    index.Write(batch);
+    batch.Clear();
+    index.Write(batch);
+    index.WaitTaskComplete();
+    EXPECT_EQ(entry_num / 1000, dropped);
+
+    auto count_wrong = [&]() -> uint64_t {
+        uint64_t wrong = 0;
+        for (uint64_t i = 0; i < entry_num; ++i) {
+            if (index.GetVerified(i) != (i % 1000 == 0 ? i + 1 : i)) {
+                wrong++;
+            }
+        }
+        return wrong;
+    };
+    EXPECT_EQ(0, count_wrong());
+    index.Optimize();
+    EXPECT_EQ(0, count_wrong());
+}
+
+TEST(TestWriteBatch, ThrottledPerMemtable) {
+    std::string work_directory = "/tmp/ssindex_write_batch_throttle/";
+    std::filesystem::remove_all(work_directory);
+
+    const uint64_t entry_num = 100000;
+    /// a writer stops as soon as a memtable waits to be flushed
+    ssindex::WriteControllerOptions options{};
+    options.stop_immutable_num_ = 1;
+    ssindex::SsIndex<uint64_t, uint64_t> index{work_directory, options};
+    index.SetMemtableFlushThreshold(10000);
+
+    /// a single batch filling many memtables waits for their flushes
+    ssindex::WriteBatch<uint64_t, uint64_t> batch{entry_num};
+    for (uint64_t i = 0; i < entry_num; ++i) {
+        batch.Put(i, i + 1);
+    }
+    index.Write(batch);
+    EXPECT_GT(index.GetWriteStallStats().stall_count_, 0);
+    index.WaitTaskComplete();
+    for (uint64_t i = 0; i < entry_num; i += 7) {
+        ASSERT_EQ(i + 1, index.GetVerified(i));
+    }
+}
@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include <thread>
+
+#include "../src/write_controller.hpp"
+
+TEST(TestWriteController, Slowdown) {
+    ssindex::WriteControllerOptions options{};
+    options.slowdown_immutable_num_ = 2;
+    options.stop_immutable_num_ = 4;
+    options.min_delay_micros_ = 100;
+    options.max_delay_micros_ = 100;
+    ssindex::WriteController controller{options};
+
+    /// below the threshold, no delay at all
+    controller.SetImmutableNum(1);
+    for (int i = 0; i < 100; ++i) {
+        controller.MaybeThrottle();
+    }
+    EXPECT_EQ(0, controller.GetStats().delay_micros_);
+
+    /// delays are charged per write and slept in chunks
+    controller.SetImmutableNum(2);
+    for (int i = 0; i < 100; ++i) {
+        controller.MaybeThrottle();
+    }
+    auto stats = controller.GetStats();
+    EXPECT_EQ(10000, stats.delay_micros_);
+    EXPECT_EQ(10, stats.delay_count_);
+    EXPECT_EQ(0, stats.stall_count_);
+}
+
+TEST(TestWriteController, Stall) {
+    ssindex::WriteControllerOptions options{};
+    options.stop_pending_compaction_bytes_ = 1024;
+    ssindex::WriteController controller{options};
+
+    controller.AddPendingCompactionBytes(4096);
+    std::thread writer([&controller] {
+        controller.MaybeThrottle();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(0, controller.GetStats().stall_count_);
+
+    /// the writer is released once the backlog is drained
+    controller.SubPendingCompactionBytes(4096);
+    writer.join();
+    auto stats = controller.GetStats();
+    EXPECT_EQ(1, stats.stall_count_);
+    EXPECT_GE(stats.stall_micros_, 10000);
+}
@@ -0,0 +1,84 @@
+#include "../src/ssindex.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+/// Usage: bulk_load <input_file> [working_directory] [parallelism]
+///                  [--memory-budget <bytes>] [--verify]
+///
+/// Builds an index from a flat "<key>\t<value>" file, and reports the build
+/// time and the memory usage. With --memory-budget, partitions are built in
+/// external memory. With --verify, every entry of the input is looked up
+/// afterwards.
+auto main(int argc, char ** argv) -> int {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <input_file> [working_directory] [parallelism] [--memory-budget <bytes>] [--verify]" << std::endl;
+        return 1;
+    }
+    std::string input_file = argv[1];
+    std::string directory = ssindex::default_working_directory;
+    size_t parallelism = std::thread::hardware_concurrency();
+    size_t memory_budget = 0;
+    bool verify = false;
+    int positional = 0;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--verify") {
+            verify = true;
+        } else if (arg == "--memory-budget" && i + 1 < argc) {
+            uint64_t budget = 0;
+            if (ssindex::IndexUtils<uint64_t>::FromString(argv[++i], &budget) != ssindex::Status::SUCCESS) {
+                std::cerr << "Invalid memory budget | " << argv[i] << std::endl;
+                return 1;
+            }
+            memory_budget = budget;
+        } else if (positional++ == 0) {
+            directory = arg;
+        } else {
+            uint64_t num = 0;
+            if (ssindex::IndexUtils<uint64_t>::FromString(arg, &num) != ssindex::Status::SUCCESS) {
+                std::cerr << "Invalid parallelism | " << arg << std::endl;
+                return 1;
+            }
+            parallelism = num;
+        }
+    }
+
+    auto index = ssindex::SsIndex<std::string, uint64_t>(directory);
+
+    auto start = std::chrono::steady_clock::now();
+    auto s = index.BulkLoad(input_file, parallelism, memory_budget);
+    auto end = std::chrono::steady_clock::now();
+    if (s != ssindex::Status::SUCCESS) {
+        std::cerr << "Bulk load failed" << std::endl;
+        return 1;
+    }
+    std::cout << "Build Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms | ";
+    std::cout << "Memory Usage: " << index.GetUsage() << " Bytes" << std::endl;
+
+    if (verify) {
+        std::ifstream ifs(input_file);
+        std::unordered_map<std::string, uint64_t> expected{};
+        std::string line{};
+        while (std::getline(ifs, line)) {
+            auto pos = line.rfind('\t');
+            uint64_t value = 0;
+            /// the load has rejected any malformed line already
+            if (pos != std::string::npos
+                && ssindex::IndexUtils<uint64_t>::FromString(line.substr(pos + 1), &value) == ssindex::Status::SUCCESS) {
+                expected[line.substr(0, pos)] = value;
+            }
+        }
+        uint64_t wrong = 0;
+        for (auto & [key, value] : expected) {
+            if (index.Get(key) != value) {
+                wrong++;
+            }
+        }
+        std::cout << "Verified: " << expected.size() - wrong << " / " << expected.size() << std::endl;
+        return wrong == 0 ? 0 : 1;
+    }
+    return 0;
+}